@@ -0,0 +1,259 @@
+/* AKUMAC: ENCRYPT OR DECRYPT A FILE THROUGH akumad
+ *
+ * akumac [-s SOCKET] [-k KEY] [-a] [-m chain|ctr] [-n REQUESTS] [-c CLIENTS] encrypt|decrypt [IN FILE] [OUT FILE]
+ *
+ * FILES HAVE THE LAYOUT OF encrypt/decrypt, CIPHERTEXT || IV (|| TAG), SO EITHER
+ * SIDE READS WHAT THE OTHER WROTE. -n REPEATS THE REQUEST n TIMES ON EACH OF -c
+ * CONNECTIONS FIRST AND PRINTS THE LATENCY AND THE RATE THE DAEMON KEPT UP.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "akuma.h"
+#include "akumad.h"
+
+struct AkumacLoad {
+	const char * socket_path;
+	int op;
+	uint32_t key;
+	int mode;
+	const unsigned char * iv;
+	const unsigned char * in;
+	size_t in_len;
+	size_t requests;
+	uint64_t * ns;			/* ONE PER REQUEST */
+	size_t failed;
+};
+
+static uint64_t akumac_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void * akumac_load(void * arg) {
+	struct AkumacLoad * load = (struct AkumacLoad *)arg;
+	struct AkumadResult res;
+	int fd = akumad_connect(load->socket_path);
+
+	for (size_t i = 0; i < load->requests; ++i) {
+		uint64_t t0 = akumac_now();
+
+		if (fd < 0 || akumad_call(fd, load->op, load->key, load->mode, load->iv, load->in, load->in_len, &res) != AKUMAD_OK) {
+			++load->failed;
+			continue;
+		}
+
+		akumad_release(&res);
+		load->ns[i] = akumac_now() - t0;
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	return NULL;
+}
+
+static int akumac_compare(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* clients CONNECTIONS IN PARALLEL, requests EACH, THEN ONE LINE OF RESULTS ON stderr */
+
+static int akumac_bench(struct AkumacLoad * proto, unsigned int clients, size_t requests) {
+	struct AkumacLoad * loads = calloc(clients, sizeof(struct AkumacLoad));
+	pthread_t * threads = calloc(clients, sizeof(pthread_t));
+	uint64_t * ns = calloc(clients * requests, sizeof(uint64_t));
+	size_t failed = 0;
+
+	if (loads == NULL || threads == NULL || ns == NULL)
+		return -1;
+
+	uint64_t t0 = akumac_now();
+
+	for (unsigned int c = 0; c < clients; ++c) {
+		loads[c] = *proto;
+		loads[c].requests = requests;
+		loads[c].ns = ns + c * requests;
+
+		if (pthread_create(&threads[c], NULL, akumac_load, &loads[c]) != 0)
+			akumac_load(&loads[c]);
+	}
+
+	for (unsigned int c = 0; c < clients; ++c) {
+		pthread_join(threads[c], NULL);
+		failed += loads[c].failed;
+	}
+
+	double seconds = (double)(akumac_now() - t0) / 1e9;
+	size_t total = clients * requests;
+	uint64_t sum = 0;
+
+	qsort(ns, total, sizeof(uint64_t), akumac_compare);
+
+	for (size_t i = 0; i < total; ++i)
+		sum += ns[i];
+
+	fprintf(stderr, "akumac: %zu requests of %zu bytes on %u connection(s): %.1f us mean, %.1f us p50, %.1f us p99, %.0f requests/s, %zu failed\n",
+			total, proto->in_len, clients, (double)sum / (double)(total - failed + (failed == total)) / 1e3,
+			(double)ns[failed + (total - failed) / 2] / 1e3, (double)ns[failed + (total - failed) * 99 / 100] / 1e3, (double)total / seconds, failed);
+
+	free(loads);
+	free(threads);
+	free(ns);
+
+	return (failed == 0)?0:-1;
+}
+
+static unsigned char * akumac_read(const char * filename, size_t * len) {
+	FILE * f = fopen(filename, "rb");
+
+	if (f == NULL) {
+		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", filename);
+		perror("Error");
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+
+	long size = ftell(f);
+	unsigned char * buf = (size >= 0)?malloc((size_t)size + 1):NULL;
+
+	rewind(f);
+
+	if (buf == NULL || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+		fprintf(stderr, "Failed to read \"%s\"\n", filename);
+		free(buf);
+		buf = NULL;
+	}
+
+	fclose(f);
+	*len = (size_t)size;
+
+	return buf;
+}
+
+int main(int argc, char ** argv) {
+	struct AkumacLoad load;
+	unsigned int clients = 1;
+	size_t requests = 0;
+	int mode = AKUMA_MODE_CHAIN;
+	int auth = 0;
+	int opt;
+
+	memset(&load, 0, sizeof(load));
+	load.socket_path = AKUMAD_SOCKET;
+
+	while ((opt = getopt(argc, argv, "s:k:am:n:c:")) != -1) {
+		switch (opt) {
+		case 's':	/* SOCKET PATH, AKUMAD_SOCKET BY DEFAULT */
+			load.socket_path = optarg;
+			break;
+		case 'k':	/* KEY NUMBER ON THE DAEMON, 0 BY DEFAULT */
+			load.key = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'a':	/* HMAC-SHA256 TAG AFTER THE IV, AS encrypt -a */
+			auth = AKUMA_AUTH;
+			break;
+		case 'm':	/* chain (DEFAULT) OR ctr */
+			mode = (strcmp(optarg, "ctr") == 0)?AKUMA_MODE_CTR:(strcmp(optarg, "chain") == 0)?AKUMA_MODE_CHAIN:-1;
+			break;
+		case 'n':	/* BENCHMARK: REQUESTS PER CONNECTION */
+			requests = (size_t)strtoull(optarg, NULL, 10);
+			break;
+		case 'c':	/* BENCHMARK: CONNECTIONS */
+			clients = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			argc = 0;
+		}
+	}
+
+	if (argc - optind < 3 || mode < 0 || clients == 0 || (strcmp(argv[optind], "encrypt") != 0 && strcmp(argv[optind], "decrypt") != 0)) {
+		fprintf(stderr, "\nUsage: [-s SOCKET] [-k KEY] [-a] [-m chain|ctr] [-n REQUESTS] [-c CLIENTS] encrypt|decrypt [IN FILE] [OUT FILE]\n\n");
+		return -1;
+	}
+
+	char * in_filename = argv[optind + 1];
+	char * out_filename = argv[optind + 2];
+	size_t tag_len = auth?AKUMA_TAG_LENGTH_BYTES:0;
+	size_t in_len;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];
+	unsigned char * in = akumac_read(in_filename, &in_len);
+
+	if (in == NULL)
+		return -1;
+
+	load.op = (strcmp(argv[optind], "encrypt") == 0)?AKUMAD_ENCRYPT:AKUMAD_DECRYPT;
+	load.mode = mode | auth;
+
+/* DECRYPT: CIPHERTEXT || IV || TAG ON DISK, CIPHERTEXT || TAG ON THE WIRE */
+
+	if (load.op == AKUMAD_DECRYPT) {
+		if (in_len < AKUMA_IV_LENGTH_BYTES + tag_len) {
+			fprintf(stderr, "Ciphertext file \"%s\" is truncated or not an Akuma ciphertext\n", in_filename);
+			return -1;
+		}
+
+		in_len -= AKUMA_IV_LENGTH_BYTES;
+		memcpy(iv, in + in_len - tag_len, sizeof(iv));
+		memmove(in + in_len - tag_len, in + in_len - tag_len + AKUMA_IV_LENGTH_BYTES, tag_len);
+		load.iv = iv;
+	}
+
+	load.in = in;
+	load.in_len = in_len;
+
+	if (requests > 0 && akumac_bench(&load, clients, requests) != 0)
+		fprintf(stderr, "Some requests failed\n");
+
+	int fd = akumad_connect(load.socket_path);
+	struct AkumadResult res;
+	int status = (fd < 0)?AKUMAD_EREQUEST:akumad_call(fd, load.op, load.key, load.mode, load.iv, in, in_len, &res);
+
+	if (status != AKUMAD_OK) {
+		fprintf(stderr, "%s failed (%s).\nAborting...\n", (fd < 0)?"Connecting to akumad":"The request", (status == AKUMAD_EKEY)?"no such key":(status == AKUMAD_EFAIL)?"wrong key or corrupted ciphertext":"daemon error");
+		return -1;
+	}
+
+	FILE * outfile = fopen(out_filename, "wb");
+
+	if (outfile == NULL) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [fopen()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	if (load.op == AKUMAD_ENCRYPT) {
+		fwrite(res.data, 1, res.len - tag_len, outfile);
+		fwrite(res.iv, 1, sizeof(res.iv), outfile);
+		fwrite(res.data + res.len - tag_len, 1, tag_len, outfile);
+	} else {
+		fwrite(res.data, 1, res.len, outfile);
+	}
+
+	akumad_release(&res);
+	close(fd);
+	free(in);
+
+	if (fclose(outfile) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	printf("Success!\n%s data now stored in \"%s\"\n", (load.op == AKUMAD_ENCRYPT)?"Encrypted":"Decrypted", out_filename);
+
+	return 0;
+}
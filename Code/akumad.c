@@ -0,0 +1,556 @@
+/* AKUMAD: KEYS LOADED ONCE, ENCRYPT/DECRYPT REQUESTS OVER A UNIX DOMAIN SOCKET
+ *
+ * akumad [--stats] [-s SOCKET] [-t WORKERS] [KEY FILE ...]
+ *
+ * KEY FILE n IS KEY n IN A REQUEST, SET UP IN ALL FOUR MODES AT START. EVERY
+ * CONNECTION GETS A THREAD THAT READS ITS REQUESTS AND QUEUES THEM. A WORKER TAKES
+ * THE OLDEST REQUEST AND, IF IT IS SMALL, EVERY OTHER QUEUED SMALL REQUEST FOR THE
+ * SAME KEY, MODE AND DIRECTION (UP TO AKUMAD_BATCH) AND RUNS THEM AS ONE BATCH:
+ * THE IVS FROM THE WORKER'S OWN POOL (Akuma_IVs()) AND ONE Akuma_KeyEncryptBatch(). REQUESTS
+ * ARRIVING WHILE THE WORKERS ARE BUSY ARE COALESCED THAT WAY, NONE IS HELD BACK
+ * WAITING FOR COMPANY. SEE akumad.h FOR THE PROTOCOL.
+ *
+ * THE SOCKET IS CREATED 0600 AND ONLY CONNECTIONS FROM THE DAEMON'S OWN USER ARE
+ * SERVED. SIGINT/SIGTERM REMOVE IT AND END THE DAEMON.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <openssl/rand.h>
+
+#include "akuma.h"
+#include "akumad.h"
+
+#define AKUMAD_BATCH   64		/* MOST REQUESTS RUN BY ONE WORKER CALL */
+#define AKUMAD_MODES   4		/* CHAIN, CTR, EACH WITH OR WITHOUT AKUMA_AUTH */
+
+struct AkumadJob {
+	struct AkumadRequest req;
+	const unsigned char * in;
+	unsigned char * out;
+	size_t out_len;
+	int status;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];	/* ENCRYPT: FILLED IN BY THE WORKER */
+	sem_t done;
+	struct AkumadJob * next;
+};
+
+struct AkumadServer {
+	Akuma_Key * keys;		/* n_keys * AKUMAD_MODES */
+	size_t n_keys;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	struct AkumadJob * head;
+	struct AkumadJob * tail;
+
+	int listen_fd;
+	_Atomic uint64_t requests;
+	_Atomic uint64_t batches;
+};
+
+struct AkumadConn {
+	struct AkumadServer * srv;
+	int fd;
+};
+
+static int akumad_variant(int mode) {
+	return (mode & AKUMA_MODE_CTR) | ((mode & AKUMA_AUTH)?2:0);
+}
+
+static bool akumad_small(const struct AkumadJob * job) {
+	return job->req.len < AKUMAD_SHM_MIN;
+}
+
+static bool akumad_same(const struct AkumadJob * a, const struct AkumadJob * b) {
+	return a->req.op == b->req.op && a->req.key == b->req.key && a->req.mode == b->req.mode;
+}
+
+
+/* QUEUE */
+
+static void akumad_submit(struct AkumadServer * srv, struct AkumadJob * job) {
+	job->next = NULL;
+
+	pthread_mutex_lock(&srv->lock);
+
+	if (srv->tail != NULL)
+		srv->tail->next = job;
+	else
+		srv->head = job;
+
+	srv->tail = job;
+
+	pthread_cond_signal(&srv->ready);
+	pthread_mutex_unlock(&srv->lock);
+}
+
+/* THE OLDEST JOB, PLUS THE SMALL JOBS QUEUED BEHIND IT THAT CAN SHARE ITS BATCH */
+
+static size_t akumad_take(struct AkumadServer * srv, struct AkumadJob ** batch) {
+	size_t count = 0;
+
+	pthread_mutex_lock(&srv->lock);
+
+	while (srv->head == NULL)
+		pthread_cond_wait(&srv->ready, &srv->lock);
+
+	batch[count++] = srv->head;
+	srv->head = srv->head->next;
+
+	struct AkumadJob * prev = NULL;
+
+	for (struct AkumadJob * j = srv->head; j != NULL && akumad_small(batch[0]) && count < AKUMAD_BATCH; ) {
+		struct AkumadJob * next = j->next;
+
+		if (akumad_small(j) && akumad_same(j, batch[0])) {
+			if (prev != NULL)
+				prev->next = next;
+			else
+				srv->head = next;
+
+			batch[count++] = j;
+		} else {
+			prev = j;
+		}
+
+		j = next;
+	}
+
+/* THE QUEUE NEVER HOLDS MORE THAN ONE JOB PER CONNECTION, FINDING THE TAIL AGAIN IS CHEAP */
+
+	srv->tail = NULL;
+
+	for (struct AkumadJob * j = srv->head; j != NULL; j = j->next)
+		srv->tail = j;
+
+/* MORE WORK LEFT: WAKE ANOTHER WORKER */
+
+	if (srv->head != NULL)
+		pthread_cond_signal(&srv->ready);
+
+	pthread_mutex_unlock(&srv->lock);
+
+	return count;
+}
+
+static void * akumad_worker(void * arg) {
+	struct AkumadServer * srv = (struct AkumadServer *)arg;
+	struct AkumadJob * batch[AKUMAD_BATCH];
+	struct AkumaMessage msgs[AKUMAD_BATCH];
+	unsigned char ivs[AKUMAD_BATCH * AKUMA_IV_LENGTH_BYTES];
+
+	for (;;) {
+		size_t count = akumad_take(srv, batch);
+		const struct AkumadRequest * req = &batch[0]->req;
+		const Akuma_Key * key = &srv->keys[req->key * AKUMAD_MODES + akumad_variant(req->mode)];
+		bool encrypt = (req->op == AKUMAD_ENCRYPT);
+
+		if (encrypt && !Akuma_IVs(ivs, count)) {
+			for (size_t i = 0; i < count; ++i) {
+				batch[i]->status = AKUMAD_EFAIL;
+				sem_post(&batch[i]->done);
+			}
+
+			continue;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			msgs[i].iv = encrypt?(ivs + AKUMA_IV_LENGTH_BYTES * i):batch[i]->req.iv;
+			msgs[i].in = batch[i]->in;
+			msgs[i].in_len = batch[i]->req.len;
+			msgs[i].out = batch[i]->out;
+			msgs[i].out_len = 0;
+		}
+
+		if (encrypt)
+			Akuma_KeyEncryptBatch(key, msgs, count);
+		else
+			Akuma_KeyDecryptBatch(key, msgs, count);
+
+		atomic_fetch_add_explicit(&srv->requests, count, memory_order_relaxed);
+		atomic_fetch_add_explicit(&srv->batches, 1, memory_order_relaxed);
+
+		for (size_t i = 0; i < count; ++i) {
+			struct AkumadJob * job = batch[i];
+
+			job->out_len = msgs[i].out_len;
+			job->status = (job->out_len == (size_t)-1)?AKUMAD_EFAIL:AKUMAD_OK;
+
+			if (encrypt)
+				memcpy(job->iv, msgs[i].iv, AKUMA_IV_LENGTH_BYTES);
+
+			sem_post(&job->done);
+		}
+
+		OPENSSL_cleanse(ivs, sizeof(ivs));
+	}
+
+	return NULL;
+}
+
+
+/* CONNECTIONS */
+
+static int akumad_check(const struct AkumadServer * srv, const struct AkumadRequest * req, int shm_fd) {
+	if (req->magic != AKUMAD_MAGIC || req->version != AKUMAD_VERSION || (req->op != AKUMAD_ENCRYPT && req->op != AKUMAD_DECRYPT))
+		return AKUMAD_EREQUEST;
+
+	if ((req->mode & ~(AKUMA_MODE_CTR | AKUMA_AUTH)) != 0 || (req->flags & ~AKUMAD_SHM) != 0 || ((req->flags & AKUMAD_SHM) != 0) != (shm_fd >= 0))
+		return AKUMAD_EREQUEST;
+
+	if (shm_fd < 0 && req->len > AKUMAD_MAX_INLINE)
+		return AKUMAD_EREQUEST;
+
+/* A memfd THE CLIENT COULD STILL TRUNCATE WOULD SIGBUS THE DAEMON THROUGH ITS MAPPING, IT
+ * MUST BE SEALED AGAINST SHRINKING AND STILL GROW AND TAKE WRITES FOR THE OUTPUT */
+
+	int seals = (shm_fd >= 0)?fcntl(shm_fd, F_GET_SEALS):F_SEAL_SHRINK;
+
+	if (seals < 0 || (seals & F_SEAL_SHRINK) == 0 || (seals & (F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_FUTURE_WRITE)) != 0)
+		return AKUMAD_EREQUEST;
+
+	return (req->key < srv->n_keys)?AKUMAD_OK:AKUMAD_EKEY;
+}
+
+/* MAP THE CLIENT'S memfd: INPUT AT 0, ROOM FOR THE OUTPUT AT THE NEXT PAGE AFTER IT */
+
+static unsigned char * akumad_map(int shm_fd, const struct AkumadRequest * req, size_t * offset, size_t * map_len) {
+	struct stat st;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+	*offset = (req->len + page - 1) / page * page;
+	*map_len = *offset + akumad_out_size(req->op, req->len);
+
+	if (fstat(shm_fd, &st) != 0 || (uint64_t)st.st_size < req->len || ftruncate(shm_fd, (off_t)*map_len) != 0)
+		return NULL;
+
+	unsigned char * map = mmap(NULL, *map_len, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+	return (map == MAP_FAILED)?NULL:map;
+}
+
+static void * akumad_connection(void * arg) {
+	struct AkumadConn * conn = (struct AkumadConn *)arg;
+	struct AkumadServer * srv = conn->srv;
+	struct AkumadJob job;
+	unsigned char * buf = NULL;
+	size_t buf_size = 0;
+	int shm_fd;
+
+	memset(&job, 0, sizeof(job));
+	sem_init(&job.done, 0, 0);
+
+	while (akumad_recv_header(conn->fd, &job.req, sizeof(job.req), &shm_fd)) {
+		struct AkumadResponse resp;
+		unsigned char * map = NULL;
+		size_t map_len = 0;
+		size_t offset = 0;
+		int status = akumad_check(srv, &job.req, shm_fd);
+
+		memset(&resp, 0, sizeof(resp));
+		resp.magic = AKUMAD_MAGIC;
+
+/* AN INLINE PAYLOAD IS READ EVEN FOR A REQUEST THAT FAILS, TO STAY IN STEP WITH THE CLIENT */
+
+		if (shm_fd >= 0) {
+			if (status == AKUMAD_OK && (map = akumad_map(shm_fd, &job.req, &offset, &map_len)) == NULL)
+				status = AKUMAD_ENOMEM;
+
+			job.in = map;
+			job.out = (map != NULL)?(map + offset):NULL;
+		} else if (job.req.len <= AKUMAD_MAX_INLINE) {
+			size_t need = job.req.len + akumad_out_size(job.req.op, job.req.len) + 1;
+
+			if (need > buf_size) {
+				unsigned char * grown = malloc(need);
+
+				if (grown == NULL)
+					break;
+
+				if (buf != NULL)
+					OPENSSL_cleanse(buf, buf_size);
+
+				free(buf);
+				buf = grown;
+				buf_size = need;
+			}
+
+			if (!akumad_recv(conn->fd, buf, job.req.len))
+				break;
+
+			job.in = buf;
+			job.out = buf + job.req.len;
+		} else {
+			resp.status = status;
+			akumad_send(conn->fd, &resp, sizeof(resp));
+			break;
+		}
+
+		if (status == AKUMAD_OK) {
+			akumad_submit(srv, &job);
+			sem_wait(&job.done);
+			status = job.status;
+		}
+
+		resp.status = status;
+
+		if (status == AKUMAD_OK) {
+			resp.offset = offset;
+			resp.len = job.out_len;
+			memcpy(resp.iv, job.iv, sizeof(resp.iv));
+		}
+
+		bool sent = akumad_send(conn->fd, &resp, sizeof(resp)) && (map != NULL || resp.len == 0 || akumad_send(conn->fd, job.out, resp.len));
+
+		if (map != NULL)
+			munmap(map, map_len);
+
+		if (shm_fd >= 0)
+			close(shm_fd);
+
+		if (!sent)
+			break;
+	}
+
+	if (buf != NULL)
+		OPENSSL_cleanse(buf, buf_size);
+
+	free(buf);
+	sem_destroy(&job.done);
+	close(conn->fd);
+	free(conn);
+
+	return NULL;
+}
+
+/* ONE DETACHED THREAD PER CONNECTION FROM OUR OWN USER */
+
+static void * akumad_acceptor(void * arg) {
+	struct AkumadServer * srv = (struct AkumadServer *)arg;
+	pthread_attr_t attr;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (;;) {
+		int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+				continue;
+
+			break;
+		}
+
+		struct ucred cred;
+		socklen_t cred_len = sizeof(cred);
+		struct AkumadConn * conn = NULL;
+		pthread_t thread;
+
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != getuid() || (conn = malloc(sizeof(*conn))) == NULL) {
+			close(fd);
+			continue;
+		}
+
+		conn->srv = srv;
+		conn->fd = fd;
+
+		if (pthread_create(&thread, &attr, akumad_connection, conn) != 0) {
+			close(fd);
+			free(conn);
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+
+	return NULL;
+}
+
+
+/* SETUP */
+
+static bool akumad_keys(struct AkumadServer * srv, char ** filenames, size_t n) {
+	static const int modes[AKUMAD_MODES] = { AKUMA_MODE_CHAIN, AKUMA_MODE_CTR, AKUMA_MODE_CHAIN | AKUMA_AUTH, AKUMA_MODE_CTR | AKUMA_AUTH };
+	unsigned char key[AKUMA_KEY_LENGTH_BYTES + 1];
+	bool ok = true;
+
+	srv->keys = calloc(n * AKUMAD_MODES, sizeof(Akuma_Key));
+	srv->n_keys = n;
+
+	for (size_t i = 0; ok && i < n; ++i) {
+		FILE * key_file = fopen(filenames[i], "rb");
+
+		if (key_file == NULL) {
+			fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", filenames[i]);
+			perror("Error");
+			return false;
+		}
+
+		size_t key_len = fread(key, 1, sizeof(key), key_file);
+
+		fclose(key_file);
+
+		if (key_len != AKUMA_KEY_LENGTH_BYTES) {
+			fprintf(stderr, "Key length incorrect in \"%s\"\nKey size must be 256 bits (32 bytes)\n", filenames[i]);
+			ok = false;
+		}
+
+		for (int m = 0; ok && m < AKUMAD_MODES; ++m)
+			ok = (srv->keys != NULL && Akuma_KeyInit(&srv->keys[i * AKUMAD_MODES + akumad_variant(modes[m])], key, modes[m]));
+	}
+
+	OPENSSL_cleanse(key, sizeof(key));
+
+	return ok;
+}
+
+static int akumad_listen(const char * path) {
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long \"%s\"\n", path);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+/* A SOCKET LEFT BEHIND BY A DAEMON THAT DIED (NOBODY ACCEPTS ON IT) IS REPLACED. A LIVE
+ * DAEMON'S SOCKET AND ANY OTHER FILE ARE NOT, bind() THEN FAILS */
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd >= 0 && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+			fprintf(stderr, "Another akumad is already listening on \"%s\"\n", path);
+			close(fd);
+			return -1;
+		}
+
+		if (errno == ECONNREFUSED)
+			unlink(path);
+
+		close(fd);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	}
+
+	mode_t mask = umask(077);
+	bool ok = (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	umask(mask);
+
+	if (!ok || listen(fd, SOMAXCONN) != 0) {
+		fprintf(stderr, "Failed to listen on \"%s\" [socket()/bind()/listen()]\n", path);
+		perror("Error");
+
+		if (fd >= 0)
+			close(fd);
+
+		return -1;
+	}
+
+	return fd;
+}
+
+/* --stats: THE LIBRARY'S GLOBAL COUNTERS AS JSON ON stderr WHEN THE DAEMON STOPS */
+
+static bool show_stats = false;
+
+int main(int argc, char ** argv) {
+	const char * socket_path = AKUMAD_SOCKET;
+	unsigned int workers = 0;
+	int opt;
+
+	static const struct option long_options[] = {
+		{ "stats", no_argument, NULL, 'S' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "s:t:", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 's':	/* SOCKET PATH, AKUMAD_SOCKET BY DEFAULT */
+			socket_path = optarg;
+			break;
+		case 't':	/* WORKERS, 0 (DEFAULT) = ONE PER ONLINE CPU */
+			workers = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		case 'S':	/* TIME EVERY CALL AND PRINT THE COUNTERS ON EXIT */
+			Akuma_StatsTiming(1);
+			show_stats = true;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+
+	if (argc - optind < 1) {
+		fprintf(stderr, "\nUsage: [--stats] [-s SOCKET] [-t WORKERS] [KEY FILE ...]\n\n");
+		return -1;
+	}
+
+	static struct AkumadServer srv;	/* OUTLIVES main(), THE WORKERS ARE STILL WAITING ON IT AT EXIT */
+
+	pthread_mutex_init(&srv.lock, NULL);
+	pthread_cond_init(&srv.ready, NULL);
+
+	if (!akumad_keys(&srv, argv + optind, (size_t)(argc - optind)))
+		return -1;
+
+/* EVERY THREAD INHERITS THE BLOCKED SIGNALS, ONLY main() WAITS FOR THEM */
+
+	sigset_t signals;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	if ((srv.listen_fd = akumad_listen(socket_path)) < 0)
+		return -1;
+
+	workers = Akuma_Threads(workers);
+
+	pthread_t thread;
+	unsigned int started = 0;
+
+	for (unsigned int t = 0; t < workers; ++t)
+		started += (pthread_create(&thread, NULL, akumad_worker, &srv) == 0);
+
+	if (started == 0 || pthread_create(&thread, NULL, akumad_acceptor, &srv) != 0) {
+		fprintf(stderr, "Failed to start the daemon threads [pthread_create()]\n");
+		unlink(socket_path);
+		return -1;
+	}
+
+	fprintf(stderr, "akumad: %zu key(s), %u worker(s), listening on \"%s\"\n", srv.n_keys, started, socket_path);
+
+	int sig;
+
+	sigwait(&signals, &sig);
+	unlink(socket_path);
+
+	fprintf(stderr, "akumad: %llu requests in %llu batches\n", (unsigned long long)atomic_load(&srv.requests), (unsigned long long)atomic_load(&srv.batches));
+
+	if (show_stats) {
+		struct AkumaStats stats;
+
+		Akuma_Stats(NULL, &stats);
+		Akuma_StatsJSON(stderr, &stats);
+	}
+
+/* THE WORKERS MAY STILL BE INSIDE OPENSSL, SO SKIP THE atexit() CLEANUP THAT TEARS IT DOWN */
+
+	fflush(stderr);
+	_exit(0);
+}
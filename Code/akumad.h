@@ -0,0 +1,295 @@
+/* AKUMAD PROTOCOL AND CLIENT, INCLUDE AFTER akuma.h
+ *
+ * akumad LOADS ITS KEYS ONCE AND SERVES ENCRYPT/DECRYPT REQUESTS ON A UNIX DOMAIN
+ * SOCKET. A REQUEST IS ONE struct AkumadRequest AND, INLINE, len BYTES OF PAYLOAD.
+ * THE ANSWER IS ONE struct AkumadResponse AND, INLINE, len BYTES OF OUTPUT.
+ *
+ *   ENCRYPT   PLAINTEXT                        -> CIPHERTEXT (|| TAG), THE IV IN THE RESPONSE
+ *   DECRYPT   CIPHERTEXT (|| TAG), IV IN HEADER -> PLAINTEXT
+ *
+ * PAYLOADS OF AKUMAD_SHM_MIN BYTES AND MORE TRAVEL IN A memfd INSTEAD: THE CLIENT
+ * SENDS ITS FILE DESCRIPTOR WITH THE HEADER (SCM_RIGHTS) AND AKUMAD_SHM SET, THE
+ * DAEMON MAPS IT, WRITES THE OUTPUT INTO THE SAME FILE AT response.offset AND
+ * NOTHING BUT THE HEADERS CROSSES THE SOCKET. THE memfd MUST CARRY F_SEAL_SHRINK,
+ * SO THE CLIENT CANNOT TRUNCATE IT UNDER THE DAEMON'S MAPPING.
+ *
+ * ONE REQUEST IS IN FLIGHT PER CONNECTION, CONNECT SEVERAL TIMES FOR MORE. ALL
+ * FIELDS ARE IN HOST BYTE ORDER, THE SOCKET NEVER LEAVES THE MACHINE.
+ *
+ * akumad AND akumac EACH USE ONLY THEIR SIDE OF THE HELPERS BELOW, SO THEY ARE ALL
+ * static inline AND NEITHER PROGRAM WARNS ABOUT THE OTHER SIDE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define AKUMAD_SOCKET     "/tmp/akumad.sock"
+#define AKUMAD_MAGIC      0x444d4b41	/* "AKMD" */
+#define AKUMAD_VERSION    1
+#define AKUMAD_SHM_MIN    (64 * 1024)	/* SMALLEST PAYLOAD SENT THROUGH A memfd */
+#define AKUMAD_MAX_INLINE (16 * 1024 * 1024)
+
+#define AKUMAD_ENCRYPT 1
+#define AKUMAD_DECRYPT 2
+
+#define AKUMAD_SHM 1			/* request.flags */
+
+#define AKUMAD_OK         0		/* response.status */
+#define AKUMAD_EREQUEST  -1		/* MALFORMED OR OVERSIZED REQUEST */
+#define AKUMAD_EKEY      -2		/* NO SUCH KEY */
+#define AKUMAD_EFAIL     -3		/* WRONG KEY, BAD LENGTH, PADDING OR TAG */
+#define AKUMAD_ENOMEM    -4
+
+struct AkumadRequest {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t op;			/* AKUMAD_ENCRYPT OR AKUMAD_DECRYPT */
+	uint16_t mode;			/* AKUMA_MODE_* | AKUMA_AUTH */
+	uint32_t key;			/* INDEX OF THE KEY FILE ON THE DAEMON'S COMMAND LINE */
+	uint32_t flags;
+	uint64_t len;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];	/* DECRYPT */
+};
+
+struct AkumadResponse {
+	uint32_t magic;
+	int32_t status;
+	uint64_t offset;		/* AKUMAD_SHM: WHERE THE OUTPUT STARTS IN THE memfd */
+	uint64_t len;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];	/* ENCRYPT */
+};
+
+/* OUTPUT OF akumad_call(), GIVE IT BACK WITH akumad_release() */
+
+struct AkumadResult {
+	unsigned char * data;
+	size_t len;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];
+	void * map;			/* AKUMAD_SHM: THE WHOLE memfd MAPPING */
+	size_t map_len;
+};
+
+
+/* SOCKET HELPERS, SHARED WITH THE DAEMON */
+
+static inline bool akumad_send(int fd, const void * buf, size_t len) {
+	const unsigned char * p = (const unsigned char *)buf;
+
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		p += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+static inline bool akumad_recv(int fd, void * buf, size_t len) {
+	unsigned char * p = (unsigned char *)buf;
+
+	while (len > 0) {
+		ssize_t n = recv(fd, p, len, 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		p += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+/* ONE HEADER, WITH shm_fd ATTACHED WHEN IT IS NOT -1 */
+
+static inline bool akumad_send_header(int fd, const void * header, size_t len, int shm_fd) {
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct iovec iov = { (void *)header, len };
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (shm_fd >= 0) {
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+
+		struct cmsghdr * c = CMSG_FIRSTHDR(&msg);
+
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(c), &shm_fd, sizeof(int));
+	}
+
+	ssize_t n;
+
+	while ((n = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+		;
+
+	return n == (ssize_t)len;
+}
+
+/* ONE HEADER, *shm_fd IS THE DESCRIPTOR THAT CAME WITH IT OR -1 */
+
+static inline bool akumad_recv_header(int fd, void * header, size_t len, int * shm_fd) {
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct iovec iov = { header, len };
+	struct msghdr msg;
+	ssize_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	*shm_fd = -1;
+
+	while ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+		;
+
+	for (struct cmsghdr * c = CMSG_FIRSTHDR(&msg); n > 0 && c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+			memcpy(shm_fd, CMSG_DATA(c), sizeof(int));
+	}
+
+	return n > 0 && akumad_recv(fd, (unsigned char *)header + n, len - (size_t)n);
+}
+
+/* UPPER BOUND ON THE OUTPUT OF A REQUEST */
+
+static inline size_t akumad_out_size(int op, size_t len) {
+	return (op == AKUMAD_ENCRYPT)?(len + AKUMA_BLOCK_SIZE_BYTES + AKUMA_TAG_LENGTH_BYTES):len;
+}
+
+
+/* CLIENT */
+
+static inline int akumad_connect(const char * path) {
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		fd = -1;
+	}
+
+	return fd;
+}
+
+/* RETURNS AKUMAD_OK AND FILLS res, OR ONE OF THE AKUMAD_E* CODES (AKUMAD_EREQUEST FOR A BROKEN CONNECTION) */
+
+static inline int akumad_call(int fd, int op, uint32_t key, int mode, const unsigned char * iv, const unsigned char * in, size_t in_len, struct AkumadResult * res) {
+	struct AkumadRequest req;
+	struct AkumadResponse resp;
+	int shm_fd = -1;
+	bool ok;
+
+	memset(res, 0, sizeof(*res));
+	memset(&req, 0, sizeof(req));
+	req.magic = AKUMAD_MAGIC;
+	req.version = AKUMAD_VERSION;
+	req.op = (uint8_t)op;
+	req.mode = (uint16_t)mode;
+	req.key = key;
+	req.len = in_len;
+
+	if (iv != NULL)
+		memcpy(req.iv, iv, sizeof(req.iv));
+
+	if (in_len >= AKUMAD_SHM_MIN) {
+		req.flags = AKUMAD_SHM;
+		shm_fd = memfd_create("akumad", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		ok = (shm_fd >= 0);
+
+		for (size_t done = 0; ok && done < in_len; ) {
+			ssize_t n = write(shm_fd, in + done, in_len - done);
+
+			ok = (n > 0 || (n < 0 && errno == EINTR));
+			done += (n > 0)?(size_t)n:0;
+		}
+
+/* THE DAEMON ONLY MAPS A memfd THAT CAN NO LONGER SHRINK UNDER IT */
+
+		ok = ok && fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK) == 0;
+		ok = ok && akumad_send_header(fd, &req, sizeof(req), shm_fd);
+	} else {
+		ok = akumad_send_header(fd, &req, sizeof(req), -1) && akumad_send(fd, in, in_len);
+	}
+
+	ok = ok && akumad_recv(fd, &resp, sizeof(resp)) && resp.magic == AKUMAD_MAGIC;
+
+	if (!ok || resp.status != AKUMAD_OK) {
+		if (shm_fd >= 0)
+			close(shm_fd);
+
+		return ok?resp.status:AKUMAD_EREQUEST;
+	}
+
+	memcpy(res->iv, resp.iv, sizeof(res->iv));
+	res->len = resp.len;
+
+/* THE OUTPUT SITS IN THE memfd, MAP IT RATHER THAN COPY IT */
+
+	if (shm_fd >= 0) {
+		res->map_len = resp.offset + resp.len;
+		res->map = (res->map_len > 0)?mmap(NULL, res->map_len, PROT_READ, MAP_SHARED, shm_fd, 0):NULL;
+		close(shm_fd);
+
+		if (res->map == MAP_FAILED) {
+			res->map = NULL;
+			return AKUMAD_ENOMEM;
+		}
+
+		res->data = (unsigned char *)res->map + resp.offset;
+
+		return AKUMAD_OK;
+	}
+
+	res->data = malloc(resp.len + 1);
+
+	if (res->data == NULL || !akumad_recv(fd, res->data, resp.len)) {
+		free(res->data);
+		res->data = NULL;
+		return AKUMAD_EREQUEST;
+	}
+
+	return AKUMAD_OK;
+}
+
+static inline void akumad_release(struct AkumadResult * res) {
+	if (res->map != NULL)
+		munmap(res->map, res->map_len);
+	else
+		free(res->data);
+
+	memset(res, 0, sizeof(*res));
+}
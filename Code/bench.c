@@ -0,0 +1,851 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <openssl/rand.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "akuma.h"
+
+/* BENCHMARK FOR THE ONE-SHOT API, pkcs7pad() AND THE encrypt/decrypt PROGRAMS
+ *
+ * EVERY (BENCH, MODE, THREADS, CACHE, SIZE) CASE IS TIMED PER OPERATION AND
+ * REPORTED AS MB/s (10^6 BYTES), MEAN ns/op, p50/p99 LATENCY AND CYCLES/BYTE.
+ * CYCLES COME FROM perf_event_open() WHEN THE KERNEL ALLOWS IT, OTHERWISE FROM
+ * THE TIME STAMP COUNTER (REFERENCE CYCLES, NOT CORE CYCLES) OR NOT AT ALL.
+ *
+ * -l MEASURES THE SMALL-MESSAGE ENTRY POINTS INSTEAD, 16 TO AKUMA_SMALL_MAX BYTES.
+ */
+
+#define MIN_SIZE 32
+#define DEFAULT_MAX_SIZE (16 * 1024 * 1024)
+#define DEFAULT_BUDGET (64 * 1024 * 1024)	/* BYTES PROCESSED PER CASE WHEN -n IS NOT GIVEN */
+#define MIN_ITERS 3
+#define MAX_ITERS 10000
+#define MAX_COLD_ITERS 50	/* EACH COLD RUN FIRST SWEEPS TWICE THE LAST LEVEL CACHE */
+#define MAX_CLI_ITERS 50	/* EACH CLI RUN STARTS A PROCESS */
+#define MAX_THREAD_COUNTS 16
+#define SMALL_RUN 64		/* -l: CALLS TIMED TOGETHER AS ONE SAMPLE */
+#define SMALL_SAMPLES 20000
+
+enum { CYCLES_NONE, CYCLES_PERF, CYCLES_TSC };
+enum { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+
+struct Bench {
+	int mode;
+	int auth;			/* AKUMA_AUTH WITH -a, ELSE 0 */
+	unsigned int threads;
+	size_t size;
+
+	unsigned char key[AKUMA_BLOCK_SIZE_BYTES];
+	unsigned char iv[AKUMA_BLOCK_SIZE_BYTES];
+
+	unsigned char * plaintext;	/* size + ONE BLOCK, pkcs7pad() READS PAST ITS INPUT */
+	unsigned char * padded;
+	size_t padded_len;
+	unsigned char * ciphertext;
+	size_t ciphertext_len;
+	unsigned char * out;		/* CALLER OWNED OUTPUT FOR THE *-to BENCHMARKS */
+
+	const char * tools;		/* DIRECTORY WITH THE encrypt AND decrypt PROGRAMS */
+	char in_path[256];
+	char key_path[256];
+	char enc_path[256];
+	char out_path[256];
+	bool enc_ready;			/* enc_path HOLDS THE CURRENT SIZE AND MODE */
+
+	Akuma_CTX ctx;
+	Akuma_Key shared;		/* -l: key, mode AND auth FOR THE Akuma_Key* FUNCTIONS */
+};
+
+struct BenchOp {
+	const char * name;
+	bool threaded;			/* USES MORE THAN ONE THREAD IN THIS MODE */
+	bool cli;
+	void (*prepare)(struct Bench * b);	/* UNTIMED */
+	int (*run)(struct Bench * b);		/* TIMED, 0 ON SUCCESS */
+	void (*finish)(struct Bench * b);	/* UNTIMED */
+};
+
+struct Result {
+	size_t iters;
+	double mb_s;
+	double ns_op;
+	double p50;
+	double p99;
+	double cycles_per_byte;	/* < 0 WHEN NO CYCLE COUNT IS AVAILABLE */
+};
+
+static int cycles_source = CYCLES_NONE;
+static int cycles_fd = -1;
+
+static unsigned char * evict_buf = NULL;
+static size_t evict_size = 0;
+static volatile unsigned char sink;
+
+
+/* CYCLE COUNTERS */
+
+static void cycles_init(void) {
+#ifdef __linux__
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.inherit = 1;	/* WORKER THREADS AND CHILD PROCESSES COUNT TOO */
+
+	cycles_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+	if (cycles_fd >= 0) {
+		cycles_source = CYCLES_PERF;
+		return;
+	}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+	cycles_source = CYCLES_TSC;
+#endif
+}
+
+static uint64_t cycles_now(void) {
+	uint64_t count = 0;
+
+	if (cycles_source == CYCLES_PERF) {
+		if (read(cycles_fd, &count, sizeof(count)) != sizeof(count))
+			return 0;
+
+		return count;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (cycles_source == CYCLES_TSC)
+		return __rdtsc();
+#endif
+
+	return count;
+}
+
+static const char * cycles_name(void) {
+	return (cycles_source == CYCLES_PERF)?"perf":(cycles_source == CYCLES_TSC)?"tsc":"none";
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* COLD CACHE: WRITE AND READ BACK A BUFFER TWICE THE SIZE OF THE LAST LEVEL CACHE */
+
+static void evict_init(void) {
+	long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+	if (llc <= 0)
+		llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+	evict_size = (llc > 0)?(2 * (size_t)llc):(64 * 1024 * 1024);
+	evict_buf = malloc(evict_size);
+}
+
+static void evict(void) {
+	unsigned char acc = 0;
+
+	if (evict_buf == NULL)
+		return;
+
+	memset(evict_buf, acc + sink + 1, evict_size);
+
+	for (size_t i = 0; i < evict_size; i += 64)
+		acc ^= evict_buf[i];
+
+	sink = acc;
+}
+
+
+/* LIBRARY BENCHMARKS */
+
+static void setup_ctx(struct Bench * b) {
+	Akuma_Init(&b->ctx);
+	Akuma_SetMode(&b->ctx, b->mode | b->auth);
+	Akuma_Update(AKUMA_UPDATE_KEY, &b->ctx, NULL, b->key, NULL, NULL, 0, 0);
+	Akuma_Update(AKUMA_UPDATE_IV, &b->ctx, b->iv, NULL, NULL, NULL, 0, 0);
+
+	b->ctx.threads = b->threads;
+}
+
+static int run_pkcs7pad(struct Bench * b) {
+	unsigned char * padded = pkcs7pad(b->plaintext, b->size, AKUMA_BLOCK_SIZE_BYTES);
+
+	sink = padded[0];
+	free(padded);
+
+	return 0;
+}
+
+/* Akuma_Encrypt() TAKES PADDED INPUT IN CHAINED MODE, THE PADDING IS MEASURED BY pkcs7pad ABOVE */
+
+static void prepare_encrypt(struct Bench * b) {
+	setup_ctx(b);
+
+	if (b->mode == AKUMA_MODE_CTR)
+		Akuma_Update(AKUMA_UPDATE_PLAINTEXT, &b->ctx, NULL, NULL, b->plaintext, NULL, b->size, 0);
+	else
+		Akuma_Update(AKUMA_UPDATE_PLAINTEXT, &b->ctx, NULL, NULL, b->padded, NULL, b->padded_len, 0);
+}
+
+static int run_encrypt(struct Bench * b) {
+	return (Akuma_Encrypt(&b->ctx) == (unsigned int)-1)?-1:0;
+}
+
+static void finish_encrypt(struct Bench * b) {
+	Akuma_Free(&b->ctx);
+}
+
+static void prepare_decrypt(struct Bench * b) {
+	setup_ctx(b);
+
+	b->ctx.ciphertext = b->ciphertext;
+	b->ctx.ciphertext_len = b->ciphertext_len;
+}
+
+static int run_decrypt(struct Bench * b) {
+	unsigned int n = (b->threads > 1)?Akuma_DecryptParallel(&b->ctx, b->threads):Akuma_Decrypt(&b->ctx);
+
+	return (n == (unsigned int)b->size)?0:-1;
+}
+
+static void finish_decrypt(struct Bench * b) {
+	Akuma_Free(&b->ctx);
+}
+
+/* Akuma_EncryptTo()/Akuma_DecryptTo(): NO HEAP ALLOCATION PER MESSAGE */
+
+static int run_encrypt_to(struct Bench * b) {
+	return (Akuma_EncryptTo(&b->ctx, b->plaintext, b->size, b->out, Akuma_EncryptedSize(&b->ctx, b->size)) == (size_t)-1)?-1:0;
+}
+
+static int run_decrypt_to(struct Bench * b) {
+	return (Akuma_DecryptTo(&b->ctx, b->ciphertext, b->ciphertext_len, b->out, b->ciphertext_len) == b->size)?0:-1;
+}
+
+
+/* SMALL MESSAGES (-l): THE WHOLE ONE-SHOT ROUND TRIP AS CALLERS WRITE IT, AGAINST THE
+ * SHARED KEY FUNCTIONS AND Akuma_EncryptSmall()/Akuma_DecryptSmall() */
+
+static int run_one_shot(struct Bench * b) {
+	unsigned char * padded = (b->mode == AKUMA_MODE_CTR)?NULL:pkcs7pad(b->plaintext, b->size, AKUMA_BLOCK_SIZE_BYTES);
+
+	setup_ctx(b);
+
+	if (padded == NULL)
+		Akuma_Update(AKUMA_UPDATE_PLAINTEXT, &b->ctx, NULL, NULL, b->plaintext, NULL, b->size, 0);
+	else
+		Akuma_Update(AKUMA_UPDATE_PLAINTEXT, &b->ctx, NULL, NULL, padded, NULL, b->padded_len, 0);
+
+	int status = (Akuma_Encrypt(&b->ctx) == (unsigned int)-1)?-1:0;
+
+	Akuma_Free(&b->ctx);
+	free(padded);
+
+	return status;
+}
+
+static int run_key_encrypt_to(struct Bench * b) {
+	return (Akuma_KeyEncryptTo(&b->shared, b->iv, b->plaintext, b->size, b->out, b->size + AKUMA_BLOCK_SIZE_BYTES + AKUMA_TAG_LENGTH_BYTES) == (size_t)-1)?-1:0;
+}
+
+static int run_key_decrypt_to(struct Bench * b) {
+	return (Akuma_KeyDecryptTo(&b->shared, b->iv, b->ciphertext, b->ciphertext_len, b->out, b->ciphertext_len) == b->size)?0:-1;
+}
+
+static int run_encrypt_small(struct Bench * b) {
+	return (Akuma_EncryptSmall(&b->shared, b->iv, b->plaintext, b->size, b->out) == (size_t)-1)?-1:0;
+}
+
+static int run_decrypt_small(struct Bench * b) {
+	return (Akuma_DecryptSmall(&b->shared, b->iv, b->ciphertext, b->ciphertext_len, b->out) == b->size)?0:-1;
+}
+
+static const struct BenchOp small_ops[] = {
+	{ "one-shot",	    false, false, NULL, run_one_shot, NULL },
+	{ "key-encrypt-to", false, false, NULL, run_key_encrypt_to, NULL },
+	{ "key-decrypt-to", false, false, NULL, run_key_decrypt_to, NULL },
+	{ "encrypt-small",  false, false, NULL, run_encrypt_small, NULL },
+	{ "decrypt-small",  false, false, NULL, run_decrypt_small, NULL },
+};
+
+
+/* END-TO-END BENCHMARKS: RUN THE PROGRAMS ON A FILE, INCLUDING PROCESS START AND FILE I/O */
+
+static int run_tool(struct Bench * b, const char * tool, const char * in, const char * out) {
+	char path[512];
+	char threads[16];
+	const char * mode = (b->mode == AKUMA_MODE_CTR)?"ctr":"chain";
+
+	snprintf(path, sizeof(path), "%s/%s", b->tools, tool);
+	snprintf(threads, sizeof(threads), "%u", b->threads);
+
+	pid_t pid = fork();
+
+	if (pid < 0)
+		return -1;
+
+	if (pid == 0) {
+		int null_fd = open("/dev/null", O_WRONLY);
+
+		dup2(null_fd, STDOUT_FILENO);
+		if (b->auth)
+			execl(path, path, "-a", "-m", mode, "-t", threads, in, b->key_path, out, (char *)NULL);
+		else
+			execl(path, path, "-m", mode, "-t", threads, in, b->key_path, out, (char *)NULL);
+		_exit(127);
+	}
+
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+
+	return 0;
+}
+
+static int run_cli_encrypt(struct Bench * b) {
+	return run_tool(b, "encrypt", b->in_path, b->enc_path);
+}
+
+static void prepare_cli_decrypt(struct Bench * b) {
+	if (!b->enc_ready)
+		b->enc_ready = (run_tool(b, "encrypt", b->in_path, b->enc_path) == 0);
+}
+
+static int run_cli_decrypt(struct Bench * b) {
+	return run_tool(b, "decrypt", b->enc_path, b->out_path);
+}
+
+static const struct BenchOp bench_ops[] = {
+	{ "pkcs7pad",	 false, false, NULL, run_pkcs7pad, NULL },
+	{ "encrypt",	 false, false, prepare_encrypt, run_encrypt, finish_encrypt },
+	{ "decrypt",	 true,  false, prepare_decrypt, run_decrypt, finish_decrypt },
+	{ "encrypt-to",	 false, false, setup_ctx, run_encrypt_to, NULL },
+	{ "decrypt-to",	 true,  false, setup_ctx, run_decrypt_to, NULL },
+	{ "cli-encrypt", false, true,  NULL, run_cli_encrypt, NULL },
+	{ "cli-decrypt", true,  true,  prepare_cli_decrypt, run_cli_decrypt, NULL },
+};
+
+
+/* TIME ONE CASE, ONE UNTIMED WARM UP RUN FIRST WHEN THE CACHE SHOULD BE HOT */
+
+static int compare_u64(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int measure(const struct BenchOp * op, struct Bench * b, bool cold, size_t iters, struct Result * result) {
+	uint64_t * samples = malloc(sizeof(uint64_t) * iters);
+	uint64_t total_ns = 0;
+	uint64_t total_cycles = 0;
+
+	if (samples == NULL)
+		return -1;
+
+	for (size_t i = 0; i < iters + (cold?0:1); ++i) {
+		if (op->prepare)
+			op->prepare(b);
+
+		if (cold)
+			evict();
+
+		uint64_t c0 = cycles_now();
+		uint64_t t0 = now_ns();
+
+		int status = op->run(b);
+
+		uint64_t t1 = now_ns();
+		uint64_t c1 = cycles_now();
+
+		if (op->finish)
+			op->finish(b);
+
+		if (status != 0) {
+			free(samples);
+			return -1;
+		}
+
+		if (!cold && i == 0)
+			continue;
+
+		samples[cold?i:(i - 1)] = t1 - t0;
+		total_ns += t1 - t0;
+		total_cycles += c1 - c0;
+	}
+
+	qsort(samples, iters, sizeof(uint64_t), compare_u64);
+
+	result->iters = iters;
+	result->ns_op = (double)total_ns / iters;
+	result->mb_s = (total_ns > 0)?((double)b->size * iters * 1000.0 / total_ns):0.0;
+	result->p50 = (double)samples[(iters - 1) * 50 / 100];
+	result->p99 = (double)samples[(iters - 1) * 99 / 100];
+	result->cycles_per_byte = (cycles_source == CYCLES_NONE)?-1.0:((double)total_cycles / ((double)b->size * iters));
+
+	free(samples);
+
+	return 0;
+}
+
+
+/* ONE CALL IS SHORTER THAN THE CLOCK RESOLVES, SO EVERY SAMPLE TIMES SMALL_RUN CALLS
+ * BACK TO BACK, HOT CACHE ONLY. ns/op, p50 AND p99 ARE PER CALL */
+
+static int measure_small(const struct BenchOp * op, struct Bench * b, size_t samples, struct Result * result) {
+	uint64_t * per_call = malloc(sizeof(uint64_t) * samples);
+	uint64_t total_ns = 0;
+	uint64_t total_cycles = 0;
+
+	if (per_call == NULL)
+		return -1;
+
+	for (size_t i = 0; i < samples + 1; ++i) {
+		int status = 0;
+		uint64_t c0 = cycles_now();
+		uint64_t t0 = now_ns();
+
+		for (size_t r = 0; r < SMALL_RUN; ++r)
+			status |= op->run(b);
+
+		uint64_t t1 = now_ns();
+		uint64_t c1 = cycles_now();
+
+		if (status != 0) {
+			free(per_call);
+			return -1;
+		}
+
+		if (i == 0)	/* WARM UP */
+			continue;
+
+		per_call[i - 1] = (t1 - t0) / SMALL_RUN;
+		total_ns += t1 - t0;
+		total_cycles += c1 - c0;
+	}
+
+	size_t calls = samples * SMALL_RUN;
+
+	qsort(per_call, samples, sizeof(uint64_t), compare_u64);
+
+	result->iters = calls;
+	result->ns_op = (double)total_ns / calls;
+	result->mb_s = (total_ns > 0)?((double)b->size * calls * 1000.0 / total_ns):0.0;
+	result->p50 = (double)per_call[(samples - 1) * 50 / 100];
+	result->p99 = (double)per_call[(samples - 1) * 99 / 100];
+	result->cycles_per_byte = (cycles_source == CYCLES_NONE)?-1.0:((double)total_cycles / ((double)b->size * calls));
+
+	free(per_call);
+
+	return 0;
+}
+
+
+/* OUTPUT */
+
+static int format = FORMAT_TEXT;
+static size_t rows = 0;
+
+static void print_header(void) {
+	if (format == FORMAT_TEXT) {
+		printf("# engine %s, cycles from %s\n", Akuma_Engine(), cycles_name());
+		printf("%-14s %-10s %7s %-5s %12s %8s %10s %14s %12s %12s %10s\n", "bench", "mode", "threads", "cache", "size", "iters", "MB/s", "ns/op", "p50 ns", "p99 ns", "cyc/byte");
+	} else if (format == FORMAT_CSV) {
+		printf("bench,mode,threads,cache,size,iters,mb_s,ns_op,p50_ns,p99_ns,cycles_per_byte,engine,cycles_source\n");
+	} else {
+		printf("{\n  \"engine\": \"%s\",\n  \"cycles_source\": \"%s\",\n  \"results\": [", Akuma_Engine(), cycles_name());
+	}
+}
+
+static void print_result(const char * bench, const char * mode, unsigned int threads, bool cold, size_t size, const struct Result * r) {
+	const char * cache = cold?"cold":"hot";
+
+	if (format == FORMAT_TEXT) {
+		printf("%-14s %-10s %7u %-5s %12zu %8zu %10.1f %14.1f %12.0f %12.0f ", bench, mode, threads, cache, size, r->iters, r->mb_s, r->ns_op, r->p50, r->p99);
+
+		if (r->cycles_per_byte < 0)
+			printf("%10s\n", "-");
+		else
+			printf("%10.3f\n", r->cycles_per_byte);
+	} else if (format == FORMAT_CSV) {
+		printf("%s,%s,%u,%s,%zu,%zu,%.3f,%.1f,%.0f,%.0f,", bench, mode, threads, cache, size, r->iters, r->mb_s, r->ns_op, r->p50, r->p99);
+
+		if (r->cycles_per_byte >= 0)
+			printf("%.4f", r->cycles_per_byte);
+
+		printf(",%s,%s\n", Akuma_Engine(), cycles_name());
+	} else {
+		printf("%s\n    {\"bench\": \"%s\", \"mode\": \"%s\", \"threads\": %u, \"cache\": \"%s\", \"size\": %zu, \"iters\": %zu, "
+			"\"mb_s\": %.3f, \"ns_op\": %.1f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"cycles_per_byte\": ",
+			(rows > 0)?",":"", bench, mode, threads, cache, size, r->iters, r->mb_s, r->ns_op, r->p50, r->p99);
+
+		if (r->cycles_per_byte < 0)
+			printf("null}");
+		else
+			printf("%.4f}", r->cycles_per_byte);
+	}
+
+	++rows;
+	fflush(stdout);
+}
+
+static void print_footer(void) {
+	if (format == FORMAT_JSON)
+		printf("\n  ]\n}\n");
+}
+
+
+/* COMMAND LINE */
+
+static size_t parse_size(const char * s) {
+	char * end;
+	size_t n = (size_t)strtoull(s, &end, 10);
+
+	switch (*end) {
+	case 'G': case 'g':
+		n *= 1024;
+		/* FALLTHROUGH */
+	case 'M': case 'm':
+		n *= 1024;
+		/* FALLTHROUGH */
+	case 'K': case 'k':
+		n *= 1024;
+	}
+
+	return n;
+}
+
+/* EXACT MATCH AGAINST A COMMA SEPARATED LIST, SO "decrypt" DOES NOT SELECT "cli-decrypt" */
+
+static bool listed(const char * list, const char * name) {
+	size_t len = strlen(name);
+
+	for (const char * p = list; p != NULL; p = strchr(p, ',')) {
+		if (*p == ',')
+			++p;
+
+		if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+static bool write_file(const char * path, const unsigned char * buf, size_t len) {
+	FILE * f = fopen(path, "wb");
+
+	if (f == NULL)
+		return false;
+
+	size_t n = fwrite(buf, 1, len, f);
+
+	return (fclose(f) == 0 && n == len);
+}
+
+static void usage(void) {
+	fprintf(stderr, "\nUsage: [-a] [-l] [-s MAX SIZE] [-n ITERATIONS] [-t THREADS[,THREADS...]] [-m chain|ctr|all] [-c hot|cold|all]\n"
+			"       [-b BENCH[,BENCH...]] [-x TOOLS DIR] [-d TEMP DIR] [-f text|csv|json]\n\n"
+			"  -a  authenticated mode (AKUMA_AUTH), the tag is computed and checked in every run\n"
+			"  -l  small-message latency instead: one-shot, key-encrypt-to, key-decrypt-to, encrypt-small, decrypt-small\n"
+			"      from 16 to %d bytes, -n is the number of samples of %d calls each (default %d)\n"
+			"  -s  largest message size, K/M/G suffixes allowed (default 16M), sizes go up from 32 B by 4x\n"
+			"  -n  iterations per case (default: enough for 64 MB of data, at least %d)\n"
+			"  -t  thread counts to run, 0 = one per online CPU (default 1)\n"
+			"  -b  pkcs7pad, encrypt, decrypt, encrypt-to, decrypt-to, cli-encrypt, cli-decrypt (default all, cli-* need -x)\n"
+			"  -x  directory holding the compiled encrypt and decrypt programs\n\n", AKUMA_SMALL_MAX, SMALL_RUN, SMALL_SAMPLES, MIN_ITERS);
+}
+
+/* -l: EVERY SMALL OP AT 16 BYTES (ONE BLOCK OUT) AND 1, 2, 4 AND 8 WHOLE BLOCKS */
+
+static int bench_small(struct Bench * b, const int * modes, size_t n_modes, const char * benches, size_t samples) {
+	static const size_t sizes[] = { 16, 32, 64, 128, AKUMA_SMALL_MAX };
+
+	b->threads = 1;
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		b->size = sizes[i];
+		b->padded_len = (b->size / AKUMA_BLOCK_SIZE_BYTES + 1) * AKUMA_BLOCK_SIZE_BYTES;
+
+		for (size_t m = 0; m < n_modes; ++m) {
+			unsigned char ciphertext[AKUMA_SMALL_MAX + AKUMA_BLOCK_SIZE_BYTES + AKUMA_TAG_LENGTH_BYTES];
+
+			b->mode = modes[m];
+
+			if (!Akuma_KeyInit(&b->shared, b->key, b->mode | b->auth))
+				return -1;
+
+			b->ciphertext = ciphertext;
+			b->ciphertext_len = Akuma_KeyEncryptTo(&b->shared, b->iv, b->plaintext, b->size, ciphertext, sizeof(ciphertext));
+
+			for (size_t o = 0; o < sizeof(small_ops) / sizeof(small_ops[0]); ++o) {
+				const struct BenchOp * op = &small_ops[o];
+				struct Result r;
+
+				if (benches != NULL && !listed(benches, op->name))
+					continue;
+
+				if (measure_small(op, b, samples, &r) != 0) {
+					fprintf(stderr, "%s failed at %zu bytes\n", op->name, b->size);
+					continue;
+				}
+
+				print_result(op->name, (b->mode == AKUMA_MODE_CTR)?(b->auth?"ctr+auth":"ctr"):(b->auth?"chain+auth":"chain"), 1, false, b->size, &r);
+			}
+
+			Akuma_KeyFree(&b->shared);
+		}
+	}
+
+	print_footer();
+
+	return 0;
+}
+
+/* REMOVE THE -x FILES AND FREE WHAT main() ALLOCATED, HOWEVER THE RUN ENDS */
+
+static void bench_free(struct Bench * b) {
+	if (b->tools != NULL) {
+		remove(b->in_path);
+		remove(b->key_path);
+		remove(b->enc_path);
+		remove(b->out_path);
+	}
+
+	free(b->plaintext);
+	free(b->out);
+	free(evict_buf);
+}
+
+int main(int argc, char ** argv) {
+	size_t max_size = DEFAULT_MAX_SIZE;
+	size_t fixed_iters = 0;
+	unsigned int thread_counts[MAX_THREAD_COUNTS] = { 1 };
+	size_t n_thread_counts = 1;
+	int modes[2] = { AKUMA_MODE_CHAIN, AKUMA_MODE_CTR };
+	size_t n_modes = 2;
+	bool caches[2] = { false, true };
+	size_t n_caches = 2;
+	const char * benches = NULL;
+	const char * tools = NULL;
+	const char * dir = "/tmp";
+	int auth = 0;
+	bool small = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "als:n:t:m:c:b:x:d:f:")) != -1) {
+		switch (opt) {
+		case 'a':
+			auth = AKUMA_AUTH;
+			break;
+		case 'l':
+			small = true;
+			break;
+		case 's':
+			max_size = parse_size(optarg);
+			break;
+		case 'n':
+			fixed_iters = (size_t)strtoull(optarg, NULL, 10);
+			break;
+		case 't':
+			n_thread_counts = 0;
+
+			for (char * t = strtok(optarg, ","); t != NULL && n_thread_counts < MAX_THREAD_COUNTS; t = strtok(NULL, ","))
+				thread_counts[n_thread_counts++] = Akuma_Threads((unsigned int)strtoul(t, NULL, 10));
+			break;
+		case 'm':
+			if (strcmp(optarg, "all") != 0) {
+				modes[0] = (strcmp(optarg, "ctr") == 0)?AKUMA_MODE_CTR:(strcmp(optarg, "chain") == 0)?AKUMA_MODE_CHAIN:-1;
+				n_modes = 1;
+			}
+			break;
+		case 'c':
+			if (strcmp(optarg, "all") != 0) {
+				caches[0] = (strcmp(optarg, "cold") == 0);
+				n_caches = 1;
+			}
+			break;
+		case 'b':
+			benches = optarg;
+			break;
+		case 'x':
+			tools = optarg;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'f':
+			format = (strcmp(optarg, "json") == 0)?FORMAT_JSON:(strcmp(optarg, "csv") == 0)?FORMAT_CSV:FORMAT_TEXT;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (modes[0] < 0 || max_size < MIN_SIZE || n_thread_counts == 0) {
+		usage();
+		return -1;
+	}
+
+	struct Bench b;
+
+	memset(&b, 0, sizeof(b));
+	b.tools = tools;
+	b.auth = auth;
+
+/* -l NEVER GOES PAST AKUMA_SMALL_MAX, WHATEVER -s SAYS */
+
+	size_t message_size = (small)?AKUMA_SMALL_MAX:max_size;
+
+	b.plaintext = malloc(message_size + AKUMA_BLOCK_SIZE_BYTES);
+	b.out = malloc(message_size + AKUMA_BLOCK_SIZE_BYTES + AKUMA_TAG_LENGTH_BYTES);
+
+	if (b.plaintext == NULL || b.out == NULL || !RAND_bytes(b.key, sizeof(b.key)) || !RAND_bytes(b.iv, sizeof(b.iv))) {
+		fprintf(stderr, "Failed to allocate or fill a %zu byte test message\n", message_size);
+		bench_free(&b);
+		return -1;
+	}
+
+	for (size_t i = 0; i < message_size + AKUMA_BLOCK_SIZE_BYTES; ++i)
+		b.plaintext[i] = (unsigned char)(i * 131 + 7);
+
+	snprintf(b.in_path, sizeof(b.in_path), "%s/akuma-bench.%d.in", dir, (int)getpid());
+	snprintf(b.key_path, sizeof(b.key_path), "%s/akuma-bench.%d.key", dir, (int)getpid());
+	snprintf(b.enc_path, sizeof(b.enc_path), "%s/akuma-bench.%d.enc", dir, (int)getpid());
+	snprintf(b.out_path, sizeof(b.out_path), "%s/akuma-bench.%d.out", dir, (int)getpid());
+
+	if (tools != NULL && !write_file(b.key_path, b.key, sizeof(b.key))) {
+		fprintf(stderr, "Failed to write \"%s\"\n", b.key_path);
+		bench_free(&b);
+		return -1;
+	}
+
+	cycles_init();
+
+	if (n_caches == 2 || caches[0])
+		evict_init();
+
+	print_header();
+
+	if (small) {
+		int status = bench_small(&b, modes, n_modes, benches, (fixed_iters > 0)?fixed_iters:SMALL_SAMPLES);
+
+		bench_free(&b);
+		return status;
+	}
+
+	for (size_t size = MIN_SIZE; size <= max_size; size = (size * 4 > max_size && size < max_size)?max_size:(size * 4)) {
+		size_t iters = fixed_iters;
+
+		if (iters == 0) {
+			iters = DEFAULT_BUDGET / size;
+			iters = (iters < MIN_ITERS)?MIN_ITERS:(iters > MAX_ITERS)?MAX_ITERS:iters;
+		}
+
+		b.size = size;
+
+		if (tools != NULL && !write_file(b.in_path, b.plaintext, size)) {
+			fprintf(stderr, "Failed to write \"%s\"\n", b.in_path);
+			bench_free(&b);
+			return -1;
+		}
+
+		for (size_t m = 0; m < n_modes; ++m) {
+			b.mode = modes[m];
+			b.enc_ready = false;
+
+/* ONE CIPHERTEXT PER SIZE AND MODE FOR THE DECRYPTION RUNS */
+
+			b.threads = 1;
+			b.padded = pkcs7pad(b.plaintext, size, AKUMA_BLOCK_SIZE_BYTES);
+			b.padded_len = (size / AKUMA_BLOCK_SIZE_BYTES + 1) * AKUMA_BLOCK_SIZE_BYTES;
+
+			prepare_encrypt(&b);
+			Akuma_Encrypt(&b.ctx);
+			b.ciphertext = b.ctx.ciphertext;
+			b.ciphertext_len = b.ctx.ciphertext_len;
+
+			for (size_t o = 0; o < sizeof(bench_ops) / sizeof(bench_ops[0]); ++o) {
+				const struct BenchOp * op = &bench_ops[o];
+
+				if (benches != NULL && !listed(benches, op->name))
+					continue;
+
+				if (op->cli && tools == NULL)
+					continue;
+
+/* pkcs7pad DOES NOT DEPEND ON THE MODE, CHAINED ENCRYPTION IS ALWAYS SERIAL */
+
+				if (op->run == run_pkcs7pad && m > 0)
+					continue;
+
+				for (size_t t = 0; t < n_thread_counts; ++t) {
+					b.threads = thread_counts[t];
+
+					bool threaded = op->threaded || b.mode == AKUMA_MODE_CTR;
+
+					if (b.threads > 1 && (!threaded || op->run == run_pkcs7pad))
+						continue;
+
+					for (size_t c = 0; c < n_caches; ++c) {
+						struct Result r;
+
+						if (caches[c] && op->cli)	/* THE PAGE CACHE CANNOT BE DROPPED WITHOUT PRIVILEGES */
+							continue;
+
+						size_t n = iters;
+
+						if (caches[c] && n > MAX_COLD_ITERS && fixed_iters == 0)
+							n = MAX_COLD_ITERS;
+
+						if (op->cli && n > MAX_CLI_ITERS && fixed_iters == 0)
+							n = MAX_CLI_ITERS;
+
+						if (measure(op, &b, caches[c], n, &r) != 0) {
+							fprintf(stderr, "%s failed at %zu bytes\n", op->name, size);
+							continue;
+						}
+
+						print_result(op->name, (op->run == run_pkcs7pad)?"-":(b.mode == AKUMA_MODE_CTR)?(auth?"ctr+auth":"ctr"):(auth?"chain+auth":"chain"), b.threads, caches[c], size, &r);
+					}
+				}
+			}
+
+			free(b.padded);
+			free(b.ciphertext);
+		}
+
+		if (size == max_size)
+			break;
+	}
+
+	print_footer();
+	bench_free(&b);
+
+	return 0;
+}
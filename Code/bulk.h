@@ -0,0 +1,856 @@
+/* BULK MODE FOR encrypt.c AND decrypt.c, INCLUDE AFTER akuma.h
+ *
+ * encrypt|decrypt [-a] [-m chain|ctr] [-t WORKERS] [-r] [-o OUT DIR] [-L LIST FILE] -k KEY FILE [INPUT ...]
+ *
+ * ONE PROCESS HANDLES ANY NUMBER OF FILES: THE KEY IS READ AND SET UP ONCE (Akuma_Key),
+ * THE IVS COME FROM ONE Akuma_IVs() POOL AND EVERY FILE GETS ITS OWN Akuma_Stream.
+ * AN INPUT IS A FILE OR A DIRECTORY (-r ALSO WALKS ITS SUBDIRECTORIES), -L READS MORE
+ * PATHS FROM A FILE, ONE PER LINE. THE FILES ARE CUT INTO TASKS:
+ *
+ *   - FILES UNDER BULK_SMALL_SIZE ARE GROUPED, ONE TASK RUNS A WHOLE GROUP
+ *   - FILES OF AT LEAST 2 * BULK_PIECE_SIZE ARE SPLIT INTO PIECES WHEN THE BLOCKS ARE
+ *     INDEPENDENT (COUNTER MODE, OR DECRYPTING) AND NO AKUMA_AUTH TAG HAS TO BE HASHED
+ *     IN ORDER. EACH PIECE SEEKS ITS OWN STREAM AND USES pread()/pwrite()
+ *   - ANY OTHER FILE IS STREAMED BY ONE TASK
+ *
+ * THE TASKS ARE DEALT ROUND ROBIN TO ONE QUEUE PER WORKER. A WORKER TAKES THE NEWEST TASK
+ * OF ITS OWN QUEUE AND, ONCE THAT IS EMPTY, STEALS THE OLDEST TASK OF ANOTHER QUEUE.
+ *
+ * OUTPUT FILES HAVE THE SAME LAYOUT AS THE SINGLE FILE PROGRAMS. ENCRYPTING APPENDS
+ * BULK_SUFFIX, DECRYPTING REMOVES IT (OR APPENDS ".out"). THEY ARE WRITTEN NEXT TO THE
+ * INPUT, OR UNDER -o WITH THE DIRECTORY TREE OF THE INPUT MIRRORED. DIRECTORY WALKS SKIP
+ * FILES THAT ALREADY END IN BULK_SUFFIX WHEN ENCRYPTING AND ONLY TAKE THOSE WHEN DECRYPTING.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define BULK_PIECE_SIZE  (4 * 1024 * 1024)	/* SPLIT FILE PIECE, ALSO THE READ SIZE WHEN STREAMING */
+#define BULK_SMALL_SIZE  (64 * 1024)
+#define BULK_BATCH_BYTES (1024 * 1024)	/* SMALL FILES PER TASK, WHICHEVER LIMIT COMES FIRST */
+#define BULK_BATCH_FILES 256
+#define BULK_SUFFIX      ".akuma"
+
+struct BulkOptions {
+	bool encrypt;
+	int mode;			/* AKUMA_MODE_* | AKUMA_AUTH */
+	unsigned int workers;
+	bool recursive;
+	const char * key_filename;
+	const char * out_dir;		/* NULL: NEXT TO THE INPUT */
+	const char * list_filename;
+	char ** inputs;
+	int n_inputs;
+};
+
+struct BulkFile {
+	char * in_path;
+	char * out_path;
+	size_t size;			/* INPUT SIZE */
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];	/* ENCRYPTING, OR READ FROM A SPLIT CIPHERTEXT */
+	size_t pieces;			/* SPLIT FILES: PIECES NOT FINISHED YET */
+	size_t out_len;			/* SPLIT FILES: SET BY THE LAST PIECE */
+	bool failed;
+};
+
+struct BulkTask {
+	size_t first;			/* INDEX IN THE FILE LIST */
+	size_t count;			/* > 1 FOR A GROUP OF SMALL FILES */
+	bool split;			/* ONE PIECE OF A SPLIT FILE */
+	size_t offset;
+	size_t length;
+};
+
+struct BulkQueue {
+	pthread_mutex_t lock;
+	size_t * tasks;
+	size_t head;			/* STOLEN FROM HERE */
+	size_t tail;			/* THE OWNER POPS HERE */
+};
+
+struct BulkRun {
+	const struct BulkOptions * opts;
+	Akuma_Key key;
+
+	struct BulkFile * files;
+	size_t n_files;
+	size_t files_size;
+
+	struct BulkTask * tasks;
+	size_t n_tasks;
+	size_t tasks_size;
+
+	struct BulkQueue * queues;
+	unsigned int workers;
+	pthread_mutex_t lock;		/* SPLIT FILE COMPLETION */
+
+	size_t skipped;			/* INPUTS THAT COULD NOT BE OPENED OR PREPARED */
+};
+
+struct BulkWorker {
+	struct BulkRun * run;
+	unsigned int id;
+	unsigned char * in;
+	unsigned char * out;
+
+	size_t files;
+	size_t failed;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+};
+
+
+/* FILE HELPERS */
+
+static bool bulk_write(int fd, const unsigned char * buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		buf += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+static bool bulk_pwrite(int fd, const unsigned char * buf, size_t len, size_t offset) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, len, (off_t)offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		buf += n;
+		len -= (size_t)n;
+		offset += (size_t)n;
+	}
+
+	return true;
+}
+
+static bool bulk_pread(int fd, unsigned char * buf, size_t len, size_t offset) {
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, (off_t)offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		buf += n;
+		len -= (size_t)n;
+		offset += (size_t)n;
+	}
+
+	return true;
+}
+
+static bool bulk_ends_with(const char * s, const char * suffix) {
+	size_t len = strlen(s);
+	size_t suffix_len = strlen(suffix);
+
+	return (len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0);
+}
+
+/* a + "/" + b (b MAY BE NULL), WITH suffix APPENDED AND strip REMOVED FROM THE END */
+
+static char * bulk_path(const char * a, const char * b, const char * suffix, size_t strip) {
+	size_t len = strlen(a) + ((b != NULL)?(strlen(b) + 1):0) + strlen(suffix) + 1;
+	char * path = malloc(len);
+
+	if (path == NULL)
+		return NULL;
+
+	if (b != NULL)
+		snprintf(path, len, "%s/%s", a, b);
+	else
+		snprintf(path, len, "%s", a);
+
+	path[strlen(path) - strip] = '\0';
+	strcat(path, suffix);
+
+	return path;
+}
+
+/* CREATE THE MISSING PARENT DIRECTORIES OF path */
+
+static void bulk_mkdirs(char * path) {
+	for (char * p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(path, 0755);
+		*p = '/';
+	}
+}
+
+
+/* INPUTS */
+
+static bool bulk_add(struct BulkRun * run, const char * in_path, const char * rel, size_t size) {
+	const struct BulkOptions * opts = run->opts;
+
+	if (run->n_files == run->files_size) {
+		size_t files_size = (run->files_size == 0)?256:(2 * run->files_size);
+		struct BulkFile * files = realloc(run->files, sizeof(struct BulkFile) * files_size);
+
+		if (files == NULL)
+			return false;
+
+		run->files = files;
+		run->files_size = files_size;
+	}
+
+	struct BulkFile * f = &run->files[run->n_files];
+	const char * suffix = BULK_SUFFIX;
+	size_t strip = 0;
+
+	if (!opts->encrypt) {
+		strip = bulk_ends_with(rel, BULK_SUFFIX)?strlen(BULK_SUFFIX):0;
+		suffix = (strip > 0)?"":".out";
+	}
+
+	memset(f, 0, sizeof(struct BulkFile));
+	f->size = size;
+	f->in_path = strdup(in_path);
+	f->out_path = (opts->out_dir != NULL)?bulk_path(opts->out_dir, rel, suffix, strip):bulk_path(in_path, NULL, suffix, strip);
+
+	if (f->in_path == NULL || f->out_path == NULL)
+		return false;
+
+	if (opts->out_dir != NULL)
+		bulk_mkdirs(f->out_path);
+
+	++run->n_files;
+
+	return true;
+}
+
+static bool bulk_walk(struct BulkRun * run, const char * dir, const char * rel) {
+	DIR * d = opendir(dir);
+	struct dirent * e;
+	bool ok = true;
+
+	if (d == NULL) {
+		fprintf(stderr, "Failed to open directory \"%s\" [opendir()]\n", dir);
+		++run->skipped;
+		return true;
+	}
+
+	while (ok && (e = readdir(d)) != NULL) {
+		struct stat st;
+
+		if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+			continue;
+
+		char * path = bulk_path(dir, e->d_name, "", 0);
+		char * sub = (rel != NULL)?bulk_path(rel, e->d_name, "", 0):strdup(e->d_name);
+
+		if (path == NULL || sub == NULL) {
+			ok = false;
+		} else if (lstat(path, &st) == 0) {
+			if (S_ISDIR(st.st_mode) && run->opts->recursive)
+				ok = bulk_walk(run, path, sub);
+			else if (S_ISREG(st.st_mode) && bulk_ends_with(e->d_name, BULK_SUFFIX) != run->opts->encrypt)
+				ok = bulk_add(run, path, sub, (size_t)st.st_size);
+		}
+
+		free(path);
+		free(sub);
+	}
+
+	closedir(d);
+
+	return ok;
+}
+
+static bool bulk_input(struct BulkRun * run, const char * path) {
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "Failed to open \"%s\" [stat()]\n", path);
+		++run->skipped;
+		return true;
+	}
+
+	if (S_ISDIR(st.st_mode))
+		return bulk_walk(run, path, NULL);
+
+	const char * base = strrchr(path, '/');
+
+	return bulk_add(run, path, (base != NULL)?(base + 1):path, (size_t)st.st_size);
+}
+
+static bool bulk_list(struct BulkRun * run, const char * list_filename) {
+	FILE * list = fopen(list_filename, "r");
+	char * line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	bool ok = true;
+
+	if (list == NULL) {
+		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", list_filename);
+		perror("Error");
+		return false;
+	}
+
+	while (ok && (len = getline(&line, &line_size, list)) >= 0) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+
+		if (len > 0)
+			ok = bulk_input(run, line);
+	}
+
+	free(line);
+	fclose(list);
+
+	return ok;
+}
+
+
+/* TASKS */
+
+static bool bulk_splittable(const struct BulkRun * run, const struct BulkFile * f) {
+	int mode = run->opts->mode;
+
+	if ((mode & AKUMA_AUTH) || (run->opts->encrypt && mode != AKUMA_MODE_CTR))
+		return false;
+
+	return (f->size >= 2 * (size_t)BULK_PIECE_SIZE);
+}
+
+static bool bulk_task(struct BulkRun * run, struct BulkTask task) {
+	if (run->n_tasks == run->tasks_size) {
+		size_t tasks_size = (run->tasks_size == 0)?256:(2 * run->tasks_size);
+		struct BulkTask * tasks = realloc(run->tasks, sizeof(struct BulkTask) * tasks_size);
+
+		if (tasks == NULL)
+			return false;
+
+		run->tasks = tasks;
+		run->tasks_size = tasks_size;
+	}
+
+	run->tasks[run->n_tasks++] = task;
+
+	return true;
+}
+
+/* PRE-SIZE THE OUTPUT OF A SPLIT FILE SO ITS PIECES CAN BE WRITTEN IN ANY ORDER, RETURNS THE LENGTH TO CUT INTO PIECES */
+
+static size_t bulk_prepare(struct BulkRun * run, struct BulkFile * f) {
+	size_t len = f->size;
+	size_t out_len = len + AKUMA_IV_LENGTH_BYTES;	/* CIPHERTEXT || IV */
+
+	if (!run->opts->encrypt) {
+		int in_fd = open(f->in_path, O_RDONLY);
+
+		len -= AKUMA_IV_LENGTH_BYTES;
+		out_len = len;
+
+		bool ok = (in_fd >= 0 && bulk_pread(in_fd, f->iv, sizeof(f->iv), len));
+
+		if (in_fd >= 0)
+			close(in_fd);
+
+		if (!ok || ((run->opts->mode == AKUMA_MODE_CHAIN) && len % AKUMA_BLOCK_SIZE_BYTES != 0))
+			return 0;
+	}
+
+	int out_fd = open(f->out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (out_fd < 0)
+		return 0;
+
+	bool ok = (ftruncate(out_fd, (off_t)out_len) == 0);
+
+	close(out_fd);
+
+	return ok?len:0;
+}
+
+static bool bulk_plan(struct BulkRun * run) {
+	struct BulkTask group = { 0, 0, false, 0, 0 };
+	size_t group_bytes = 0;
+
+	for (size_t i = 0; i < run->n_files; ++i) {
+		struct BulkFile * f = &run->files[i];
+
+		if (bulk_splittable(run, f)) {
+			size_t len = bulk_prepare(run, f);
+
+			if (len == 0) {
+				fprintf(stderr, "Failed to prepare \"%s\"\n", f->out_path);
+				remove(f->out_path);
+				++run->skipped;
+				continue;
+			}
+
+			for (size_t offset = 0; offset < len; offset += BULK_PIECE_SIZE) {
+				struct BulkTask task = { i, 1, true, offset, (len - offset < BULK_PIECE_SIZE)?(len - offset):BULK_PIECE_SIZE };
+
+				if (!bulk_task(run, task))
+					return false;
+
+				++f->pieces;
+			}
+
+			continue;
+		}
+
+		if (f->size >= BULK_SMALL_SIZE) {
+			struct BulkTask task = { i, 1, false, 0, 0 };
+
+			if (!bulk_task(run, task))
+				return false;
+
+			continue;
+		}
+
+/* A GROUP OF SMALL FILES IS A RUN OF NEIGHBOURS IN THE FILE LIST */
+
+		if (group.count > 0 && (group.first + group.count != i || group.count == BULK_BATCH_FILES || group_bytes >= BULK_BATCH_BYTES)) {
+			if (!bulk_task(run, group))
+				return false;
+
+			group.count = 0;
+		}
+
+		if (group.count == 0) {
+			group.first = i;
+			group_bytes = 0;
+		}
+
+		++group.count;
+		group_bytes += f->size;
+	}
+
+	return (group.count == 0 || bulk_task(run, group));
+}
+
+
+/* ONE WHOLE FILE, STREAMED THROUGH THE WORKER'S BUFFERS */
+
+static bool bulk_encrypt_file(struct BulkWorker * w, struct BulkFile * f) {
+	Akuma_Stream s;
+	int in_fd = open(f->in_path, O_RDONLY);
+	int out_fd = (in_fd >= 0)?open(f->out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644):-1;
+	bool ok = (out_fd >= 0 && Akuma_StreamInit(&s, &w->run->key, f->iv));
+	ssize_t bytes_read = 0;
+	size_t n = 0;
+
+	while (ok && (bytes_read = read(in_fd, w->in, BULK_PIECE_SIZE)) != 0) {
+		if (bytes_read < 0) {
+			ok = (errno == EINTR);
+			continue;
+		}
+
+		n = Akuma_StreamEncrypt(&s, w->in, (size_t)bytes_read, w->out);
+		ok = (n != (size_t)-1 && bulk_write(out_fd, w->out, n));
+
+		w->bytes_in += (uint64_t)bytes_read;
+		w->bytes_out += n;
+	}
+
+	int final_len = (ok)?Akuma_StreamEncryptFinal(&s, w->out):-1;
+
+	if (final_len >= 0) {
+		n = (size_t)final_len;
+		memcpy(w->out + n, f->iv, AKUMA_IV_LENGTH_BYTES);
+		n += AKUMA_IV_LENGTH_BYTES;
+
+		if (Akuma_StreamTag(&s, w->out + n))
+			n += AKUMA_TAG_LENGTH_BYTES;
+
+		ok = bulk_write(out_fd, w->out, n);
+		w->bytes_out += n;
+	} else {
+		ok = false;
+	}
+
+	if (in_fd >= 0)
+		close(in_fd);
+
+	if (out_fd >= 0 && close(out_fd) != 0)
+		ok = false;
+
+	if (!ok && out_fd >= 0)
+		remove(f->out_path);
+
+	return ok;
+}
+
+static bool bulk_decrypt_file(struct BulkWorker * w, struct BulkFile * f) {
+	const Akuma_Key * key = &w->run->key;
+	size_t trailer = AKUMA_IV_LENGTH_BYTES + (key->auth?AKUMA_TAG_LENGTH_BYTES:0);
+	size_t remaining = f->size - trailer;
+	unsigned char tag[AKUMA_TAG_LENGTH_BYTES];
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];
+	Akuma_Stream s;
+
+	if (f->size < trailer || (key->mode == AKUMA_MODE_CHAIN && (remaining == 0 || remaining % AKUMA_BLOCK_SIZE_BYTES != 0))) {
+		fprintf(stderr, "Ciphertext file \"%s\" is truncated or not an Akuma ciphertext\n", f->in_path);
+		return false;
+	}
+
+	int in_fd = open(f->in_path, O_RDONLY);
+	bool ok = (in_fd >= 0 && bulk_pread(in_fd, iv, sizeof(iv), remaining) && bulk_pread(in_fd, tag, trailer - sizeof(iv), remaining + sizeof(iv)));
+	int out_fd = ok?open(f->out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644):-1;
+	int final_len = -1;
+	size_t n = 0;
+
+	ok = (ok && out_fd >= 0 && Akuma_StreamInit(&s, key, iv));
+
+	while (ok && remaining > 0) {
+		size_t len = (remaining < BULK_PIECE_SIZE)?remaining:BULK_PIECE_SIZE;
+		ssize_t bytes_read = read(in_fd, w->in, len);
+
+		if (bytes_read < 0 && errno == EINTR)
+			continue;
+
+		if (bytes_read <= 0) {
+			ok = false;
+			break;
+		}
+
+		n = Akuma_StreamDecrypt(&s, w->in, (size_t)bytes_read, w->out);
+		ok = (n != (size_t)-1 && bulk_write(out_fd, w->out, n));
+		remaining -= (size_t)bytes_read;
+
+		w->bytes_in += (uint64_t)bytes_read;
+		w->bytes_out += n;
+	}
+
+/* THE PLAINTEXT ALREADY WRITTEN IS REMOVED BELOW IF THE PADDING OR THE TAG IS BAD */
+
+	if (ok)
+		final_len = Akuma_StreamDecryptFinal(&s, w->out);
+
+	if (final_len < 0 || (key->auth && !Akuma_StreamVerify(&s, tag)))
+		ok = false;
+
+	if (ok) {
+		ok = bulk_write(out_fd, w->out, (size_t)final_len);
+		w->bytes_out += (size_t)final_len;
+	}
+
+	if (in_fd >= 0)
+		close(in_fd);
+
+	if (out_fd >= 0 && close(out_fd) != 0)
+		ok = false;
+
+	if (!ok && out_fd >= 0)
+		remove(f->out_path);
+
+	return ok;
+}
+
+/* ONE PIECE OF A SPLIT FILE. A DECRYPTED PIECE ALSO READS THE BLOCK AFTER IT, WHICH
+ * Akuma_StreamDecrypt() HOLDS BACK IN CHAINED MODE, AND THE BLOCK BEFORE IT TO SEEK. */
+
+static bool bulk_piece(struct BulkWorker * w, struct BulkFile * f, size_t offset, size_t length) {
+	bool encrypt = w->run->opts->encrypt;
+	bool last = (offset + length == ((encrypt)?f->size:(f->size - AKUMA_IV_LENGTH_BYTES)));
+	size_t extra = (!encrypt && !last)?AKUMA_BLOCK_SIZE_BYTES:0;
+	unsigned char prev[AKUMA_BLOCK_SIZE_BYTES];
+	uint64_t block = offset / AKUMA_BLOCK_SIZE_BYTES;
+	Akuma_Stream s;
+
+	int in_fd = open(f->in_path, O_RDONLY);
+	int out_fd = open(f->out_path, O_WRONLY);
+	bool ok = (in_fd >= 0 && out_fd >= 0 && Akuma_StreamInit(&s, &w->run->key, f->iv));
+
+	if (ok && offset > 0 && !encrypt)
+		ok = bulk_pread(in_fd, prev, sizeof(prev), offset - sizeof(prev));
+
+	ok = (ok && Akuma_StreamSeek(&s, f->iv, block, prev) && bulk_pread(in_fd, w->in, length + extra, offset));
+
+	if (ok) {
+		size_t n = (encrypt)?Akuma_StreamEncrypt(&s, w->in, length, w->out):Akuma_StreamDecrypt(&s, w->in, length + extra, w->out);
+
+		if (n == (size_t)-1) {
+			ok = false;
+			n = 0;
+		} else if (last) {
+			int final_len = (encrypt)?Akuma_StreamEncryptFinal(&s, w->out + n):Akuma_StreamDecryptFinal(&s, w->out + n);
+
+			ok = (final_len >= 0);
+			n += (ok)?(size_t)final_len:0;
+
+			if (encrypt) {
+				memcpy(w->out + n, f->iv, AKUMA_IV_LENGTH_BYTES);
+				n += AKUMA_IV_LENGTH_BYTES;
+			}
+
+			f->out_len = offset + n;
+		} else if (n > length) {
+			n = length;
+		}
+
+		ok = (ok && bulk_pwrite(out_fd, w->out, n, offset));
+		w->bytes_in += length;
+		w->bytes_out += n;
+	}
+
+	if (in_fd >= 0)
+		close(in_fd);
+
+	if (out_fd >= 0 && close(out_fd) != 0)
+		ok = false;
+
+	return ok;
+}
+
+/* THE LAST PIECE TO FINISH CUTS THE PADDING OFF (OR REMOVES THE FILE) AND COUNTS IT */
+
+static void bulk_piece_done(struct BulkWorker * w, struct BulkFile * f, bool ok) {
+	pthread_mutex_lock(&w->run->lock);
+
+	if (!ok)
+		f->failed = true;
+
+	bool done = (--f->pieces == 0);
+
+	pthread_mutex_unlock(&w->run->lock);
+
+	if (!done)
+		return;
+
+	if (!f->failed && truncate(f->out_path, (off_t)f->out_len) != 0)
+		f->failed = true;
+
+	if (f->failed) {
+		fprintf(stderr, "Failed to %s \"%s\"\n", (w->run->opts->encrypt)?"encrypt":"decrypt", f->in_path);
+		remove(f->out_path);
+		++w->failed;
+	} else {
+		++w->files;
+	}
+}
+
+
+/* WORKERS */
+
+static bool bulk_next(struct BulkRun * run, unsigned int id, size_t * task) {
+	bool found = false;
+
+	for (unsigned int i = 0; !found && i < run->workers; ++i) {
+		struct BulkQueue * q = &run->queues[(id + i) % run->workers];
+
+		pthread_mutex_lock(&q->lock);
+
+		if (q->tail > q->head) {
+			*task = (i == 0)?q->tasks[--q->tail]:q->tasks[q->head++];
+			found = true;
+		}
+
+		pthread_mutex_unlock(&q->lock);
+	}
+
+	return found;
+}
+
+static void * bulk_worker(void * arg) {
+	struct BulkWorker * w = (struct BulkWorker *)arg;
+	struct BulkRun * run = w->run;
+	size_t t;
+
+	while (bulk_next(run, w->id, &t)) {
+		struct BulkTask * task = &run->tasks[t];
+
+		if (task->split) {
+			struct BulkFile * f = &run->files[task->first];
+
+			bulk_piece_done(w, f, bulk_piece(w, f, task->offset, task->length));
+			continue;
+		}
+
+		for (size_t i = task->first; i < task->first + task->count; ++i) {
+			struct BulkFile * f = &run->files[i];
+			bool ok = (run->opts->encrypt)?bulk_encrypt_file(w, f):bulk_decrypt_file(w, f);
+
+			if (ok) {
+				++w->files;
+			} else {
+				fprintf(stderr, "Failed to %s \"%s\"\n", (run->opts->encrypt)?"encrypt":"decrypt", f->in_path);
+				++w->failed;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static bool bulk_key(struct BulkRun * run) {
+	unsigned char key[AKUMA_KEY_LENGTH_BYTES + 1];
+	FILE * key_file = fopen(run->opts->key_filename, "rb");
+
+	if (key_file == NULL) {
+		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", run->opts->key_filename);
+		perror("Error");
+		return false;
+	}
+
+	size_t key_len = fread(key, 1, sizeof(key), key_file);
+
+	fclose(key_file);
+
+	if (key_len != AKUMA_KEY_LENGTH_BYTES) {
+		fprintf(stderr, "Key length incorrect\nKey size must be 256 bits (32 bytes)\n");
+		return false;
+	}
+
+	bool ok = Akuma_KeyInit(&run->key, key, run->opts->mode);
+
+	OPENSSL_cleanse(key, sizeof(key));
+
+	return ok;
+}
+
+static void bulk_free(struct BulkRun * run) {
+	for (size_t i = 0; i < run->n_files; ++i) {
+		free(run->files[i].in_path);
+		free(run->files[i].out_path);
+	}
+
+	free(run->files);
+	free(run->tasks);
+	Akuma_KeyFree(&run->key);
+}
+
+/* RETURNS 0 WHEN EVERY FILE WENT THROUGH, -1 OTHERWISE */
+
+static int bulk_main(const struct BulkOptions * opts) {
+	struct BulkRun run;
+	struct timespec t0, t1;
+	bool ok = true;
+
+	memset(&run, 0, sizeof(run));
+	run.opts = opts;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (!bulk_key(&run))
+		return -1;
+
+	for (int i = 0; ok && i < opts->n_inputs; ++i)
+		ok = bulk_input(&run, opts->inputs[i]);
+
+	if (ok && opts->list_filename != NULL)
+		ok = bulk_list(&run, opts->list_filename);
+
+/* A FRESH IV PER FILE FROM THE THREAD'S POOL, SPLIT CIPHERTEXTS BRING THEIRS */
+
+	for (size_t i = 0; ok && opts->encrypt && i < run.n_files; ++i)
+		ok = Akuma_IV(run.files[i].iv);
+
+	ok = (ok && bulk_plan(&run));
+
+	if (!ok) {
+		fprintf(stderr, "Failed to collect the input files\nAborting...\n");
+		bulk_free(&run);
+		return -1;
+	}
+
+	run.workers = Akuma_Threads(opts->workers);
+
+	if (run.workers > run.n_tasks)
+		run.workers = (run.n_tasks > 0)?(unsigned int)run.n_tasks:1;
+
+	struct BulkWorker * workers = calloc(run.workers, sizeof(struct BulkWorker));
+	pthread_t * threads = malloc(sizeof(pthread_t) * run.workers);
+	bool * started = calloc(run.workers, sizeof(bool));
+
+	run.queues = calloc(run.workers, sizeof(struct BulkQueue));
+	ok = (workers != NULL && threads != NULL && started != NULL && run.queues != NULL);
+
+	for (unsigned int t = 0; run.queues != NULL && workers != NULL && t < run.workers; ++t) {
+		workers[t].run = &run;
+		workers[t].id = t;
+		workers[t].in = malloc(BULK_PIECE_SIZE + AKUMA_BLOCK_SIZE_BYTES);
+		workers[t].out = malloc(BULK_PIECE_SIZE + 2 * AKUMA_BLOCK_SIZE_BYTES + AKUMA_IV_LENGTH_BYTES + AKUMA_TAG_LENGTH_BYTES);
+
+		run.queues[t].tasks = malloc(sizeof(size_t) * (run.n_tasks / run.workers + 1));
+		pthread_mutex_init(&run.queues[t].lock, NULL);
+
+		ok = (ok && workers[t].in != NULL && workers[t].out != NULL && run.queues[t].tasks != NULL);
+	}
+
+	if (ok) {
+		pthread_mutex_init(&run.lock, NULL);
+
+		for (size_t i = 0; i < run.n_tasks; ++i) {
+			struct BulkQueue * q = &run.queues[i % run.workers];
+
+			q->tasks[q->tail++] = i;
+		}
+
+/* WORKER 0 RUNS ON THE CALLING THREAD, ANY WORKER THAT FAILS TO START DOES TOO */
+
+		for (unsigned int t = 1; t < run.workers; ++t)
+			started[t] = (pthread_create(&threads[t], NULL, bulk_worker, &workers[t]) == 0);
+
+		bulk_worker(&workers[0]);
+
+		for (unsigned int t = 1; t < run.workers; ++t) {
+			if (started[t])
+				pthread_join(threads[t], NULL);
+			else
+				bulk_worker(&workers[t]);
+		}
+
+		pthread_mutex_destroy(&run.lock);
+	} else {
+		fprintf(stderr, "Failed to allocate the worker buffers [malloc()]\nAborting...\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	size_t files = 0;
+	size_t failed = run.skipped;
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+
+	for (unsigned int t = 0; workers != NULL && t < run.workers; ++t) {
+		files += workers[t].files;
+		failed += workers[t].failed;
+		bytes_in += workers[t].bytes_in;
+		bytes_out += workers[t].bytes_out;
+
+		free(workers[t].in);
+		free(workers[t].out);
+
+		if (run.queues != NULL) {
+			free(run.queues[t].tasks);
+			pthread_mutex_destroy(&run.queues[t].lock);
+		}
+	}
+
+	double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("%s %zu files (%zu failed) with %u workers: %llu bytes in, %llu bytes out in %.3f s (%.1f MB/s)\n",
+			(opts->encrypt)?"Encrypted":"Decrypted", files, failed, run.workers,
+			(unsigned long long)bytes_in, (unsigned long long)bytes_out, secs, (secs > 0)?((double)bytes_in / secs / 1e6):0.0);
+
+	free(workers);
+	free(threads);
+	free(started);
+	free(run.queues);
+	bulk_free(&run);
+
+	return (ok && failed == 0)?0:-1;
+}
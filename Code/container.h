@@ -0,0 +1,672 @@
+/* CHUNKED CONTAINER FORMAT FOR encrypt.c (-C) AND decrypt.c, INCLUDE AFTER akuma.h
+ *
+ *   HEADER    MAGIC "\x89AKUMA\r\n" | u8 VERSION | u8 MODE | u8 FLAGS | u8 COMPRESSION
+ *             | u32 CHUNK SIZE | IV[32]                                         48 BYTES
+ *   CHUNKS    u32 LENGTH | CIPHERTEXT (AND TAG)                                 PER CHUNK
+ *   END       u32 0
+ *   INDEX     u64 FILE OFFSET OF EACH CHUNK RECORD
+ *   FOOTER    u64 CHUNKS | u64 PLAINTEXT LENGTH | "AKUMAIDX"                    24 BYTES
+ *
+ * ALL INTEGERS ARE LITTLE ENDIAN. EVERY CHUNK HOLDS CHUNK SIZE BYTES OF PLAINTEXT EXCEPT
+ * THE LAST ONE, WHICH IS SHORTER (AN EMPTY LAST CHUNK FOLLOWS A PLAINTEXT THAT FILLS ITS
+ * CHUNKS EXACTLY), SO THE WRITER NEVER NEEDS TO KNOW THE LENGTH UP FRONT.
+ *
+ * EACH CHUNK IS A COMPLETE MESSAGE OF ITS OWN (PADDED IN CHAINED MODE, WITH ITS OWN TAG
+ * UNDER AKUMA_AUTH) UNDER THE IV SHA-256(IV || u64 INDEX || u8 LAST). THE CHUNKS ARE
+ * ENCRYPTED AND DECRYPTED IN BATCHES OVER ctx->threads (Akuma_EncryptBatch()), ANY
+ * CHUNK CAN BE DECRYPTED ON ITS OWN THROUGH THE INDEX, AND WITH AKUMA_AUTH A CHUNK
+ * THAT WAS MOVED, OR A FILE CUT SHORT AT A CHUNK BOUNDARY, FAILS ITS TAG.
+ *
+ * THE WRITER ONLY APPENDS, AND A READER WITHOUT THE INDEX TELLS THE LAST CHUNK BY ITS
+ * SHORT RECORD, SO EITHER END CAN BE A PIPE (encrypt/decrypt "-", container_stream()).
+ *
+ * WITH COMPRESSION (encrypt -z) EVERY CHUNK IS COMPRESSED ON ITS OWN BEFORE IT IS
+ * ENCRYPTED, SO THE INDEX AND THE PLAINTEXT OFFSETS WORK AS BEFORE. RECORDS NO LONGER
+ * HAVE A FIXED LENGTH, SO THE LAST ONE CARRIES CONTAINER_LAST IN ITS LENGTH FIELD.
+ * zlib IS ALWAYS BUILT IN (-lz), zstd WITH -DAKUMA_HAVE_ZSTD (-lzstd).
+ *
+ * encrypt ONLY WRITES CONTAINERS AND decrypt ONLY READS THEM, SO THE FUNCTIONS ARE
+ * static inline AND EACH PROGRAM COMPILES THE HALF IT USES WITHOUT A WARNING.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#ifdef AKUMA_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define CONTAINER_MAGIC         "\x89" "AKUMA\r\n"
+#define CONTAINER_INDEX_MAGIC   "AKUMAIDX"
+#define CONTAINER_MAGIC_LENGTH  8
+#define CONTAINER_VERSION       1
+#define CONTAINER_HEADER_SIZE   48
+#define CONTAINER_FOOTER_SIZE   24
+#define CONTAINER_CHUNK         (1024 * 1024)		/* PLAINTEXT PER CHUNK WRITTEN BY encrypt -C */
+#define CONTAINER_MAX_CHUNK     (64 * 1024 * 1024)	/* LARGEST CHUNK SIZE A READER ACCEPTS */
+#define CONTAINER_FLAG_AUTH     1
+#define CONTAINER_LAST          0x80000000u		/* RECORD LENGTH FLAG OF A COMPRESSED CONTAINER'S LAST CHUNK */
+
+#define CONTAINER_COMPRESS_NONE 0	/* HEADER COMPRESSION BYTE */
+#define CONTAINER_COMPRESS_ZLIB 1
+#define CONTAINER_COMPRESS_ZSTD 2
+
+#define CONTAINER_ZLIB_LEVEL    Z_DEFAULT_COMPRESSION
+#define CONTAINER_ZSTD_LEVEL    3
+
+struct Container {
+	int version;
+	int mode;			/* AKUMA_MODE_* | AKUMA_AUTH */
+	int compression;		/* CONTAINER_COMPRESS_* */
+	size_t chunk_size;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];
+
+	uint64_t chunks;		/* FROM THE FOOTER WHEN READING */
+	uint64_t plaintext_len;
+	uint64_t * offsets;
+};
+
+
+/* LITTLE ENDIAN FIELDS */
+
+static inline void container_put32(unsigned char * p, uint32_t v) {
+	for (int i = 0; i < 4; ++i)
+		p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static inline void container_put64(unsigned char * p, uint64_t v) {
+	for (int i = 0; i < 8; ++i)
+		p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static inline uint32_t container_get32(const unsigned char * p) {
+	uint32_t v = 0;
+
+	for (int i = 3; i >= 0; --i)
+		v = (v << 8) | p[i];
+
+	return v;
+}
+
+static inline uint64_t container_get64(const unsigned char * p) {
+	uint64_t v = 0;
+
+	for (int i = 7; i >= 0; --i)
+		v = (v << 8) | p[i];
+
+	return v;
+}
+
+static inline bool container_write(int fd, const unsigned char * buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		buf += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+/* READ UP TO len BYTES, SHORT ONLY AT THE END OF THE INPUT, -1 ON AN ERROR */
+
+static inline ssize_t container_read(int fd, unsigned char * buf, size_t len) {
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t n = read(fd, buf + done, len - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0)
+			return -1;
+
+		if (n == 0)
+			break;
+
+		done += (size_t)n;
+	}
+
+	return (ssize_t)done;
+}
+
+static inline bool container_pread(int fd, unsigned char * buf, size_t len, uint64_t offset) {
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, (off_t)offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		buf += n;
+		len -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+
+	return true;
+}
+
+static inline void container_chunk_iv(const struct Container * c, uint64_t index, bool last, unsigned char * iv) {
+	unsigned char block[sizeof(uint64_t) + 1];
+	SHA256_CTX sha;
+
+	container_put64(block, index);
+	block[sizeof(uint64_t)] = last?1:0;
+
+	SHA256_Init(&sha);
+	SHA256_Update(&sha, c->iv, sizeof(c->iv));
+	SHA256_Update(&sha, block, sizeof(block));
+	SHA256_Final(iv, &sha);
+}
+
+
+/* COMPRESSION */
+
+/* 1 IF THIS BUILD CAN READ AND WRITE compression */
+
+static inline int container_codec(int compression) {
+#ifdef AKUMA_HAVE_ZSTD
+	if (compression == CONTAINER_COMPRESS_ZSTD)
+		return 1;
+#endif
+	return (compression == CONTAINER_COMPRESS_NONE || compression == CONTAINER_COMPRESS_ZLIB);
+}
+
+/* LARGEST COMPRESSED CHUNK, INCOMPRESSIBLE DATA GROWS A LITTLE */
+
+static inline size_t container_bound(const struct Container * c) {
+#ifdef AKUMA_HAVE_ZSTD
+	if (c->compression == CONTAINER_COMPRESS_ZSTD)
+		return ZSTD_compressBound(c->chunk_size);
+#endif
+	if (c->compression == CONTAINER_COMPRESS_ZLIB)
+		return compressBound((uLong)c->chunk_size);
+
+	return c->chunk_size;
+}
+
+/* BOTH RETURN THE BYTES WRITTEN TO out (AT MOST out_size) OR -1 */
+
+static inline size_t container_compress(int compression, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+#ifdef AKUMA_HAVE_ZSTD
+	if (compression == CONTAINER_COMPRESS_ZSTD) {
+		size_t n = ZSTD_compress(out, out_size, in, in_len, CONTAINER_ZSTD_LEVEL);
+
+		return ZSTD_isError(n)?(size_t)-1:n;
+	}
+#endif
+	uLongf n = (uLongf)out_size;
+
+	if (compression != CONTAINER_COMPRESS_ZLIB || compress2(out, &n, in, (uLong)in_len, CONTAINER_ZLIB_LEVEL) != Z_OK)
+		return -1;
+
+	return n;
+}
+
+static inline size_t container_decompress(int compression, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+#ifdef AKUMA_HAVE_ZSTD
+	if (compression == CONTAINER_COMPRESS_ZSTD) {
+		size_t n = ZSTD_decompress(out, out_size, in, in_len);
+
+		return ZSTD_isError(n)?(size_t)-1:n;
+	}
+#endif
+	uLongf n = (uLongf)out_size;
+
+	if (compression != CONTAINER_COMPRESS_ZLIB || uncompress(out, &n, in, (uLong)in_len) != Z_OK)
+		return -1;
+
+	return n;
+}
+
+/* (DE)COMPRESS A BATCH OF CHUNKS, ONE SLICE PER THREAD LIKE Akuma_EncryptBatch() */
+
+struct ContainerCodecJob {
+	const struct Container * c;
+	struct AkumaMessage * msgs;
+	size_t count;
+	unsigned char * buf;		/* stride BYTES PER CHUNK */
+	size_t stride;
+	bool compress;
+	bool ok;
+};
+
+static inline void * container_codec_worker(void * arg) {
+	struct ContainerCodecJob * job = (struct ContainerCodecJob *)arg;
+
+	for (size_t i = 0; job->ok && i < job->count; ++i) {
+		struct AkumaMessage * m = &job->msgs[i];
+		unsigned char * to = job->buf + i * job->stride;
+
+		if (job->compress) {
+			m->in_len = container_compress(job->c->compression, m->in, m->in_len, to, job->stride);
+			m->in = to;
+			job->ok = (m->in_len != (size_t)-1);
+		} else {
+			m->out_len = container_decompress(job->c->compression, m->out, m->out_len, to, job->stride);
+			m->out = to;
+			job->ok = (m->out_len != (size_t)-1);
+		}
+	}
+
+	return NULL;
+}
+
+/* COMPRESSING REPOINTS EVERY msgs[i].in AT ITS CHUNK IN buf, DECOMPRESSING EVERY
+ * msgs[i].out, SO THE BATCH THEN RUNS THROUGH THE CIPHER OR OUT AS BEFORE */
+
+static inline bool container_codec_batch(const struct Container * c, struct AkumaMessage * msgs, size_t count, unsigned char * buf, size_t stride, unsigned int threads, bool compress) {
+	struct ContainerCodecJob jobs[AKUMA_MAX_THREADS];
+	pthread_t workers[AKUMA_MAX_THREADS];
+	bool started[AKUMA_MAX_THREADS];
+	size_t first = 0;
+	bool ok = true;
+
+	if (threads > count)
+		threads = (unsigned int)count;
+
+	if (threads == 0)
+		return true;
+
+	for (unsigned int t = 0; t < threads; ++t) {
+		jobs[t] = (struct ContainerCodecJob){ c, msgs + first, count / threads + (t < count % threads), buf + first * stride, stride, compress, true };
+		first += jobs[t].count;
+	}
+
+/* SLICE 0 RUNS ON THE CALLING THREAD, ANY WORKER THAT FAILS TO START DOES TOO */
+
+	for (unsigned int t = 1; t < threads; ++t)
+		started[t] = (pthread_create(&workers[t], NULL, container_codec_worker, &jobs[t]) == 0);
+
+	container_codec_worker(&jobs[0]);
+
+	for (unsigned int t = 1; t < threads; ++t) {
+		if (started[t])
+			pthread_join(workers[t], NULL);
+		else
+			container_codec_worker(&jobs[t]);
+	}
+
+	for (unsigned int t = 0; t < threads; ++t)
+		ok = (ok && jobs[t].ok);
+
+	return ok;
+}
+
+static inline size_t container_record_max(const struct Container * c) {
+	return container_bound(c) + AKUMA_BLOCK_SIZE_BYTES + ((c->mode & AKUMA_AUTH)?AKUMA_TAG_LENGTH_BYTES:0);
+}
+
+
+/* HEADER AND INDEX */
+
+static inline void container_header(const struct Container * c, unsigned char * header) {
+	memset(header, 0, CONTAINER_HEADER_SIZE);
+	memcpy(header, CONTAINER_MAGIC, CONTAINER_MAGIC_LENGTH);
+
+	header[8] = CONTAINER_VERSION;
+	header[9] = (unsigned char)(c->mode & ~AKUMA_AUTH);
+	header[10] = (c->mode & AKUMA_AUTH)?CONTAINER_FLAG_AUTH:0;
+	header[11] = (unsigned char)c->compression;
+
+	container_put32(header + 12, (uint32_t)c->chunk_size);
+	memcpy(header + 16, c->iv, AKUMA_IV_LENGTH_BYTES);
+}
+
+/* 1 IF header STARTS A CONTAINER THIS VERSION CAN READ */
+
+static inline int container_parse(struct Container * c, const unsigned char * header) {
+	memset(c, 0, sizeof(struct Container));
+
+	if (memcmp(header, CONTAINER_MAGIC, CONTAINER_MAGIC_LENGTH) != 0)
+		return 0;
+
+	c->version = header[8];
+	c->mode = header[9] | ((header[10] & CONTAINER_FLAG_AUTH)?AKUMA_AUTH:0);
+	c->compression = header[11];
+	c->chunk_size = container_get32(header + 12);
+
+	memcpy(c->iv, header + 16, AKUMA_IV_LENGTH_BYTES);
+
+	if (c->version != CONTAINER_VERSION || (header[9] != AKUMA_MODE_CHAIN && header[9] != AKUMA_MODE_CTR) || !container_codec(c->compression))
+		return 0;
+
+	return (c->chunk_size > 0 && c->chunk_size <= CONTAINER_MAX_CHUNK && c->chunk_size % AKUMA_BLOCK_SIZE_BYTES == 0);
+}
+
+/* READ THE HEADER, FOOTER AND INDEX OF A CONTAINER FILE. 1 ON SUCCESS, 0 IF fd IS NOT A
+ * CONTAINER (A RAW CIPHERTEXT), -1 IF IT IS ONE BUT DAMAGED OR OF AN UNKNOWN VERSION */
+
+static inline int container_open(struct Container * c, int fd) {
+	unsigned char header[CONTAINER_HEADER_SIZE];
+	unsigned char footer[CONTAINER_FOOTER_SIZE];
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < CONTAINER_HEADER_SIZE + sizeof(uint32_t) + CONTAINER_FOOTER_SIZE)
+		return 0;
+
+	if (!container_pread(fd, header, sizeof(header), 0) || memcmp(header, CONTAINER_MAGIC, CONTAINER_MAGIC_LENGTH) != 0)
+		return 0;
+
+	if (!container_parse(c, header) || !container_pread(fd, footer, sizeof(footer), (uint64_t)st.st_size - sizeof(footer)))
+		return -1;
+
+	c->chunks = container_get64(footer);
+	c->plaintext_len = container_get64(footer + 8);
+
+	uint64_t index_end = (uint64_t)st.st_size - sizeof(footer);
+
+	if (memcmp(footer + 16, CONTAINER_INDEX_MAGIC, CONTAINER_MAGIC_LENGTH) != 0 || c->chunks == 0 || c->chunks > index_end / sizeof(uint64_t)
+			|| c->chunks - 1 != c->plaintext_len / c->chunk_size)
+		return -1;
+
+	unsigned char * index = malloc(sizeof(uint64_t) * c->chunks);
+
+	c->offsets = malloc(sizeof(uint64_t) * c->chunks);
+
+	if (index == NULL || c->offsets == NULL || !container_pread(fd, index, sizeof(uint64_t) * c->chunks, index_end - sizeof(uint64_t) * c->chunks)) {
+		free(index);
+		free(c->offsets);
+		c->offsets = NULL;
+		return -1;
+	}
+
+	for (uint64_t i = 0; i < c->chunks; ++i)
+		c->offsets[i] = container_get64(index + sizeof(uint64_t) * i);
+
+	free(index);
+
+	return 1;
+}
+
+static inline void container_close(struct Container * c) {
+	free(c->offsets);
+	c->offsets = NULL;
+}
+
+
+/* ENCRYPT in_fd INTO A CONTAINER ON out_fd. ctx HOLDS THE KEY, MODE AND THREADS,
+ * iv IS THE CONTAINER IV, compression A CONTAINER_COMPRESS_*. RETURNS 0 OR -1 */
+
+static inline int container_encrypt(Akuma_CTX * ctx, int in_fd, int out_fd, const unsigned char * iv, int compression) {
+	struct Container c;
+	unsigned char header[CONTAINER_HEADER_SIZE];
+	unsigned char footer[CONTAINER_FOOTER_SIZE];
+	size_t batch = Akuma_Threads(ctx->threads);
+	bool last = false;
+	bool ok = true;
+
+	memset(&c, 0, sizeof(c));
+	c.mode = ctx->mode | (ctx->auth?AKUMA_AUTH:0);
+	c.compression = compression;
+	c.chunk_size = CONTAINER_CHUNK;
+	memcpy(c.iv, iv, sizeof(c.iv));
+
+	size_t record_size = sizeof(uint32_t) + container_record_max(&c);
+	size_t offsets_size = 64;
+	uint64_t * offsets = malloc(sizeof(uint64_t) * offsets_size);
+	unsigned char * in = malloc(batch * c.chunk_size);
+	unsigned char * packed = compression?malloc(batch * container_bound(&c)):NULL;
+	unsigned char * out = malloc(batch * record_size);
+	unsigned char * ivs = malloc(batch * AKUMA_IV_LENGTH_BYTES);
+	struct AkumaMessage * msgs = malloc(batch * sizeof(struct AkumaMessage));
+	uint64_t pos = CONTAINER_HEADER_SIZE;
+
+	container_header(&c, header);
+	ok = (container_codec(compression) && offsets != NULL && in != NULL && (packed != NULL || !compression) && out != NULL && ivs != NULL && msgs != NULL
+			&& container_write(out_fd, header, sizeof(header)));
+
+/* READ UP TO batch CHUNKS, THE FIRST SHORT ONE IS THE LAST */
+
+	while (ok && !last) {
+		size_t count = 0;
+
+		while (ok && !last && count < batch) {
+			ssize_t n = container_read(in_fd, in + count * c.chunk_size, c.chunk_size);
+
+			ok = (n >= 0);
+			last = (ok && (size_t)n < c.chunk_size);
+
+			msgs[count].iv = ivs + count * AKUMA_IV_LENGTH_BYTES;
+			msgs[count].in = in + count * c.chunk_size;
+			msgs[count].in_len = ok?(size_t)n:0;
+			msgs[count].out = out + count * record_size + sizeof(uint32_t);
+
+			container_chunk_iv(&c, c.chunks + count, last, ivs + count * AKUMA_IV_LENGTH_BYTES);
+			c.plaintext_len += msgs[count].in_len;
+			++count;
+		}
+
+/* EACH CHUNK IS COMPRESSED ON ITS OWN, THE CIPHER THEN RUNS OVER THE SMALLER CHUNKS */
+
+		if (ok && compression)
+			ok = container_codec_batch(&c, msgs, count, packed, container_bound(&c), (unsigned int)batch, true);
+
+		ok = (ok && Akuma_EncryptBatch(ctx, msgs, count) == count);
+
+		for (size_t j = 0; ok && j < count; ++j) {
+			unsigned char * record = out + j * record_size;
+
+			if (c.chunks == offsets_size) {
+				uint64_t * grown = realloc(offsets, sizeof(uint64_t) * 2 * offsets_size);
+
+				ok = (grown != NULL);
+				offsets = ok?grown:offsets;
+				offsets_size *= 2;
+			}
+
+			if (ok) {
+				container_put32(record, (uint32_t)msgs[j].out_len | ((compression && last && j == count - 1)?CONTAINER_LAST:0));
+				ok = container_write(out_fd, record, sizeof(uint32_t) + msgs[j].out_len);
+
+				offsets[c.chunks++] = pos;
+				pos += sizeof(uint32_t) + msgs[j].out_len;
+			}
+		}
+	}
+
+/* END MARKER, INDEX AND FOOTER (THE INDEX IS REUSED AS ITS OWN ENCODING BUFFER) */
+
+	if (ok && last) {
+		unsigned char end[sizeof(uint32_t)] = { 0 };
+
+		for (uint64_t i = 0; i < c.chunks; ++i)
+			container_put64((unsigned char *)&offsets[i], offsets[i]);
+
+		container_put64(footer, c.chunks);
+		container_put64(footer + 8, c.plaintext_len);
+		memcpy(footer + 16, CONTAINER_INDEX_MAGIC, CONTAINER_MAGIC_LENGTH);
+
+		ok = (container_write(out_fd, end, sizeof(end)) && container_write(out_fd, (unsigned char *)offsets, sizeof(uint64_t) * c.chunks) && container_write(out_fd, footer, sizeof(footer)));
+	}
+
+	free(offsets);
+	free(in);
+	free(packed);
+	free(out);
+	free(ivs);
+	free(msgs);
+
+	return (ok && last)?0:-1;
+}
+
+/* DECRYPT THE PLAINTEXT BYTES [start, stop) OF AN OPENED CONTAINER, ONLY THE CHUNKS
+ * COVERING THEM ARE READ. ctx HOLDS THE KEY AND THREADS, THE MODE COMES FROM THE HEADER.
+ * RETURNS THE BYTES WRITTEN TO out_fd OR -1 */
+
+static inline size_t container_decrypt(Akuma_CTX * ctx, const struct Container * c, int in_fd, int out_fd, uint64_t start, uint64_t stop) {
+	size_t batch = Akuma_Threads(ctx->threads);
+	size_t record_max = container_record_max(c);
+	size_t written = 0;
+	bool ok = Akuma_SetMode(ctx, c->mode);
+
+	if (stop > c->plaintext_len)
+		stop = c->plaintext_len;
+
+	if (start >= stop)
+		return ok?0:(size_t)-1;
+
+	unsigned char * in = malloc(batch * record_max);
+	unsigned char * out = malloc(batch * record_max);
+	unsigned char * plain = c->compression?malloc(batch * c->chunk_size):NULL;
+	unsigned char * ivs = malloc(batch * AKUMA_IV_LENGTH_BYTES);
+	struct AkumaMessage * msgs = malloc(batch * sizeof(struct AkumaMessage));
+
+	ok = (ok && in != NULL && out != NULL && (plain != NULL || !c->compression) && ivs != NULL && msgs != NULL);
+
+	for (uint64_t first = start / c->chunk_size; ok && first <= (stop - 1) / c->chunk_size; first += batch) {
+		size_t count = 0;
+
+		for (uint64_t i = first; ok && count < batch && i <= (stop - 1) / c->chunk_size; ++i, ++count) {
+			unsigned char length[sizeof(uint32_t)];
+			bool last = (i == c->chunks - 1);
+
+			ok = container_pread(in_fd, length, sizeof(length), c->offsets[i]);
+
+			size_t len = ok?(container_get32(length) & (c->compression?~CONTAINER_LAST:~0u)):0;
+
+			ok = (ok && len <= record_max && container_pread(in_fd, in + count * record_max, len, c->offsets[i] + sizeof(length)));
+
+			msgs[count].iv = ivs + count * AKUMA_IV_LENGTH_BYTES;
+			msgs[count].in = in + count * record_max;
+			msgs[count].in_len = len;
+			msgs[count].out = out + count * record_max;
+
+			container_chunk_iv(c, i, last, ivs + count * AKUMA_IV_LENGTH_BYTES);
+		}
+
+		ok = (ok && Akuma_DecryptBatch(ctx, msgs, count) == count);
+
+		if (ok && c->compression)
+			ok = container_codec_batch(c, msgs, count, plain, c->chunk_size, (unsigned int)batch, false);
+
+/* EVERY CHUNK BUT THE LAST MUST COME OUT FULL, THEN WRITE THE PART INSIDE THE RANGE */
+
+		for (size_t j = 0; ok && j < count; ++j) {
+			uint64_t i = first + j;
+			uint64_t chunk_start = i * c->chunk_size;
+			size_t expected = (i == c->chunks - 1)?(size_t)(c->plaintext_len - chunk_start):c->chunk_size;
+			size_t from = (start > chunk_start)?(size_t)(start - chunk_start):0;
+			size_t to = (stop < chunk_start + expected)?(size_t)(stop - chunk_start):expected;
+
+			ok = (msgs[j].out_len == expected && container_write(out_fd, msgs[j].out + from, to - from));
+			written += to - from;
+		}
+	}
+
+	free(in);
+	free(out);
+	free(plain);
+	free(ivs);
+	free(msgs);
+
+	return ok?written:(size_t)-1;
+}
+
+/* DECRYPT A CONTAINER READ FRONT TO BACK FROM A PIPE, c PARSED FROM ITS HEADER (ALREADY
+ * READ). WITHOUT THE INDEX A CHUNK IS KNOWN TO BE THE LAST ONE BY ITS RECORD, WHICH IS
+ * SHORTER THAN A FULL CHUNK'S. THE INDEX IS SKIPPED AND THE FOOTER CHECKED AGAINST THE
+ * CHUNKS SEEN. PLAINTEXT BYTES [start, stop) ARE WRITTEN, EACH CHUNK ONCE IT DECRYPTED
+ * (AND UNDER AKUMA_AUTH PASSED ITS TAG). RETURNS THE BYTES WRITTEN TO out_fd OR -1 */
+
+static inline size_t container_stream(Akuma_CTX * ctx, struct Container * c, int in_fd, int out_fd, uint64_t start, uint64_t stop) {
+	size_t batch = Akuma_Threads(ctx->threads);
+	size_t record_max = container_record_max(c);
+	size_t record_full = c->chunk_size + (((c->mode & ~AKUMA_AUTH) == AKUMA_MODE_CHAIN)?AKUMA_BLOCK_SIZE_BYTES:0) + ((c->mode & AKUMA_AUTH)?AKUMA_TAG_LENGTH_BYTES:0);
+	size_t written = 0;
+	bool last = false;
+	bool ok = Akuma_SetMode(ctx, c->mode);
+
+	unsigned char * in = malloc(batch * record_max);
+	unsigned char * out = malloc(batch * record_max);
+	unsigned char * plain = c->compression?malloc(batch * c->chunk_size):NULL;
+	unsigned char * ivs = malloc(batch * AKUMA_IV_LENGTH_BYTES);
+	struct AkumaMessage * msgs = malloc(batch * sizeof(struct AkumaMessage));
+
+	ok = (ok && in != NULL && out != NULL && (plain != NULL || !c->compression) && ivs != NULL && msgs != NULL);
+
+	while (ok && !last) {
+		size_t count = 0;
+
+		while (ok && !last && count < batch) {
+			unsigned char length[sizeof(uint32_t)];
+
+			ok = (container_read(in_fd, length, sizeof(length)) == sizeof(length));
+
+			size_t len = ok?container_get32(length):0;
+
+			last = c->compression?((len & CONTAINER_LAST) != 0):(len != record_full);
+			len &= c->compression?~CONTAINER_LAST:~0u;
+			ok = (ok && len <= record_max && container_read(in_fd, in + count * record_max, len) == (ssize_t)len);
+
+			msgs[count].iv = ivs + count * AKUMA_IV_LENGTH_BYTES;
+			msgs[count].in = in + count * record_max;
+			msgs[count].in_len = len;
+			msgs[count].out = out + count * record_max;
+
+			container_chunk_iv(c, c->chunks + count, last, ivs + count * AKUMA_IV_LENGTH_BYTES);
+			++count;
+		}
+
+		ok = (ok && Akuma_DecryptBatch(ctx, msgs, count) == count);
+
+		if (ok && c->compression)
+			ok = container_codec_batch(c, msgs, count, plain, c->chunk_size, (unsigned int)batch, false);
+
+/* EVERY CHUNK BUT THE LAST MUST COME OUT FULL, THE LAST ONE SHORT */
+
+		for (size_t j = 0; ok && j < count; ++j) {
+			uint64_t chunk_start = c->plaintext_len;
+			size_t n = msgs[j].out_len;
+			size_t from = (start > chunk_start)?(size_t)((start - chunk_start < n)?(start - chunk_start):n):0;
+			size_t to = (stop < chunk_start + n)?((stop > chunk_start)?(size_t)(stop - chunk_start):0):n;
+
+			ok = ((last && j == count - 1)?(n < c->chunk_size):(n == c->chunk_size));
+			ok = (ok && (to <= from || container_write(out_fd, msgs[j].out + from, to - from)));
+
+			written += (to > from)?(to - from):0;
+			c->plaintext_len += n;
+			++c->chunks;
+		}
+	}
+
+/* END MARKER, THE INDEX (READ AND DROPPED) AND THE FOOTER */
+
+	if (ok) {
+		unsigned char end[sizeof(uint32_t)];
+		unsigned char footer[CONTAINER_FOOTER_SIZE];
+		uint64_t index_len = sizeof(uint64_t) * c->chunks;
+
+		ok = (container_read(in_fd, end, sizeof(end)) == sizeof(end) && container_get32(end) == 0);
+
+		while (ok && index_len > 0) {
+			size_t n = (index_len < batch * record_max)?(size_t)index_len:batch * record_max;
+
+			ok = (container_read(in_fd, in, n) == (ssize_t)n);
+			index_len -= n;
+		}
+
+		ok = (ok && container_read(in_fd, footer, sizeof(footer)) == sizeof(footer) && memcmp(footer + 16, CONTAINER_INDEX_MAGIC, CONTAINER_MAGIC_LENGTH) == 0
+				&& container_get64(footer) == c->chunks && container_get64(footer + 8) == c->plaintext_len);
+	}
+
+	free(in);
+	free(out);
+	free(plain);
+	free(ivs);
+	free(msgs);
+
+	return ok?written:(size_t)-1;
+}
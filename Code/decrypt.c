@@ -1,24 +1,449 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <openssl/rand.h>
 
 #include "akuma.h"
+#include "bulk.h"
+#include "pipeline.h"
+#include "container.h"
+
+#define BUFFER_SIZE 4096	/* WORKING SET PER READ, INDEPENDENT OF THE FILE SIZE */
+#define THREAD_BUFFER_SIZE (1024 * 1024)	/* PER THREAD SHARE OF EACH READ WHEN DECRYPTING IN PARALLEL */
+#define ARMOR_BUFFER_SIZE (64 * 1024)	/* --base64 READS, DECODED AND DECRYPTED AKUMA_AUTH_CHUNK AT A TIME */
+#define ARMOR_TAIL 256			/* LAST CHARACTERS READ FIRST: IV, TAG, LAST CIPHERTEXT BYTES AND THE LINE BREAK */
+
+/* WRITE THE PART OF out THAT FALLS INSIDE THE REQUESTED RANGE [start, stop), pos IS THE PLAINTEXT OFFSET OF out[0] */
+
+static void write_range(FILE * outfile, const unsigned char * out, size_t n, size_t * pos, size_t start, size_t stop) {
+	size_t from = (*pos < start)?(start - *pos):0;
+	size_t to = (*pos + n > stop)?((stop > *pos)?(stop - *pos):0):n;
+
+	if (to > from)
+		fwrite(out + from, to - from, 1, outfile);
+
+	*pos += n;
+}
+
+/* -M: MAP THE CIPHERTEXT AND A PRE-SIZED OUTPUT FILE AND DECRYPT STRAIGHT FROM ONE MAPPING INTO THE OTHER */
+/* A RANGE GOES THROUGH Akuma_DecryptRange() ON THE MAPPING, WHICH ONLY FAULTS IN THE PAGES IT NEEDS */
+
+static int decrypt_mapped(Akuma_CTX * ctx, int in_fd, size_t ciphertext_len, const char * out_filename, size_t start, size_t length, const unsigned char * tag) {
+	unsigned char * in = NULL;
+	unsigned char * out = NULL;
+	bool range = (start != 0 || length != SIZE_MAX);
+
+	if (ciphertext_len > 0)
+		in = mmap(NULL, ciphertext_len, PROT_READ, MAP_PRIVATE, in_fd, 0);
+
+	int out_fd = open(out_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (in == MAP_FAILED || out_fd < 0) {
+		fprintf(stderr, "Failed to %s [%s]\n", (in == MAP_FAILED)?"map the ciphertext":"create the output file", (in == MAP_FAILED)?"mmap()":"open()");
+		perror("Error");
+		return -1;
+	}
+
+	if (!range)
+		madvise(in, ciphertext_len, MADV_SEQUENTIAL);
+
+	size_t out_len = ciphertext_len;	/* UPPER BOUND, TRUNCATED ONCE THE PADDING IS GONE */
+	int final_len = 0;
+	size_t n = 0;
+
+	if (range) {
+		ctx->ciphertext = in;
+		ctx->ciphertext_len = ciphertext_len;
+
+		size_t range_len = Akuma_DecryptRange(ctx, start, length);
+
+		ctx->ciphertext = NULL;
+		ctx->ciphertext_len = 0;
+
+		final_len = (range_len == (size_t)-1)?-1:0;
+		out_len = (final_len < 0)?0:range_len;
+	}
+
+	if (out_len > 0 && (ftruncate(out_fd, (off_t)out_len) != 0 || (out = mmap(NULL, out_len, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0)) == MAP_FAILED)) {
+		fprintf(stderr, "Failed to map \"%s\" [ftruncate()/mmap()]\n", out_filename);
+		perror("Error");
+		close(out_fd);
+		return -1;
+	}
+
+	if (range) {
+		n = out_len;
+
+		if (n > 0)
+			memcpy(out, ctx->plaintext, n);
+
+		Akuma_Free(ctx);
+	} else {
+		n = Akuma_DecryptUpdate(ctx, in, ciphertext_len, out);
+		final_len = (n == (size_t)-1)?-1:Akuma_DecryptFinal(ctx, out + n);
+
+		if (tag != NULL && !Akuma_DecryptVerify(ctx, tag))
+			final_len = -1;
+	}
+
+	if (in != NULL)
+		munmap(in, ciphertext_len);
+
+	if (out != NULL)
+		munmap(out, out_len);
+
+	if (final_len < 0) {
+		fprintf(stderr, "Decryption failed (wrong key or corrupted ciphertext).\nAborting...\n");
+		close(out_fd);
+		remove(out_filename);
+		return -1;
+	}
+
+	if (ftruncate(out_fd, (off_t)(n + final_len)) != 0 || close(out_fd) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* -P: READ, DECRYPT AND WRITE OVERLAPPED, SEE pipeline.h */
+
+static int decrypt_pipelined(Akuma_CTX * ctx, int in_fd, size_t ciphertext_len, const char * out_filename, const unsigned char * tag, size_t chunk) {
+	unsigned char tail[AKUMA_BLOCK_SIZE_BYTES];
+	int out_fd = open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (out_fd < 0) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [open()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	size_t n = pipe_run(ctx, Akuma_DecryptUpdate, in_fd, ciphertext_len, out_fd, chunk);
+	int final_len = (n == (size_t)-1)?-1:Akuma_DecryptFinal(ctx, tail);
+
+	if (final_len >= 0 && tag != NULL && !Akuma_DecryptVerify(ctx, tag))
+		final_len = -1;
+
+	if (final_len < 0 || pwrite(out_fd, tail, (size_t)final_len, (off_t)n) != final_len) {
+		fprintf(stderr, "Decryption failed (wrong key, corrupted ciphertext or I/O error).\nAborting...\n");
+		close(out_fd);
+		remove(out_filename);
+		return -1;
+	}
+
+	if (close(out_fd) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* A CONTAINER (encrypt -C) ONLY READS THE CHUNKS THAT HOLD [start, start + length) */
+/* WITHOUT ITS INDEX (indexed = false, A PIPE) IT IS READ FRONT TO BACK, "-" WRITES TO stdout */
+
+static int decrypt_container(const unsigned char * key, unsigned int threads, struct Container * c, bool indexed, int in_fd, const char * out_filename, size_t start, size_t length) {
+	Akuma_CTX ctx;
+
+	Akuma_Init(&ctx);
+	ctx.threads = threads;
+
+	if (!Akuma_Update(AKUMA_UPDATE_KEY, &ctx, NULL, (unsigned char *)key, NULL, NULL, 0, 0)) {
+		fprintf(stderr, "Akuma_Update() failed to update the encryption key\nAborting...\n");
+		return -1;
+	}
+
+	bool piped = (strcmp(out_filename, "-") == 0);
+	int out_fd = piped?STDOUT_FILENO:open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (out_fd < 0) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [open()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	uint64_t stop = (length > UINT64_MAX - start)?UINT64_MAX:(uint64_t)start + length;
+	size_t n = indexed?container_decrypt(&ctx, c, in_fd, out_fd, start, stop):container_stream(&ctx, c, in_fd, out_fd, start, stop);
+
+	container_close(c);
+
+/* ONLY CHUNKS THAT DECRYPTED (AND PASSED THEIR TAGS) REACH stdout, THE EXIT STATUS TELLS THE REST */
+
+	if (n == (size_t)-1) {
+		fprintf(stderr, "Decryption failed (wrong key, corrupted container or I/O error).\nAborting...\n");
+
+		if (!piped) {
+			close(out_fd);
+			remove(out_filename);
+		}
+
+		return -1;
+	}
+
+	if (!piped && close(out_fd) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* --base64: TEXT FROM encrypt --base64 OR --base64url, ONE UNBROKEN LINE
+ *
+ * THE TEXT LENGTH GIVES THE BINARY LENGTH, SO THE GROUPS HOLDING THE IV AND TAG
+ * (AND THE LAST ONE OR TWO CIPHERTEXT BYTES SHARING A GROUP WITH THEM) ARE DECODED
+ * FIRST AND THE REST IS DECODED AND DECRYPTED IN ONE PASS.
+ */
+
+static int decrypt_armored(Akuma_CTX * ctx, FILE * in, const char * out_filename, unsigned int threads) {
+	char text[ARMOR_TAIL];
+	unsigned char tail[ARMOR_TAIL];
+	struct AkumaBase64 b64;
+
+	fseek(in, 0, SEEK_END);
+
+	long file_len = ftell(in);
+	long text_pos = (file_len > ARMOR_TAIL)?(file_len - ARMOR_TAIL):0;
+	size_t text_len = (size_t)(file_len - text_pos);
+
+	fseek(in, text_pos, SEEK_SET);
+
+	if (fread(text, 1, text_len, in) != text_len)
+		return -1;
+
+	while (text_len > 0 && (text[text_len - 1] == '\n' || text[text_len - 1] == '\r' || text[text_len - 1] == ' ' || text[text_len - 1] == '\t'))
+		--text_len;
+
+/* PADDED OR NOT, T CHARACTERS HOLD T / 4 * 3 BYTES PLUS (T % 4) - 1 FOR A SHORT GROUP */
+
+	size_t total = (size_t)text_pos + text_len;
+	size_t pad = 0;
+
+	while (pad < 2 && pad < text_len && text[text_len - 1 - pad] == '=')
+		++pad;
+
+	size_t binary_len = total / 4 * 3 + ((total % 4 > 1)?(total % 4 - 1):0) - ((total % 4 == 0)?pad:0);
+	size_t trailer = AKUMA_BLOCK_SIZE_BYTES + (ctx->auth?AKUMA_TAG_LENGTH_BYTES:0);
+	size_t ciphertext_len = binary_len - trailer;
+
+	if (total % 4 == 1 || binary_len < trailer || (ctx->mode == AKUMA_MODE_CHAIN && (ciphertext_len < AKUMA_BLOCK_SIZE_BYTES || ciphertext_len % AKUMA_BLOCK_SIZE_BYTES != 0)) ||
+			ciphertext_len / 3 * 4 < (size_t)text_pos) {
+		fprintf(stderr, "Not an Akuma ciphertext in base64, or not on one line\n");
+		return -1;
+	}
+
+	size_t body = ciphertext_len / 3 * 4;	/* CHARACTERS OF THE WHOLE GROUPS BEFORE THE TAIL */
+	size_t split = ciphertext_len % 3;	/* CIPHERTEXT BYTES AT THE START OF THE TAIL */
+
+	Akuma_Base64Init(&b64, 0);
+
+	size_t tail_len = Akuma_Base64Decode(&b64, text + (body - (size_t)text_pos), total - body, tail);
+	int final_len = (tail_len == (size_t)-1)?-1:Akuma_Base64DecodeFinal(&b64, tail + tail_len);
+
+	if (final_len < 0 || tail_len + final_len != split + trailer) {
+		fprintf(stderr, "Not an Akuma ciphertext in base64, or not on one line\n");
+		return -1;
+	}
+
+	ctx->threads = threads;
+
+	if (!Akuma_Update(AKUMA_UPDATE_IV, ctx, tail + split, NULL, NULL, NULL, 0, 0) || !Akuma_DecryptInit(ctx)) {
+		fprintf(stderr, "Akuma_DecryptInit() failed.\nAborting...\n");
+		return -1;
+	}
+
+	FILE * outfile = fopen(out_filename, "wb");
+	size_t buffer_size = (threads > 1)?(threads * THREAD_BUFFER_SIZE):ARMOR_BUFFER_SIZE;
+	char * in_buf = malloc(buffer_size);
+	unsigned char * out_buf = malloc(buffer_size + AKUMA_BLOCK_SIZE_BYTES);
+
+	if (outfile == NULL || in_buf == NULL || out_buf == NULL) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [fopen()/malloc()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	size_t remaining = body;
+	size_t bytes_read = 0;
+	size_t bytes_written = 0;
+
+	rewind(in);
+	Akuma_Base64Init(&b64, 0);
+
+	while (remaining > 0 && (bytes_read = fread(in_buf, 1, (remaining < buffer_size)?remaining:buffer_size, in)) > 0) {
+		bytes_written = Akuma_DecryptUpdateBase64(ctx, &b64, in_buf, bytes_read, out_buf);
+
+		if (bytes_written == (size_t)-1)
+			break;
+
+		fwrite(out_buf, bytes_written, 1, outfile);
+		remaining -= bytes_read;
+	}
+
+	bytes_written = (remaining != 0)?(size_t)-1:Akuma_DecryptUpdate(ctx, tail, split, out_buf);
+
+	if (bytes_written != (size_t)-1)
+		fwrite(out_buf, bytes_written, 1, outfile);
+
+	final_len = (bytes_written == (size_t)-1 || Akuma_Base64DecodeFinal(&b64, tail) != 0)?-1:Akuma_DecryptFinal(ctx, out_buf);
+
+	if (final_len >= 0 && ctx->auth && !Akuma_DecryptVerify(ctx, tail + split + AKUMA_BLOCK_SIZE_BYTES))
+		final_len = -1;
+
+	free(in_buf);
+
+	if (final_len < 0) {
+		fprintf(stderr, "Decryption failed (wrong key, corrupted ciphertext or bad base64).\nAborting...\n");
+		fclose(outfile);
+		remove(out_filename);
+		free(out_buf);
+		return -1;
+	}
+
+	fwrite(out_buf, (size_t)final_len, 1, outfile);
+	free(out_buf);
+
+	if (fclose(outfile) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* "-" SENDS THE DATA ITSELF TO stdout, SO THE MESSAGE GOES TO stderr */
+
+static void report_success(const char * out_filename) {
+	if (strcmp(out_filename, "-") == 0)
+		fprintf(stderr, "Success!\nDecrypted data written to stdout\n");
+	else
+		printf("Success!\nDecrypted data now stored in \"%s\"\n", out_filename);
+}
+
+/* --stats: THE LIBRARY'S GLOBAL COUNTERS AS JSON ON stderr, HOWEVER THE RUN ENDS */
+
+static void dump_stats(void) {
+	struct AkumaStats stats;
+
+	Akuma_Stats(NULL, &stats);
+	Akuma_StatsJSON(stderr, &stats);
+}
 
 int main(int argc, char ** argv) {
-	if (argc < 4) {
-		fprintf(stderr, "\nUsage: [CIPHERTEXT FILE] [KEY FILE] [OUT FILE]\n\n");
+	unsigned int threads = 1;
+	int mode = AKUMA_MODE_CHAIN;
+	size_t start = 0;
+	size_t stop = SIZE_MAX;
+	int use_mmap = 0;
+	int pipelined = 0;
+	int auth = 0;
+	int armor = 0;
+	int opt;
+
+	struct BulkOptions bulk = { false, 0, 1, false, NULL, NULL, NULL, NULL, 0 };
+
+	static const struct option long_options[] = {
+		{ "offset", required_argument, NULL, 'O' },
+		{ "length", required_argument, NULL, 'l' },
+		{ "stats", no_argument, NULL, 'S' },
+		{ "base64", no_argument, NULL, 'B' },
+		{ "base64url", no_argument, NULL, 'B' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "aMPm:t:k:o:rL:", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':	/* THE FILE ENDS WITH AN HMAC-SHA256 TAG (encrypt -a) */
+			auth = AKUMA_AUTH;
+			break;
+		case 'M':	/* MEMORY MAP THE FILES INSTEAD OF STREAMING THEM */
+			use_mmap = 1;
+			break;
+		case 'P':	/* OVERLAP READS, THE CIPHER AND WRITES (NOT FOR A RANGE) */
+			pipelined = 1;
+			break;
+		case 'm':	/* MUST MATCH THE MODE USED TO ENCRYPT */
+			mode = (strcmp(optarg, "ctr") == 0)?AKUMA_MODE_CTR:(strcmp(optarg, "chain") == 0)?AKUMA_MODE_CHAIN:-1;
+			break;
+		case 't':	/* 0 = ONE THREAD PER ONLINE CPU */
+			threads = Akuma_Threads((unsigned int)strtoul(optarg, NULL, 10));
+			break;
+		case 'O':	/* ONLY DECRYPT THE PLAINTEXT FROM THIS BYTE ON */
+			start = (size_t)strtoull(optarg, NULL, 10);
+			break;
+		case 'l':	/* AND ONLY THIS MANY BYTES OF IT */
+			stop = (size_t)strtoull(optarg, NULL, 10);
+			break;
+		case 'k':	/* BULK MODE: EVERY ARGUMENT IS AN INPUT, SEE bulk.h */
+			bulk.key_filename = optarg;
+			break;
+		case 'o':
+			bulk.out_dir = optarg;
+			break;
+		case 'r':
+			bulk.recursive = true;
+			break;
+		case 'L':
+			bulk.list_filename = optarg;
+			break;
+		case 'S':	/* TIME EVERY CALL AND PRINT THE COUNTERS AT EXIT */
+			Akuma_StatsTiming(1);
+			atexit(dump_stats);
+			break;
+		case 'B':	/* THE CIPHERTEXT IS BASE64 OR BASE64URL TEXT (encrypt --base64, --base64url) */
+			armor = 1;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+
+	/* THE TAG COVERS THE WHOLE FILE, A RANGE COULD NOT BE CHECKED */
+
+	bool range = (start != 0 || stop != SIZE_MAX);
+
+	if (armor && (range || use_mmap || pipelined || bulk.key_filename != NULL))
+		argc = 0;	/* TEXT INPUT IS STREAMED ONLY */
+
+	/* "-" READS stdin OR WRITES stdout, NEITHER CAN BE MAPPED OR pwrite()N */
+
+	if (bulk.key_filename == NULL && argc - optind >= 3 && (strcmp(argv[optind], "-") == 0 || strcmp(argv[optind + 2], "-") == 0) && (use_mmap || pipelined || armor))
+		argc = 0;
+
+	if (bulk.key_filename != NULL && argc > 0 && mode >= 0 && !range && (optind < argc || bulk.list_filename != NULL)) {
+		bulk.mode = mode | auth;
+		bulk.workers = threads;
+		bulk.inputs = argv + optind;
+		bulk.n_inputs = argc - optind;
+
+		return bulk_main(&bulk);
+	}
+
+	if (argc - optind < 3 || mode < 0 || (auth && range) || bulk.key_filename != NULL) {
+		fprintf(stderr, "\nUsage: [--stats] [-a] [-M | -P | --base64] [-m chain|ctr] [-t THREADS] [--offset BYTES] [--length BYTES] [CIPHERTEXT FILE | -] [KEY FILE] [OUT FILE | -]\n"
+				"       [--stats] [-a] [-m chain|ctr] [-t WORKERS] [-r] [-o OUT DIR] [-L LIST FILE] -k KEY FILE [INPUT ...]\n\n");
 		return -1;
 	}
 
-	char * ciphertext_filename = argv[1];
-	char * key_filename = argv[2];
-	char * out_filename = argv[3];
+	char * ciphertext_filename = argv[optind];
+	char * key_filename = argv[optind + 1];
+	char * out_filename = argv[optind + 2];
 
-	FILE * ciphertext_file = fopen(ciphertext_filename, "rb");
+	FILE * ciphertext_file = (strcmp(ciphertext_filename, "-") == 0)?stdin:fopen(ciphertext_filename, "rb");
 	FILE * key_file = fopen(key_filename, "rb");
 
 	if (ciphertext_file == NULL || key_file == NULL) {
-		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", (ciphertext_file == NULL)?argv[1]:argv[2]);
+		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", (ciphertext_file == NULL)?ciphertext_filename:key_filename);
 		perror("Error");
 		return -1;
 	}
@@ -31,7 +456,6 @@ int main(int argc, char ** argv) {
 	ciphertext_len = ftell(ciphertext_file);	/* STORE LENGTH OF CIPHERTEXT FILE - LENGTH OF IV AT END */
 	key_len = ftell(key_file);			/* STORE LENGTH OF ENCRYPTION KEY - 2 FOR LINE ENDING */
 
-	rewind(ciphertext_file);	/* RESET POSITION OF FILES TO THE START */
 	rewind(key_file);
 
 	if (key_len != AKUMA_BLOCK_SIZE_BYTES) { 	/* CHECK LENGTH OF KEY */
@@ -39,70 +463,223 @@ int main(int argc, char ** argv) {
 		return -1;
 	}
 
-	ciphertext_len = ciphertext_len - AKUMA_BLOCK_SIZE_BYTES;
+	unsigned char key[AKUMA_BLOCK_SIZE_BYTES];
+	unsigned char iv[AKUMA_BLOCK_SIZE_BYTES];	/* INITIALIZATION VECTOR MUST BE SAME SIZE AS BLOCK SIZE (256 BITS) */
+	unsigned char tag[AKUMA_TAG_LENGTH_BYTES];
 
-	char ciphertext[ciphertext_len];
-	char key[AKUMA_BLOCK_SIZE_BYTES];
-	char iv[AKUMA_BLOCK_SIZE_BYTES];	/* INITIALIZATION VECTOR MUST BE SAME SIZE AS BLOCK SIZE (256 BITS) */
-
-	fread(ciphertext, 1, ciphertext_len, ciphertext_file); /* READ CIPHERTEXT EXCEPT IV */
 	fread(key, 1, sizeof(key), key_file);
+	fclose(key_file);
 
-	rewind(ciphertext_file);
-	fseek(ciphertext_file, ciphertext_len, SEEK_SET);
+	/* A CONTAINER CARRIES ITS OWN MODE AND TAGS, -m AND -a ONLY DESCRIBE A RAW CIPHERTEXT */
 
-	fread(iv, 1, sizeof(iv), ciphertext_file);
+	struct Container container;
+	struct stat st;
+	int is_container = container_open(&container, fileno(ciphertext_file));
+	bool indexed = true;
 
-	ciphertext[ciphertext_len]  = '\0'; /* ZERO OUT THE fread() TO THE END OF THE CIPHERTEXT */
+	/* A PIPE CAN ONLY BE A CONTAINER, READ AS IT COMES */
+
+	if (is_container == 0 && fstat(fileno(ciphertext_file), &st) == 0 && !S_ISREG(st.st_mode)) {
+		unsigned char header[CONTAINER_HEADER_SIZE];
+
+		if (container_read(fileno(ciphertext_file), header, sizeof(header)) != sizeof(header) || container_parse(&container, header) != 1) {
+			fprintf(stderr, "Ciphertext \"%s\" is not a container (encrypt -C, or encrypt to \"-\"), which a pipe must be\n", ciphertext_filename);
+			return -1;
+		}
+
+		is_container = 1;
+		indexed = false;
+	}
+
+	if (is_container != 0) {
+		if (is_container < 0 || decrypt_container(key, threads, &container, indexed, fileno(ciphertext_file), out_filename, start, stop) != 0) {
+			if (is_container < 0)
+				fprintf(stderr, "Container \"%s\" is damaged, of an unknown version or compressed by a method this build lacks\n", ciphertext_filename);
+
+			return -1;
+		}
+
+		fclose(ciphertext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
 
 	Akuma_CTX ctx;
 	Akuma_Init(&ctx);
+	Akuma_SetMode(&ctx, mode | auth);
 
 	/* int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char * key, unsigned char * plaintext, unsigned char * ciphertext, size_t plaintext_len, size_t ciphertext_len); */
 
-	if (!Akuma_Update(AKUMA_UPDATE_CIPHERTEXT, &ctx, NULL, NULL, NULL, ciphertext, 0, ciphertext_len)) {
-		fprintf(stderr, "Akuma_Update() failed to update the ciphertext\nAborting...\n");
+	if (!Akuma_Update(AKUMA_UPDATE_KEY, &ctx, NULL, key, NULL, NULL, 0, 0)) {
+		fprintf(stderr, "Akuma_Update() failed to update the encryption key\nAborting...\n");
 		return -1;
 	}
 
-	if (!Akuma_Update(AKUMA_UPDATE_KEY, &ctx, NULL, key, NULL, NULL, 0, 0)) {
-		fprintf(stderr, "Akuma_Update() failed to update the encryption key\nAborting...\n");
+	if (armor) {
+		if (decrypt_armored(&ctx, ciphertext_file, out_filename, threads) != 0)
+			return -1;
+
+		fclose(ciphertext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
+
+	size_t tag_len = auth?AKUMA_TAG_LENGTH_BYTES:0;
+
+	ciphertext_len = ciphertext_len - AKUMA_BLOCK_SIZE_BYTES - (long)tag_len;
+
+	if (ciphertext_len < 0 || (mode == AKUMA_MODE_CHAIN && (ciphertext_len < AKUMA_BLOCK_SIZE_BYTES || ciphertext_len % AKUMA_BLOCK_SIZE_BYTES != 0))) {
+		fprintf(stderr, "Ciphertext file \"%s\" is truncated or not an Akuma ciphertext\n", ciphertext_filename);
 		return -1;
 	}
 
+	fseek(ciphertext_file, ciphertext_len, SEEK_SET);	/* IV IS STORED IN THE LAST 32 BYTES, OR BEFORE THE -a TAG */
+	fread(iv, 1, sizeof(iv), ciphertext_file);
+	fread(tag, 1, tag_len, ciphertext_file);
+	rewind(ciphertext_file);
+
 	if (!Akuma_Update(AKUMA_UPDATE_IV, &ctx, iv, NULL, NULL, NULL, 0, 0)) {
 		fprintf(stderr, "Akuma_Update() failed to update the IV\nAborting...\n");
 		return -1;
 	}
 
-	size_t bytes_written = 0;
+	ctx.threads = threads;
 
-	/* Akuma_Decrypt RETURNS THE AMOUNT OF COPIED BYTES ON SUCCESS AND 0 ON FAILURE */
+	if (!Akuma_DecryptInit(&ctx)) {
+		fprintf(stderr, "Akuma_DecryptInit() failed.\nAborting...\n");
+		return -1;
+	}
 
-	bytes_written = Akuma_Decrypt(&ctx);
+	if (use_mmap) {
+		if (decrypt_mapped(&ctx, fileno(ciphertext_file), (size_t)ciphertext_len, out_filename, start, stop, auth?tag:NULL) != 0)
+			return -1;
 
-	if (bytes_written < 1) {
-		fprintf(stderr, "Akuma_Decrypt() failed.\nAborting...\n");
-		return -1;
+		fclose(ciphertext_file);
+		report_success(out_filename);
+
+		return 0;
 	}
 
-	/* PLAINTEXT IS NOW STORED IN ctx.plaintext */
-	/* LENGTH OF PLAINTEXT IS STORED IN ctx.plaintext_len */
+	if (pipelined && !range) {
+		size_t chunk = (threads > 1)?(threads * THREAD_BUFFER_SIZE):PIPE_CHUNK;
 
-	FILE * outfile = fopen(out_filename, "wb");
+		if (decrypt_pipelined(&ctx, fileno(ciphertext_file), (size_t)ciphertext_len, out_filename, auth?tag:NULL, chunk) != 0)
+			return -1;
+
+		fclose(ciphertext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
+
+	/* A RANGE ONLY NEEDS ITS OWN BLOCKS, THE CIPHERTEXT BLOCK BEFORE THEM TO RESTORE THE KEYROUND */
+	/* AND IN CHAINED MODE ONE BLOCK AFTER THEM, WHICH Akuma_DecryptUpdate() HOLDS BACK UNREAD */
+
+	/* A CHAINED RANGE PAST THE END STILL READS THE LAST BLOCK SO ITS PADDING IS CHECKED */
+
+	if (start > (size_t)ciphertext_len)
+		start = (size_t)ciphertext_len;
+
+	stop = (stop > (size_t)ciphertext_len - start)?SIZE_MAX:(start + stop);
+
+	size_t first = ((start < (size_t)ciphertext_len || mode == AKUMA_MODE_CTR)?start:(start - 1)) / AKUMA_BLOCK_SIZE_BYTES;
+	size_t end = (size_t)ciphertext_len;
+
+	if (stop != SIZE_MAX) {
+		end = (stop + AKUMA_BLOCK_SIZE_BYTES - 1) / AKUMA_BLOCK_SIZE_BYTES * AKUMA_BLOCK_SIZE_BYTES + ((mode == AKUMA_MODE_CHAIN)?AKUMA_BLOCK_SIZE_BYTES:0);
+
+		if (end > (size_t)ciphertext_len)
+			end = (size_t)ciphertext_len;
+	}
+
+	if (first > 0) {
+		unsigned char prev[AKUMA_BLOCK_SIZE_BYTES];
+
+		fseek(ciphertext_file, (long)(AKUMA_BLOCK_SIZE_BYTES * (first - 1)), SEEK_SET);
+
+		if (fread(prev, 1, sizeof(prev), ciphertext_file) != sizeof(prev) || !Akuma_DecryptSeek(&ctx, first, prev)) {
+			fprintf(stderr, "Akuma_DecryptSeek() failed.\nAborting...\n");
+			return -1;
+		}
+	}
+
+	FILE * outfile = (strcmp(out_filename, "-") == 0)?stdout:fopen(out_filename, "wb");
 
 	if (outfile == NULL) {
-		fprintf(stderr, "Failed to open file file for writing \"%s\" [fopen()]\n", (outfile == NULL)?argv[1]:argv[2]);
+		fprintf(stderr, "Failed to open file for writing \"%s\" [fopen()]\n", out_filename);
 		perror("Error");
 		return -1;
 	}
 
-	/* WRITE PLAINTEXT TO NEW FILE */
+	/* STREAM THE CIPHERTEXT (EXCEPT IV) THROUGH THE CIPHER IN FIXED SIZE CHUNKS */
+
+	size_t buffer_size = (threads > 1)?(threads * THREAD_BUFFER_SIZE):BUFFER_SIZE;
+
+	unsigned char * in_buf = malloc(buffer_size);
+	unsigned char * out_buf = malloc(buffer_size + AKUMA_BLOCK_SIZE_BYTES);
+
+	if (in_buf == NULL || out_buf == NULL) {
+		fprintf(stderr, "Failed to allocate %zu byte buffers [malloc()]\n", buffer_size);
+		return -1;
+	}
+
+	size_t remaining = end - (AKUMA_BLOCK_SIZE_BYTES * first);
+	size_t bytes_read = 0;
+	size_t bytes_written = 0;
+	size_t pos = AKUMA_BLOCK_SIZE_BYTES * first;
+
+	while (remaining > 0) {
+		bytes_read = fread(in_buf, 1, (remaining < buffer_size)?remaining:buffer_size, ciphertext_file);
+
+		if (bytes_read == 0)
+			break;
+
+		bytes_written = Akuma_DecryptUpdate(&ctx, in_buf, bytes_read, out_buf);
+
+		if (bytes_written == (size_t)-1)
+			break;	/* remaining STAYS ABOVE 0, SO IT FAILS BELOW */
+
+		write_range(outfile, out_buf, bytes_written, &pos, start, stop);
+		remaining -= bytes_read;
+	}
+
+	/* Akuma_DecryptFinal() REMOVES THE PKCS#7 PADDING AND RETURNS -1 ON A BAD CIPHERTEXT */
+	/* A RANGE THAT STOPS SHORT OF THE LAST BLOCK HAS NO PADDING TO REMOVE */
 
-	fwrite(ctx.plaintext, ctx.plaintext_len, 1, outfile);
+	int final_len = (remaining != 0)?-1:(end == (size_t)ciphertext_len)?Akuma_DecryptFinal(&ctx, out_buf):0;
+
+	/* -a: THE PLAINTEXT ALREADY WRITTEN IS REMOVED IF THE TAG DOES NOT MATCH */
+
+	if (auth && final_len >= 0 && !Akuma_DecryptVerify(&ctx, tag))
+		final_len = -1;
+
+	/* ON stdout THE PLAINTEXT CANNOT BE TAKEN BACK, ONLY THE EXIT STATUS SAYS IT IS BAD */
+
+	if (final_len < 0) {
+		fprintf(stderr, "Akuma_DecryptFinal() failed (wrong key or corrupted ciphertext).\nAborting...\n");
+		fclose(outfile);
+
+		if (outfile != stdout)
+			remove(out_filename);
+
+		return -1;
+	}
+
+	write_range(outfile, out_buf, final_len, &pos, start, stop);
+
+	fclose(ciphertext_file);
+	free(in_buf);
+	free(out_buf);
+
+	if (fclose(outfile) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
 
-	printf("Success!\nDecrypted data now stored in \"%s\"\n", out_filename);
-	printf("Data: %s\n", ctx.plaintext);
+	report_success(out_filename);
 
 	return 0;
 }
@@ -1,37 +1,480 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <openssl/rand.h>
 
 #include "akuma.h"
+#include "bulk.h"
+#include "pipeline.h"
+#include "container.h"
+
+#define BUFFER_SIZE 4096	/* WORKING SET PER READ, INDEPENDENT OF THE FILE SIZE */
+#define THREAD_BUFFER_SIZE (1024 * 1024)	/* PER THREAD SHARE OF EACH READ WHEN ENCRYPTING IN PARALLEL */
+#define ARMOR_BUFFER_SIZE (64 * 1024)	/* --base64 READS, ENCRYPTED AND ENCODED AKUMA_AUTH_CHUNK AT A TIME */
+
+/* -M: MAP THE PLAINTEXT AND A PRE-SIZED OUTPUT FILE AND ENCRYPT STRAIGHT FROM ONE MAPPING INTO THE OTHER */
+
+static int encrypt_mapped(Akuma_CTX * ctx, int in_fd, const char * out_filename, const unsigned char * iv) {
+	struct stat st;
+
+	if (fstat(in_fd, &st) != 0) {
+		perror("Error");
+		return -1;
+	}
+
+	size_t plaintext_len = (size_t)st.st_size;
+	size_t out_len = Akuma_EncryptedSize(ctx, plaintext_len) + AKUMA_BLOCK_SIZE_BYTES;	/* IV (AND -a TAG) AT THE END */
+
+	int out_fd = open(out_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (out_fd < 0 || ftruncate(out_fd, (off_t)out_len) != 0) {
+		fprintf(stderr, "Failed to create \"%s\" [open()/ftruncate()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	unsigned char * in = NULL;
+	unsigned char * out = mmap(NULL, out_len, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+
+	if (plaintext_len > 0)
+		in = mmap(NULL, plaintext_len, PROT_READ, MAP_PRIVATE, in_fd, 0);
+
+	if (out == MAP_FAILED || in == MAP_FAILED) {
+		fprintf(stderr, "Failed to map \"%s\" [mmap()]\n", (out == MAP_FAILED)?out_filename:"plaintext");
+		perror("Error");
+		close(out_fd);
+		return -1;
+	}
+
+	if (in != NULL)
+		madvise(in, plaintext_len, MADV_SEQUENTIAL);
+
+	size_t n = Akuma_EncryptUpdate(ctx, in, plaintext_len, out);
+	int final_len = (n == (size_t)-1)?-1:Akuma_EncryptFinal(ctx, out + n);
+
+	if (final_len >= 0) {
+		n += (size_t)final_len;
+		memcpy(out + n, iv, AKUMA_BLOCK_SIZE_BYTES);
+		Akuma_EncryptTag(ctx, out + n + AKUMA_BLOCK_SIZE_BYTES);
+	}
+
+	if (in != NULL)
+		munmap(in, plaintext_len);
+
+	munmap(out, out_len);
+
+	if (close(out_fd) != 0 || final_len < 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* -P: READ, ENCRYPT AND WRITE OVERLAPPED, SEE pipeline.h */
+
+static int encrypt_pipelined(Akuma_CTX * ctx, int in_fd, const char * out_filename, const unsigned char * iv, size_t chunk) {
+	struct stat st;
+	unsigned char tail[2 * AKUMA_BLOCK_SIZE_BYTES + AKUMA_TAG_LENGTH_BYTES];
+
+	if (fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "-P needs a regular input file\n");
+		return -1;
+	}
+
+	int out_fd = open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (out_fd < 0) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [open()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	size_t n = pipe_run(ctx, Akuma_EncryptUpdate, in_fd, (size_t)st.st_size, out_fd, chunk);
+	int final_len = (n == (size_t)-1)?-1:Akuma_EncryptFinal(ctx, tail);
+
+	if (final_len < 0) {
+		fprintf(stderr, "Failed to encrypt \"%s\" [pipe_run()]\n", out_filename);
+		close(out_fd);
+		remove(out_filename);
+		return -1;
+	}
+
+/* PADDING (OR THE COUNTER MODE TAIL), THEN THE IV AND THE -a TAG */
+
+	size_t tail_len = (size_t)final_len;
+
+	memcpy(tail + tail_len, iv, AKUMA_BLOCK_SIZE_BYTES);
+	tail_len += AKUMA_BLOCK_SIZE_BYTES;
+
+	if (Akuma_EncryptTag(ctx, tail + tail_len))
+		tail_len += AKUMA_TAG_LENGTH_BYTES;
+
+	if (pwrite(out_fd, tail, tail_len, (off_t)n) != (ssize_t)tail_len || close(out_fd) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* -C: WRITE A CHUNKED CONTAINER INSTEAD OF CIPHERTEXT || IV, SEE container.h */
+
+/* "-" WRITES IT TO stdout, WHICH IS LEFT OPEN */
+
+static int encrypt_container(Akuma_CTX * ctx, int in_fd, const char * out_filename, const unsigned char * iv, int compression) {
+	bool piped = (strcmp(out_filename, "-") == 0);
+	int out_fd = piped?STDOUT_FILENO:open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (out_fd < 0) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [open()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	if (container_encrypt(ctx, in_fd, out_fd, iv, compression) != 0 || (!piped && close(out_fd) != 0)) {
+		fprintf(stderr, "Failed to encrypt \"%s\" [container_encrypt()]\n", out_filename);
+		perror("Error");
+
+		if (!piped)
+			remove(out_filename);
+
+		return -1;
+	}
+
+	return 0;
+}
+
+/* --base64, --base64url: THE SAME CIPHERTEXT || IV (|| TAG) AS ONE LINE OF TEXT, ENCODED IN THE CIPHER'S PASS */
+
+static int encrypt_armored(Akuma_CTX * ctx, FILE * in, const char * out_filename, const unsigned char * iv, size_t buffer_size, int url) {
+	unsigned char tail[2 * AKUMA_BLOCK_SIZE_BYTES + AKUMA_TAG_LENGTH_BYTES];
+	struct AkumaBase64 b64;
+	int ok = 1;
+
+	if (buffer_size < ARMOR_BUFFER_SIZE)
+		buffer_size = ARMOR_BUFFER_SIZE;
+
+	FILE * outfile = fopen(out_filename, "wb");
+	unsigned char * in_buf = malloc(buffer_size);
+	char * out_buf = malloc(AKUMA_BASE64_LENGTH(buffer_size + AKUMA_BLOCK_SIZE_BYTES + 2) + 1);
+
+	if (outfile == NULL || in_buf == NULL || out_buf == NULL) {
+		fprintf(stderr, "Failed to open file for writing \"%s\" [fopen()/malloc()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	Akuma_Base64Init(&b64, url);
+
+	size_t bytes_read = 0;
+	size_t text_len = 0;
+
+	while (ok && (bytes_read = fread(in_buf, 1, buffer_size, in)) > 0) {
+		text_len = Akuma_EncryptUpdateBase64(ctx, &b64, in_buf, bytes_read, out_buf);
+		ok = (text_len != (size_t)-1 && fwrite(out_buf, 1, text_len, outfile) == text_len);
+	}
+
+	ok = ok && !ferror(in);
+
+/* PADDING (OR THE COUNTER MODE TAIL), THE IV AND THE -a TAG GO THROUGH THE SAME ENCODER */
+
+	int final_len = ok?Akuma_EncryptFinal(ctx, tail):-1;
+	size_t tail_len = (final_len < 0)?0:(size_t)final_len;
+
+	ok = ok && final_len >= 0;
+
+	memcpy(tail + tail_len, iv, AKUMA_BLOCK_SIZE_BYTES);
+	tail_len += AKUMA_BLOCK_SIZE_BYTES;
+
+	if (Akuma_EncryptTag(ctx, tail + tail_len))
+		tail_len += AKUMA_TAG_LENGTH_BYTES;
+
+	text_len = Akuma_Base64Encode(&b64, tail, tail_len, out_buf);
+	text_len += Akuma_Base64EncodeFinal(&b64, out_buf + text_len);
+	out_buf[text_len++] = '\n';
+
+	ok = ok && (fwrite(out_buf, 1, text_len, outfile) == text_len);
+	ok = (fclose(outfile) == 0) && ok;
+
+	free(in_buf);
+	free(out_buf);
+
+	if (!ok) {
+		fprintf(stderr, "Failed to encrypt \"%s\"\n", out_filename);
+		perror("Error");
+		remove(out_filename);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* --append: CONTINUE THE CIPHERTEXT || IV (|| TAG) ALREADY IN out_filename UNDER ITS OWN IV
+ * ONLY ITS LAST TWO BLOCKS ARE READ (ALL OF IT IS HASHED WITH -a), THE FILE IS REWRITTEN FROM
+ * THE LAST BLOCK ON. THE KEY AND -m MUST BE THOSE IT WAS ENCRYPTED WITH, AND main() ONLY
+ * ALLOWS IT WITH -a, WHOSE TAG IS WHAT REFUSES A WRONG KEY */
+
+static int encrypt_append(Akuma_CTX * ctx, FILE * in, const char * out_filename, size_t buffer_size) {
+	size_t tag_len = ctx->auth?AKUMA_TAG_LENGTH_BYTES:0;
+	int out_fd = open(out_filename, O_RDWR);
+	struct Container c;
+	struct stat st;
+
+	if (out_fd < 0 || fstat(out_fd, &st) != 0) {
+		fprintf(stderr, "Failed to open file for appending \"%s\" [open()]\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	if (container_open(&c, out_fd) != 0) {
+		fprintf(stderr, "\"%s\" is a container (-C), only plain ciphertexts can be appended to\n", out_filename);
+		container_close(&c);
+		close(out_fd);
+		return -1;
+	}
+
+	if ((size_t)st.st_size < AKUMA_IV_LENGTH_BYTES + tag_len) {
+		fprintf(stderr, "\"%s\" is truncated or not an Akuma ciphertext\n", out_filename);
+		close(out_fd);
+		return -1;
+	}
+
+	size_t ciphertext_len = (size_t)st.st_size - AKUMA_IV_LENGTH_BYTES - tag_len;
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];
+	unsigned char tag[AKUMA_TAG_LENGTH_BYTES];
+	unsigned char * map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, out_fd, 0);
+
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Failed to map \"%s\" [mmap()]\n", out_filename);
+		perror("Error");
+		close(out_fd);
+		return -1;
+	}
+
+	memcpy(iv, map + ciphertext_len, sizeof(iv));
+	memcpy(tag, map + ciphertext_len + sizeof(iv), tag_len);
+
+	size_t keep = (size_t)-1;
+
+	if (Akuma_Update(AKUMA_UPDATE_IV, ctx, iv, NULL, NULL, NULL, 0, 0))
+		keep = Akuma_EncryptAppend(ctx, map, ciphertext_len, tag);
+
+	munmap(map, (size_t)st.st_size);
+
+	if (keep == (size_t)-1) {
+		fprintf(stderr, "Cannot append to \"%s\" (wrong key or -m, not written with -a, or corrupted ciphertext).\nAborting...\n", out_filename);
+		close(out_fd);
+		return -1;
+	}
+
+	/* EVERYTHING FROM keep ON IS WRITTEN AGAIN: THE OLD LAST BLOCK AND THE NEW DATA, THE IV, THE NEW TAG */
+
+	unsigned char * in_buf = malloc(buffer_size);
+	unsigned char * out_buf = malloc(buffer_size + AKUMA_BLOCK_SIZE_BYTES + AKUMA_IV_LENGTH_BYTES + AKUMA_TAG_LENGTH_BYTES);
+	bool ok = (in_buf != NULL && out_buf != NULL && lseek(out_fd, (off_t)keep, SEEK_SET) == (off_t)keep);
+	size_t bytes_read;
+	size_t n;
+
+	while (ok && (bytes_read = fread(in_buf, 1, buffer_size, in)) > 0) {
+		n = Akuma_EncryptUpdate(ctx, in_buf, bytes_read, out_buf);
+		ok = (n != (size_t)-1 && container_write(out_fd, out_buf, n));
+		keep += n;
+	}
+
+	int final_len = (ok && !ferror(in))?Akuma_EncryptFinal(ctx, out_buf):-1;
+
+	if (final_len >= 0) {
+		n = (size_t)final_len;
+		memcpy(out_buf + n, iv, sizeof(iv));
+		n += sizeof(iv);
+
+		if (Akuma_EncryptTag(ctx, out_buf + n))
+			n += AKUMA_TAG_LENGTH_BYTES;
+
+		ok = container_write(out_fd, out_buf, n) && ftruncate(out_fd, (off_t)(keep + n)) == 0;
+	} else {
+		ok = false;
+	}
+
+	free(in_buf);
+	free(out_buf);
+
+	if (close(out_fd) != 0 || !ok) {
+		fprintf(stderr, "Failed to append to \"%s\", its end is now damaged\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* "-" SENDS THE DATA ITSELF TO stdout, SO THE MESSAGE GOES TO stderr */
+
+static void report_success(const char * out_filename) {
+	if (strcmp(out_filename, "-") == 0)
+		fprintf(stderr, "Success!\nEncrypted data written to stdout\n");
+	else
+		printf("Success!\nEncrypted data now stored in \"%s\"\n", out_filename);
+}
+
+/* --stats: THE LIBRARY'S GLOBAL COUNTERS AS JSON ON stderr, HOWEVER THE RUN ENDS */
+
+static void dump_stats(void) {
+	struct AkumaStats stats;
+
+	Akuma_Stats(NULL, &stats);
+	Akuma_StatsJSON(stderr, &stats);
+}
 
 int main(int argc, char ** argv) {
-	if (argc < 4) {
-		fprintf(stderr, "\nUsage: [PLAINTEXT FILE] [KEY FILE] [OUTPUT FILE]\n\n");
+	unsigned int threads = 1;
+	int mode = AKUMA_MODE_CHAIN;
+	int use_mmap = 0;
+	int pipelined = 0;
+	int container = 0;
+	int auth = 0;
+	int armor = -1;	/* 0 = --base64, 1 = --base64url */
+	int append = 0;
+	int compression = CONTAINER_COMPRESS_NONE;
+	int opt;
+
+	struct BulkOptions bulk = { true, 0, 1, false, NULL, NULL, NULL, NULL, 0 };
+
+	static const struct option long_options[] = {
+		{ "stats", no_argument, NULL, 'S' },
+		{ "base64", no_argument, NULL, 'B' },
+		{ "base64url", no_argument, NULL, 'U' },
+		{ "append", no_argument, NULL, 'A' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "aCMPm:t:k:o:rL:z:", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':	/* APPEND AN HMAC-SHA256 TAG AFTER THE IV */
+			auth = AKUMA_AUTH;
+			break;
+		case 'C':	/* CHUNKED CONTAINER, CHUNKS ARE ENCRYPTED -t AT A TIME */
+			container = 1;
+			break;
+		case 'M':	/* MEMORY MAP THE FILES INSTEAD OF STREAMING THEM */
+			use_mmap = 1;
+			break;
+		case 'P':	/* OVERLAP READS, THE CIPHER AND WRITES */
+			pipelined = 1;
+			break;
+		case 'm':	/* chain (DEFAULT) OR ctr */
+			mode = (strcmp(optarg, "ctr") == 0)?AKUMA_MODE_CTR:(strcmp(optarg, "chain") == 0)?AKUMA_MODE_CHAIN:-1;
+			break;
+		case 't':	/* ONLY COUNTER MODE ENCRYPTS IN PARALLEL, 0 = ONE THREAD PER ONLINE CPU */
+			threads = Akuma_Threads((unsigned int)strtoul(optarg, NULL, 10));
+			break;
+		case 'k':	/* BULK MODE: EVERY ARGUMENT IS AN INPUT, SEE bulk.h */
+			bulk.key_filename = optarg;
+			break;
+		case 'o':
+			bulk.out_dir = optarg;
+			break;
+		case 'r':
+			bulk.recursive = true;
+			break;
+		case 'L':
+			bulk.list_filename = optarg;
+			break;
+		case 'S':	/* TIME EVERY CALL AND PRINT THE COUNTERS AT EXIT */
+			Akuma_StatsTiming(1);
+			atexit(dump_stats);
+			break;
+		case 'B':	/* WRITE THE OUTPUT AS BASE64 TEXT */
+			armor = 0;
+			break;
+		case 'U':	/* OR AS UNPADDED BASE64URL */
+			armor = 1;
+			break;
+		case 'A':	/* ADD TO THE END OF AN EXISTING CIPHERTEXT FILE */
+			append = 1;
+			break;
+		case 'z':	/* COMPRESS EVERY CHUNK OF A CONTAINER: zlib OR zstd (-DAKUMA_HAVE_ZSTD) */
+			compression = (strcmp(optarg, "zlib") == 0)?CONTAINER_COMPRESS_ZLIB:(strcmp(optarg, "zstd") == 0)?CONTAINER_COMPRESS_ZSTD:-1;
+			compression = container_codec(compression)?compression:-1;
+			break;
+		default:
+			argc = 0;
+		}
+	}
+
+	if (armor >= 0 && (container || use_mmap || pipelined || bulk.key_filename != NULL))
+		argc = 0;	/* TEXT OUTPUT IS STREAMED ONLY */
+
+	/* "-" READS stdin OR WRITES stdout, ALWAYS AS A CONTAINER: ITS IV COMES FIRST, SO THE */
+	/* OTHER END OF THE PIPE CAN DECRYPT AS THE DATA ARRIVES */
+
+	/* ONLY A CONTAINER RECORDS ITS COMPRESSION, SO -z IMPLIES -C */
+
+	if (compression != CONTAINER_COMPRESS_NONE) {
+		if (compression < 0 || use_mmap || pipelined || armor >= 0 || append || bulk.key_filename != NULL)
+			argc = 0;
+
+		container = 1;
+	}
+
+	if (append && (container || use_mmap || pipelined || armor >= 0 || bulk.key_filename != NULL || (argc - optind >= 3 && strcmp(argv[optind + 2], "-") == 0)))
+		argc = 0;	/* ONLY A PLAIN CIPHERTEXT FILE CAN BE CONTINUED, stdin IS FINE */
+
+	if (bulk.key_filename == NULL && !append && argc - optind >= 3 && (strcmp(argv[optind], "-") == 0 || strcmp(argv[optind + 2], "-") == 0)) {
+		if (use_mmap || pipelined || armor >= 0)
+			argc = 0;
+
+		container = 1;
+	}
+
+	if (bulk.key_filename != NULL && argc > 0 && mode >= 0 && (optind < argc || bulk.list_filename != NULL)) {
+		bulk.mode = mode | auth;
+		bulk.workers = threads;
+		bulk.inputs = argv + optind;
+		bulk.n_inputs = argc - optind;
+
+		return bulk_main(&bulk);
+	}
+
+	if (argc - optind < 3 || mode < 0 || bulk.key_filename != NULL) {
+		fprintf(stderr, "\nUsage: [--stats] [-a] [-C | -M | -P | --base64 | --base64url | --append] [-z zlib|zstd] [-m chain|ctr] [-t THREADS] [PLAINTEXT FILE | -] [KEY FILE] [OUTPUT FILE | -]\n"
+				"       [--stats] [-a] [-m chain|ctr] [-t WORKERS] [-r] [-o OUT DIR] [-L LIST FILE] -k KEY FILE [INPUT ...]\n\n");
 		return -1;
 	}
 
-	char * plaintext_filename = argv[1];
-	char * key_filename = argv[2];
-	char * out_filename = argv[3];
+	/* ONLY THE TAG CAN TELL A WRONG KEY: WITHOUT IT A CHAINED FILE'S LAST BLOCK DECRYPTS UNDER */
+	/* ANY KEY, AND THE APPEND WOULD SILENTLY DAMAGE THE FILE */
+
+	if (append && !auth) {
+		fprintf(stderr, "--append needs -a, the file must have been encrypted with -a\nAborting...\n");
+		return -1;
+	}
 
-	FILE * plaintext_file = fopen(plaintext_filename, "r");
+	char * plaintext_filename = argv[optind];
+	char * key_filename = argv[optind + 1];
+	char * out_filename = argv[optind + 2];
+
+	FILE * plaintext_file = (strcmp(plaintext_filename, "-") == 0)?stdin:fopen(plaintext_filename, "rb");
 	FILE * key_file = fopen(key_filename, "rb");
 
 	if (plaintext_file == NULL || key_file == NULL) {
-		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", (plaintext_file == NULL)?argv[1]:argv[2]);
+		fprintf(stderr, "Failed to open file \"%s\" [fopen()]\n", (plaintext_file == NULL)?plaintext_filename:key_filename);
 		perror("Error");
 		return -1;
 	}
 
-	long plaintext_len, key_len = 0;
+	long key_len = 0;
 
-	fseek(plaintext_file, 0, SEEK_END); 	/* GO TO END OF PLAINTEXT FILE */
 	fseek(key_file, 0, SEEK_END); 		/* GET FIRST 32 BYTES OF KEY */
-
-	plaintext_len = ftell(plaintext_file);	/* STORE LENGTH OF PLAINTEXT FILE */
-	key_len = ftell(key_file);		/* STORE LENGTH OF ENCRYPTION KEY - 2 FOR LINE ENDING */
-
-	rewind(plaintext_file);	/* RESET POSITION OF FILES TO THE START */
+	key_len = ftell(key_file);		/* STORE LENGTH OF ENCRYPTION KEY */
 	rewind(key_file);
 
 	if (key_len != AKUMA_BLOCK_SIZE_BYTES) { 	/* CHECK LENGTH OF KEY */
@@ -39,38 +482,23 @@ int main(int argc, char ** argv) {
 		return -1;
 	}
 
-	char plaintext[plaintext_len];
-	char key[AKUMA_BLOCK_SIZE_BYTES];
-	char iv[AKUMA_BLOCK_SIZE_BYTES];	/* INITIALIZATION VECTOR MUST BE SAME SIZE AS BLOCK SIZE (256 BITS) */
+	unsigned char key[AKUMA_BLOCK_SIZE_BYTES];
+	unsigned char iv[AKUMA_BLOCK_SIZE_BYTES];	/* INITIALIZATION VECTOR MUST BE SAME SIZE AS BLOCK SIZE (256 BITS) */
 
-	if (!RAND_bytes(iv, sizeof(iv))) {
-		fprintf(stderr, "Failed to randomly generate IV [RAND_bytes()] (NOT CRITICAL BUT UNSAFE)\nAborting...");
+	if (!Akuma_IV(iv)) {
+		fprintf(stderr, "Failed to randomly generate IV [Akuma_IV()] (NOT CRITICAL BUT UNSAFE)\nAborting...");
 		return -1;
 	}
 
-	fread(plaintext, 1, plaintext_len, plaintext_file);
 	fread(key, 1, sizeof(key), key_file);
+	fclose(key_file);
 
-	plaintext[plaintext_len] = '\0';	/* ZERO OUT THE fread() */
-
-	/* PAD THE PLAINTEXT TO THE REQUIRED BLOCK SIZE DIVISION */
-	char * padded_plaintext = pkcs7pad(plaintext, strlen(plaintext), AKUMA_BLOCK_SIZE_BYTES);
-
-	// YOU MUST ALWAYS pkcs7pad() YOUR PLAINTEXT STRING WHEN ENCRYPTING
-	// THIS IS IMPORTANT FOR THE DECRYPTION PROCESS AND THIS IS USED TO
-	// ENSURE THE PLAINTEXT IS PADDED TO FIT THE BLOCK SIZE OTHERWISE Akuma_Update() WILL NOT WORK.
-	// I WILL PROVIDE AN AUTOMATED ALTERNATIVE FOR THIS IN THE FUTURE.
-	
 	Akuma_CTX ctx;
 	Akuma_Init(&ctx);
+	Akuma_SetMode(&ctx, mode | auth);
 
 	/* int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char * key, unsigned char * plaintext, unsigned char * ciphertext, size_t plaintext_len, size_t ciphertext_len); */
 
-	if (!Akuma_Update(AKUMA_UPDATE_PLAINTEXT, &ctx, NULL, NULL, padded_plaintext, NULL, strlen(padded_plaintext), 0)) {
-		fprintf(stderr, "Akuma_Update() failed to update the plaintext\nAborting...\n");
-		return -1;
-	}
-
 	if (!Akuma_Update(AKUMA_UPDATE_KEY, &ctx, NULL, key, NULL, NULL, 0, 0)) {
 		fprintf(stderr, "Akuma_Update() failed to update the encryption key\nAborting...\n");
 		return -1;
@@ -81,34 +509,136 @@ int main(int argc, char ** argv) {
 		return -1;
 	}
 
-	size_t bytes_written = 0;
+	ctx.threads = threads;
+
+	/* --append TO A FILE THAT IS NOT THERE YET JUST CREATES IT */
+
+	if (append && access(out_filename, F_OK) == 0) {
+		size_t buffer_size = (threads > 1 && mode == AKUMA_MODE_CTR)?(threads * THREAD_BUFFER_SIZE):BUFFER_SIZE;
 
-	/* Akuma_Encrypt() RETURNS THE AMOUNT OF COPIED BYTES ON SUCCESS AND 0 ON FAILURE */
+		if (encrypt_append(&ctx, plaintext_file, out_filename, buffer_size) != 0)
+			return -1;
 
-	bytes_written = Akuma_Encrypt(&ctx);
+		fclose(plaintext_file);
+		report_success(out_filename);
 
-	if (bytes_written < 1) {
-		fprintf(stderr, "Akuma_Encrypt() failed.\nAborting...\n");
+		return 0;
+	}
+
+	if (!Akuma_EncryptInit(&ctx)) {
+		fprintf(stderr, "Akuma_EncryptInit() failed.\nAborting...\n");
 		return -1;
 	}
 
-	/* ENCRYPTED TEXT/CIPHERTEXT IS NOW STORED IN ctx.ciphertext */
-	/* LENGTH OF CIPHERTEXT IS STORED IN ctx.ciphertext_len */
+	if (container) {
+		if (encrypt_container(&ctx, fileno(plaintext_file), out_filename, iv, compression) != 0)
+			return -1;
+
+		fclose(plaintext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
+
+	if (use_mmap) {
+		if (encrypt_mapped(&ctx, fileno(plaintext_file), out_filename, iv) != 0)
+			return -1;
+
+		fclose(plaintext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
+
+	size_t buffer_size = (threads > 1 && mode == AKUMA_MODE_CTR)?(threads * THREAD_BUFFER_SIZE):BUFFER_SIZE;
+
+	if (armor >= 0) {
+		if (encrypt_armored(&ctx, plaintext_file, out_filename, iv, buffer_size, armor) != 0)
+			return -1;
+
+		fclose(plaintext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
+
+	if (pipelined) {
+		if (encrypt_pipelined(&ctx, fileno(plaintext_file), out_filename, iv, (buffer_size > PIPE_CHUNK)?buffer_size:PIPE_CHUNK) != 0)
+			return -1;
+
+		fclose(plaintext_file);
+		report_success(out_filename);
+
+		return 0;
+	}
 
 	FILE * outfile = fopen(out_filename, "wb");
 
 	if (outfile == NULL) {
-		fprintf(stderr, "Failed to open file file for writing \"%s\" [fopen()]\n", (outfile == NULL)?argv[1]:argv[2]);
+		fprintf(stderr, "Failed to open file for writing \"%s\" [fopen()]\n", out_filename);
 		perror("Error");
 		return -1;
 	}
 
-	/* WRITE CIPHERTEXT TO NEW FILE */
+	/* STREAM THE PLAINTEXT THROUGH THE CIPHER IN FIXED SIZE CHUNKS */
+	/* Akuma_EncryptFinal() APPLIES THE PKCS#7 PADDING TO THE LAST BLOCK */
+
+	unsigned char * in_buf = malloc(buffer_size);
+	unsigned char * out_buf = malloc(buffer_size + AKUMA_BLOCK_SIZE_BYTES);
+
+	if (in_buf == NULL || out_buf == NULL) {
+		fprintf(stderr, "Failed to allocate %zu byte buffers [malloc()]\n", buffer_size);
+		return -1;
+	}
+
+	size_t bytes_read = 0;
+	size_t bytes_written = 0;
+
+	while ((bytes_read = fread(in_buf, 1, buffer_size, plaintext_file)) > 0) {
+		bytes_written = Akuma_EncryptUpdate(&ctx, in_buf, bytes_read, out_buf);
+
+		if (bytes_written == (size_t)-1)
+			break;
+
+		fwrite(out_buf, bytes_written, 1, outfile);
+	}
+
+	if (ferror(plaintext_file)) {
+		fprintf(stderr, "Failed to read \"%s\" [fread()]\nAborting...\n", plaintext_filename);
+		return -1;
+	}
+
+	int final_len = (bytes_written == (size_t)-1)?-1:Akuma_EncryptFinal(&ctx, out_buf);
+
+	if (final_len < 0) {
+		fprintf(stderr, "Failed to encrypt \"%s\"\nAborting...\n", plaintext_filename);
+		return -1;
+	}
+
+	fwrite(out_buf, (size_t)final_len, 1, outfile);
+
+	/* WRITE IV TO THE END OF THE CIPHERTEXT FILE */
 
-	fwrite(ctx.ciphertext, ctx.ciphertext_len, 1, outfile);
 	fwrite(iv, AKUMA_BLOCK_SIZE_BYTES, 1, outfile);
 
-	printf("Success!\nEncrypted data now stored in \"%s\"\n", out_filename);
+	/* -a: THE TAG COVERS THE IV AND THE CIPHERTEXT AND GOES LAST */
+
+	unsigned char tag[AKUMA_TAG_LENGTH_BYTES];
+
+	if (Akuma_EncryptTag(&ctx, tag))
+		fwrite(tag, sizeof(tag), 1, outfile);
+
+	fclose(plaintext_file);
+	free(in_buf);
+	free(out_buf);
+
+	if (fclose(outfile) != 0) {
+		fprintf(stderr, "Failed to write \"%s\"\n", out_filename);
+		perror("Error");
+		return -1;
+	}
+
+	report_success(out_filename);
 
 	return 0;
 }
@@ -0,0 +1,433 @@
+/* PIPELINED FILE I/O FOR encrypt.c AND decrypt.c (-P), INCLUDE AFTER akuma.h
+ *
+ * THE INPUT IS CUT INTO CHUNKS THAT CYCLE THROUGH PIPE_DEPTH SLOTS. WHILE THE CIPHER
+ * RUNS ON ONE SLOT, THE READS OF THE NEXT CHUNKS AND THE WRITES OF THE LAST ONES ARE
+ * IN FLIGHT, SO THE DISK AND THE CPU WORK AT THE SAME TIME AND A FILE TAKES ABOUT
+ * max(I/O, CIPHER) INSTEAD OF THEIR SUM. A SLOT'S INPUT IS READ AGAIN AS SOON AS THE
+ * CIPHER HAS CONSUMED IT, ITS OUTPUT IS REUSED ONCE ITS WRITE HAS COMPLETED.
+ *
+ * THE I/O GOES THROUGH io_uring (RAW SYSCALLS, NO liburing NEEDED) WHEN THE KERNEL
+ * OFFERS IORING_OP_READ/WRITE, OTHERWISE THROUGH ONE I/O THREAD. AKUMA_IO=thread
+ * FORCES THE THREAD.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#define PIPE_DEPTH 4			/* CHUNKS IN FLIGHT */
+#define PIPE_CHUNK (1024 * 1024)	/* PER SLOT, GROWN TO THE PARALLEL CHUNK WHEN THREADED */
+
+#define PIPE_READ  0
+#define PIPE_WRITE 1
+
+struct PipeReq {
+	int op;
+	int fd;
+	unsigned char * buf;
+	size_t len;
+	size_t offset;
+	ssize_t result;
+	bool pending;
+	bool done;
+};
+
+struct Pipe {
+	bool uring;
+
+#ifdef __linux__
+	int ring_fd;
+	unsigned int * sq_tail;
+	unsigned int * sq_mask;
+	unsigned int * sq_array;
+	struct io_uring_sqe * sqes;
+	unsigned int * cq_head;
+	unsigned int * cq_tail;
+	unsigned int * cq_mask;
+	struct io_uring_cqe * cqes;
+	void * sq_ring;
+	size_t sq_ring_size;
+	void * cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+#endif
+
+/* THREAD FALLBACK: A FIFO OF REQUESTS SERVED BY ONE I/O THREAD */
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct PipeReq * queue[2 * PIPE_DEPTH];
+	size_t head;
+	size_t tail;
+	bool stop;
+};
+
+
+/* BLOCKING REMAINDER OF A SHORT TRANSFER, RETURNS THE TOTAL OR -1 */
+
+static ssize_t pipe_finish(struct PipeReq * r, size_t done) {
+	while (done < r->len) {
+		ssize_t n = (r->op == PIPE_READ)?pread(r->fd, r->buf + done, r->len - done, (off_t)(r->offset + done)):pwrite(r->fd, r->buf + done, r->len - done, (off_t)(r->offset + done));
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return (n == 0 && r->op == PIPE_READ)?(ssize_t)done:-1;
+
+		done += (size_t)n;
+	}
+
+	return (ssize_t)done;
+}
+
+
+/* io_uring BACKEND */
+
+#ifdef __linux__
+
+static int pipe_uring_enter(struct Pipe * p, unsigned int submit, unsigned int wait) {
+	return (int)syscall(__NR_io_uring_enter, p->ring_fd, submit, wait, wait?IORING_ENTER_GETEVENTS:0, NULL, 0);
+}
+
+static bool pipe_uring_init(struct Pipe * p) {
+	struct io_uring_params params;
+	struct io_uring_probe * probe;
+	bool supported = false;
+
+	memset(&params, 0, sizeof(params));
+	p->ring_fd = (int)syscall(__NR_io_uring_setup, 2 * PIPE_DEPTH, &params);
+
+	if (p->ring_fd < 0)
+		return false;
+
+/* IORING_OP_READ/WRITE CAME WITH THE PROBE (5.6), OLDER KERNELS TAKE THE THREAD */
+
+	probe = calloc(1, sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+
+	if (probe != NULL && syscall(__NR_io_uring_register, p->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+		supported = (probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED));
+
+	free(probe);
+
+	if (!supported) {
+		close(p->ring_fd);
+		return false;
+	}
+
+	p->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	p->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (p->cq_ring_size > p->sq_ring_size)
+			p->sq_ring_size = p->cq_ring_size;
+
+		p->cq_ring_size = 0;
+	}
+
+	p->sq_ring = mmap(NULL, p->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, p->ring_fd, IORING_OFF_SQ_RING);
+	p->cq_ring = (p->cq_ring_size == 0)?p->sq_ring:mmap(NULL, p->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, p->ring_fd, IORING_OFF_CQ_RING);
+
+	p->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	p->sqes = mmap(NULL, p->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, p->ring_fd, IORING_OFF_SQES);
+
+	if (p->sq_ring == MAP_FAILED || p->cq_ring == MAP_FAILED || p->sqes == MAP_FAILED) {
+		if (p->sqes != MAP_FAILED)
+			munmap(p->sqes, p->sqes_size);
+
+		if (p->cq_ring_size > 0 && p->cq_ring != MAP_FAILED)
+			munmap(p->cq_ring, p->cq_ring_size);
+
+		if (p->sq_ring != MAP_FAILED)
+			munmap(p->sq_ring, p->sq_ring_size);
+
+		close(p->ring_fd);
+		return false;
+	}
+
+	p->sq_tail = (unsigned int *)((char *)p->sq_ring + params.sq_off.tail);
+	p->sq_mask = (unsigned int *)((char *)p->sq_ring + params.sq_off.ring_mask);
+	p->sq_array = (unsigned int *)((char *)p->sq_ring + params.sq_off.array);
+	p->cq_head = (unsigned int *)((char *)p->cq_ring + params.cq_off.head);
+	p->cq_tail = (unsigned int *)((char *)p->cq_ring + params.cq_off.tail);
+	p->cq_mask = (unsigned int *)((char *)p->cq_ring + params.cq_off.ring_mask);
+	p->cqes = (struct io_uring_cqe *)((char *)p->cq_ring + params.cq_off.cqes);
+
+	return true;
+}
+
+static void pipe_uring_free(struct Pipe * p) {
+	munmap(p->sqes, p->sqes_size);
+
+	if (p->cq_ring_size > 0)
+		munmap(p->cq_ring, p->cq_ring_size);
+
+	munmap(p->sq_ring, p->sq_ring_size);
+	close(p->ring_fd);
+}
+
+/* AT MOST 2 * PIPE_DEPTH REQUESTS ARE EVER PENDING, SO THE RING NEVER FILLS UP */
+
+static bool pipe_uring_submit(struct Pipe * p, struct PipeReq * r) {
+	unsigned int tail = *p->sq_tail;
+	unsigned int index = tail & *p->sq_mask;
+	struct io_uring_sqe * sqe = &p->sqes[index];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = (r->op == PIPE_READ)?IORING_OP_READ:IORING_OP_WRITE;
+	sqe->fd = r->fd;
+	sqe->addr = (uint64_t)(uintptr_t)r->buf;
+	sqe->len = (uint32_t)r->len;
+	sqe->off = (uint64_t)r->offset;
+	sqe->user_data = (uint64_t)(uintptr_t)r;
+
+	p->sq_array[index] = index;
+	__atomic_store_n(p->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return (pipe_uring_enter(p, 1, 0) == 1);
+}
+
+static void pipe_uring_reap(struct Pipe * p) {
+	unsigned int head = *p->cq_head;
+	unsigned int tail = __atomic_load_n(p->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; ++head) {
+		struct io_uring_cqe * cqe = &p->cqes[head & *p->cq_mask];
+		struct PipeReq * r = (struct PipeReq *)(uintptr_t)cqe->user_data;
+
+		r->result = cqe->res;
+		r->done = true;
+	}
+
+	__atomic_store_n(p->cq_head, head, __ATOMIC_RELEASE);
+}
+
+#endif
+
+
+/* THREAD BACKEND */
+
+static void * pipe_thread(void * arg) {
+	struct Pipe * p = (struct Pipe *)arg;
+
+	pthread_mutex_lock(&p->lock);
+
+	for (;;) {
+		while (p->head == p->tail && !p->stop)
+			pthread_cond_wait(&p->cond, &p->lock);
+
+		if (p->head == p->tail)
+			break;
+
+		struct PipeReq * r = p->queue[p->head++ % (2 * PIPE_DEPTH)];
+
+		pthread_mutex_unlock(&p->lock);
+
+		ssize_t result = pipe_finish(r, 0);
+
+		pthread_mutex_lock(&p->lock);
+		r->result = result;
+		r->done = true;
+		pthread_cond_broadcast(&p->cond);
+	}
+
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+
+/* COMMON INTERFACE */
+
+static bool pipe_init(struct Pipe * p) {
+	const char * io = getenv("AKUMA_IO");
+
+	memset(p, 0, sizeof(struct Pipe));
+
+#ifdef __linux__
+	if (io == NULL || strcmp(io, "thread") != 0)
+		p->uring = pipe_uring_init(p);
+#endif
+
+	if (p->uring)
+		return true;
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	if (pthread_create(&p->thread, NULL, pipe_thread, p) != 0) {
+		pthread_mutex_destroy(&p->lock);
+		pthread_cond_destroy(&p->cond);
+		return false;
+	}
+
+	return true;
+}
+
+static bool pipe_submit(struct Pipe * p, struct PipeReq * r, int op, int fd, unsigned char * buf, size_t len, size_t offset) {
+	r->op = op;
+	r->fd = fd;
+	r->buf = buf;
+	r->len = len;
+	r->offset = offset;
+	r->result = 0;
+	r->done = false;
+	r->pending = (len > 0);
+
+	if (!r->pending)
+		return true;
+
+#ifdef __linux__
+	if (p->uring && !pipe_uring_submit(p, r)) {
+		r->pending = false;
+		r->result = -1;
+		return false;
+	}
+
+	if (p->uring)
+		return true;
+#endif
+
+	pthread_mutex_lock(&p->lock);
+	p->queue[p->tail++ % (2 * PIPE_DEPTH)] = r;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	return true;
+}
+
+/* WAIT FOR r, RETURNS THE BYTES TRANSFERRED (r->len UNLESS A READ HIT THE END OF THE FILE)
+ * OR < 0 ON AN ERROR. A REQUEST THAT WAS NEVER SUBMITTED OR ALREADY WAITED FOR RETURNS AT ONCE */
+
+static ssize_t pipe_wait(struct Pipe * p, struct PipeReq * r) {
+	if (!r->pending)
+		return r->result;
+
+#ifdef __linux__
+	if (p->uring) {
+		pipe_uring_reap(p);
+
+		while (!r->done) {
+			if (pipe_uring_enter(p, 0, 1) < 0 && errno != EINTR)
+				return -1;
+
+			pipe_uring_reap(p);
+		}
+	}
+#endif
+
+	if (!p->uring) {
+		pthread_mutex_lock(&p->lock);
+
+		while (!r->done)
+			pthread_cond_wait(&p->cond, &p->lock);
+
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	r->pending = false;
+
+	if (p->uring && r->result > 0 && (size_t)r->result < r->len)
+		r->result = pipe_finish(r, (size_t)r->result);
+
+	return r->result;
+}
+
+static void pipe_free(struct Pipe * p) {
+#ifdef __linux__
+	if (p->uring) {
+		pipe_uring_free(p);
+		return;
+	}
+#endif
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	pthread_join(p->thread, NULL);
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+}
+
+
+/* RUN in_len BYTES OF in_fd THROUGH update() INTO out_fd, update() IS Akuma_EncryptUpdate()
+ * OR Akuma_DecryptUpdate(). RETURNS THE BYTES WRITTEN OR -1, THE CALLER WRITES WHAT THE
+ * FINAL CALL PRODUCES AFTER THEM. chunk IS THE SIZE OF EACH READ. */
+
+static size_t pipe_run(Akuma_CTX * ctx, size_t (*update)(Akuma_CTX *, const unsigned char *, size_t, unsigned char *), int in_fd, size_t in_len, int out_fd, size_t chunk) {
+	struct PipeReq reads[PIPE_DEPTH];
+	struct PipeReq writes[PIPE_DEPTH];
+	unsigned char * in[PIPE_DEPTH] = { NULL };
+	unsigned char * out[PIPE_DEPTH] = { NULL };
+	size_t chunks = (in_len + chunk - 1) / chunk;
+	size_t out_len = 0;
+	bool ok = true;
+	struct Pipe p;
+
+	if (!pipe_init(&p))
+		return -1;
+
+	memset(reads, 0, sizeof(reads));
+	memset(writes, 0, sizeof(writes));
+
+	for (size_t s = 0; s < PIPE_DEPTH; ++s) {
+		in[s] = malloc(chunk);
+		out[s] = malloc(chunk + AKUMA_BLOCK_SIZE_BYTES);
+		ok = (ok && in[s] != NULL && out[s] != NULL);
+	}
+
+	for (size_t k = 0; ok && k < PIPE_DEPTH && k < chunks; ++k)
+		ok = pipe_submit(&p, &reads[k], PIPE_READ, in_fd, in[k], (in_len - k * chunk < chunk)?(in_len - k * chunk):chunk, k * chunk);
+
+	for (size_t k = 0; ok && k < chunks; ++k) {
+		size_t s = k % PIPE_DEPTH;
+		size_t len = reads[s].len;
+
+		if (pipe_wait(&p, &reads[s]) != (ssize_t)len || pipe_wait(&p, &writes[s]) < 0) {
+			ok = false;
+			break;
+		}
+
+		size_t n = update(ctx, in[s], len, out[s]);
+
+		if (n == (size_t)-1) {
+			ok = false;
+			break;
+		}
+
+/* THE INPUT BUFFER IS FREE AGAIN, START READING THE CHUNK THAT REUSES THIS SLOT */
+
+		size_t next = k + PIPE_DEPTH;
+
+		if (next < chunks)
+			ok = pipe_submit(&p, &reads[s], PIPE_READ, in_fd, in[s], (in_len - next * chunk < chunk)?(in_len - next * chunk):chunk, next * chunk);
+
+		ok = (ok && pipe_submit(&p, &writes[s], PIPE_WRITE, out_fd, out[s], n, out_len));
+		out_len += n;
+	}
+
+/* NOTHING MAY STILL BE IN FLIGHT WHEN THE BUFFERS ARE FREED */
+
+	for (size_t s = 0; s < PIPE_DEPTH; ++s) {
+		if (pipe_wait(&p, &reads[s]) < 0 || pipe_wait(&p, &writes[s]) < 0)
+			ok = false;
+	}
+
+	pipe_free(&p);
+
+	for (size_t s = 0; s < PIPE_DEPTH; ++s) {
+		free(in[s]);
+		free(out[s]);
+	}
+
+	return ok?out_len:(size_t)-1;
+}
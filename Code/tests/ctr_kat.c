@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+
+#include "akuma.h"
+
+/* KNOWN ANSWERS FOR AKUMA_MODE_CTR
+ *
+ * A FIXED KEY, IV AND PLAINTEXT MUST ENCRYPT TO THE BYTES BELOW AND DECRYPT BACK.
+ * THE SHORT VECTOR ENDS IN A PARTIAL BLOCK, THE LONG ONE (CHECKED BY ITS SHA-256)
+ * SPANS SEVERAL BATCHES OF AKUMA_CTR_BATCH KEYROUNDS.
+ *
+ * THE KEYSTREAM COMES FROM THE AES-NI KERNEL OR, WITHOUT AES-NI AND WITH
+ * AKUMA_ENGINE=scalar, FROM OPENSSL'S EVP. THE PROGRAM RUNS ITSELF AGAIN WITH
+ * AKUMA_ENGINE=scalar SO ONE RUN CHECKS BOTH AGAINST THE SAME ANSWERS. THE ANSWERS
+ * THEMSELVES ARE SHA-256(KEY || IV) AND `openssl enc -aes-256-ctr` APPLIED BY HAND.
+ *
+ *	$ gcc -O2 -o ctr_kat tests/ctr_kat.c -I ../ -lcrypto -pthread && ./ctr_kat
+ */
+
+#define KAT_SHORT_LEN 100
+#define KAT_LONG_LEN  5000
+
+static const unsigned char kat_short[KAT_SHORT_LEN] = {
+	0xef, 0xb7, 0x2e, 0xb8, 0x6f, 0xa7, 0xed, 0x8f, 0xec, 0xee, 0xf3, 0xa8,
+	0xeb, 0x34, 0x24, 0x9d, 0x6e, 0x9b, 0x75, 0x70, 0x65, 0x05, 0x98, 0x52,
+	0xea, 0x8a, 0x23, 0xc0, 0xf8, 0xb7, 0x0b, 0x74, 0x66, 0x09, 0x4d, 0x2d,
+	0xf6, 0xe1, 0x53, 0x8d, 0x7b, 0x78, 0xfb, 0xd6, 0xa8, 0xbd, 0x63, 0xc5,
+	0x3f, 0xc3, 0x85, 0x3a, 0xb1, 0xd6, 0xbd, 0xf6, 0xe0, 0xd4, 0x8a, 0xf8,
+	0x46, 0xab, 0x06, 0x39, 0x37, 0x11, 0x6d, 0xe8, 0xc6, 0xbb, 0xbe, 0x0d,
+	0xde, 0xfb, 0xfd, 0x0a, 0xdb, 0x3f, 0x44, 0xf5, 0x53, 0x62, 0x9c, 0xbc,
+	0x22, 0x0e, 0xdb, 0xf2, 0x88, 0x59, 0xc4, 0x3b, 0xf3, 0x62, 0x8c, 0x54,
+	0xe5, 0xb5, 0xba, 0xf2
+};
+
+static const unsigned char kat_long_sha256[SHA256_DIGEST_LENGTH] = {
+	0x11, 0x5a, 0x10, 0x4f, 0x1f, 0x3d, 0x7b, 0x1c, 0xdc, 0xc5, 0xa4, 0x64,
+	0xc3, 0x2a, 0x5a, 0xfe, 0xa9, 0xe2, 0xdd, 0x6d, 0x5f, 0xfd, 0x3c, 0x19,
+	0x8e, 0x10, 0xad, 0x5a, 0x41, 0x5c, 0xfb, 0x21
+};
+
+static void kat_fill(unsigned char * key, unsigned char * iv, unsigned char * plaintext, size_t len) {
+	for (size_t i = 0; i < AKUMA_KEY_LENGTH_BYTES; ++i)
+		key[i] = (unsigned char)i;
+
+	for (size_t i = 0; i < AKUMA_IV_LENGTH_BYTES; ++i)
+		iv[i] = (unsigned char)(0xA0 + i);
+
+	for (size_t i = 0; i < len; ++i)
+		plaintext[i] = (unsigned char)(i * 7 + 3);
+}
+
+/* 1 IF len BYTES ENCRYPT TO expected (OR TO A CIPHERTEXT WHOSE SHA-256 IS expected) AND BACK */
+
+static int kat_check(const char * name, size_t len, const unsigned char * expected, int hashed) {
+	unsigned char key_bytes[AKUMA_KEY_LENGTH_BYTES];
+	unsigned char iv[AKUMA_IV_LENGTH_BYTES];
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	unsigned char * plaintext = malloc(len);
+	unsigned char * ciphertext = malloc(len);
+	unsigned char * decrypted = malloc(len);
+	Akuma_Key key;
+	int ok = 0;
+
+	if (plaintext == NULL || ciphertext == NULL || decrypted == NULL) {
+		fprintf(stderr, "%s: out of memory\n", name);
+		goto done;
+	}
+
+	kat_fill(key_bytes, iv, plaintext, len);
+
+	if (!Akuma_KeyInit(&key, key_bytes, AKUMA_MODE_CTR)) {
+		fprintf(stderr, "%s: Akuma_KeyInit() failed\n", name);
+		goto done;
+	}
+
+	size_t n = Akuma_KeyEncryptTo(&key, iv, plaintext, len, ciphertext, len);
+	const unsigned char * got = (hashed)?digest:ciphertext;
+	size_t got_len = (hashed)?sizeof(digest):len;
+
+	if (hashed)
+		SHA256(ciphertext, len, digest);
+
+	if (n != len || memcmp(got, expected, got_len) != 0) {
+		fprintf(stderr, "%s: wrong ciphertext (%s)\n", name, Akuma_Engine());
+
+		for (size_t i = 0; n == len && i < got_len; ++i)
+			fprintf(stderr, "0x%02x,%s", got[i], (i % 12 == 11 || i + 1 == got_len)?"\n":" ");
+	} else if (Akuma_KeyDecryptTo(&key, iv, ciphertext, len, decrypted, len) != len || memcmp(decrypted, plaintext, len) != 0) {
+		fprintf(stderr, "%s: does not decrypt back (%s)\n", name, Akuma_Engine());
+	} else {
+		ok = 1;
+	}
+
+	Akuma_KeyFree(&key);
+done:
+	free(plaintext);
+	free(ciphertext);
+	free(decrypted);
+
+	return ok;
+}
+
+int main(int argc, char * argv[]) {
+	(void)argc;
+
+	int ok = kat_check("short", KAT_SHORT_LEN, kat_short, 0);
+
+	ok = kat_check("long", KAT_LONG_LEN, kat_long_sha256, 1) && ok;
+
+	printf("%s: %s\n", Akuma_Engine(), (ok)?"ok":"FAILED");
+
+/* THE FIRST RUN PICKED THE FASTEST ENGINE, NOW THE PORTABLE KEYSTREAM */
+
+	if (ok && getenv("AKUMA_ENGINE") == NULL) {
+		fflush(stdout);
+		setenv("AKUMA_ENGINE", "scalar", 1);
+		execv("/proc/self/exe", argv);
+		execvp(argv[0], argv);
+		perror("Error");
+		return 1;
+	}
+
+	return (ok)?0:1;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "akuma.h"
+
+/* SESSION TABLE REGRESSIONS
+ *
+ * CLOSING A SESSION TWICE, OR CLOSING A FORGED HANDLE THAT NAMES A CLOSED SLOT,
+ * USED TO PUT THE SLOT ON THE FREE LIST AGAIN, AND TWO LATER SESSIONS THEN SHARED
+ * ONE SLOT AND ONE KEYROUND. AFTER EACH MISUSE THE TABLE MUST STILL HAND OUT
+ * capacity DISTINCT SLOTS, REFUSE ONE MORE, AND EVERY SESSION MUST ENCRYPT LIKE
+ * Akuma_KeyEncryptTo() WHILE THE OTHERS ARE IN USE. BUILD IT WITH -fsanitize=address
+ * TO ALSO CATCH THE MEMORY ERRORS.
+ *
+ *	$ gcc -O1 -g -fsanitize=address -o session tests/session.c -I ../ -lcrypto -pthread && ./session
+ */
+
+#define SESSION_CAPACITY 4
+#define SESSION_MESSAGE  100	/* THREE WHOLE BLOCKS AND A PADDED TAIL */
+
+static unsigned char session_key[AKUMA_KEY_LENGTH_BYTES];
+static unsigned char session_iv[SESSION_CAPACITY][AKUMA_IV_LENGTH_BYTES];
+static unsigned char session_plaintext[SESSION_MESSAGE];
+
+/* 1 IF THE TABLE HOLDS capacity DISTINCT SESSIONS THAT EACH ENCRYPT CORRECTLY, ALL CLOSED AGAIN AFTER */
+
+static int session_fill(Akuma_SessionTable * t, const Akuma_Key * key, const char * name) {
+	uint64_t h[SESSION_CAPACITY];
+	unsigned char out[SESSION_CAPACITY][SESSION_MESSAGE + AKUMA_BLOCK_SIZE_BYTES];
+	unsigned char expected[SESSION_MESSAGE + AKUMA_BLOCK_SIZE_BYTES];
+	size_t used[SESSION_CAPACITY];
+	int ok = 1;
+
+	for (size_t s = 0; s < SESSION_CAPACITY; ++s) {
+		h[s] = Akuma_SessionOpen(t, session_iv[s]);
+
+		for (size_t o = 0; h[s] != 0 && o < s; ++o) {
+			if ((uint32_t)h[s] == (uint32_t)h[o])
+				ok = 0;
+		}
+
+		if (h[s] == 0)
+			ok = 0;
+	}
+
+	if (!ok || Akuma_SessionOpen(t, session_iv[0]) != 0 || t->open != SESSION_CAPACITY) {
+		fprintf(stderr, "%s: the table did not hand out %d distinct slots\n", name, SESSION_CAPACITY);
+		return 0;
+	}
+
+/* INTERLEAVED, SO A SHARED SLOT WOULD MIX THE KEYROUNDS */
+
+	for (size_t s = 0; s < SESSION_CAPACITY; ++s)
+		used[s] = Akuma_SessionEncrypt(t, h[s], session_plaintext, SESSION_MESSAGE / 2, out[s]);
+
+	for (size_t s = 0; s < SESSION_CAPACITY; ++s) {
+		size_t n = used[s];
+
+		n += Akuma_SessionEncrypt(t, h[s], session_plaintext + n, SESSION_MESSAGE - n, out[s] + n);
+
+		int final_len = Akuma_SessionEncryptFinal(t, h[s], session_plaintext + n, SESSION_MESSAGE - n, out[s] + n);
+		size_t expected_len = Akuma_KeyEncryptTo(key, session_iv[s], session_plaintext, SESSION_MESSAGE, expected, sizeof(expected));
+
+		if (final_len < 0 || n + (size_t)final_len != expected_len || memcmp(out[s], expected, expected_len) != 0) {
+			fprintf(stderr, "%s: session %zu does not match Akuma_KeyEncryptTo()\n", name, s);
+			ok = 0;
+		}
+	}
+
+	if (t->open != 0) {
+		fprintf(stderr, "%s: %u sessions still open after their final calls\n", name, t->open);
+		ok = 0;
+	}
+
+	return ok;
+}
+
+int main(void) {
+	Akuma_SessionTable t;
+	Akuma_Key key;
+	int ok = 1;
+
+	for (size_t i = 0; i < sizeof(session_key); ++i)
+		session_key[i] = (unsigned char)(i * 5 + 1);
+
+	for (size_t s = 0; s < SESSION_CAPACITY; ++s)
+		memset(session_iv[s], (int)(0x10 + s), AKUMA_IV_LENGTH_BYTES);
+
+	for (size_t i = 0; i < sizeof(session_plaintext); ++i)
+		session_plaintext[i] = (unsigned char)(i * 3);
+
+	if (!Akuma_KeyInit(&key, session_key, AKUMA_MODE_CHAIN) || !Akuma_SessionTableInit(&t, &key, SESSION_CAPACITY)) {
+		fprintf(stderr, "Failed to set up the key or the session table\n");
+		return 1;
+	}
+
+	ok = session_fill(&t, &key, "fresh") && ok;
+
+/* DOUBLE CLOSE: THE SECOND CALL HAS A STALE HANDLE AND MUST DO NOTHING */
+
+	uint64_t a = Akuma_SessionOpen(&t, session_iv[0]);
+
+	Akuma_SessionClose(&t, a);
+	Akuma_SessionClose(&t, a);
+
+	if (t.open != 0 || Akuma_SessionOffset(&t, a) != (uint64_t)-1 || Akuma_SessionEncrypt(&t, a, session_plaintext, AKUMA_BLOCK_SIZE_BYTES, session_iv[1]) != (size_t)-1) {
+		fprintf(stderr, "double close: the stale handle still works\n");
+		ok = 0;
+	}
+
+	ok = session_fill(&t, &key, "double close") && ok;
+
+/* FORGED HANDLES: THE CLOSED SLOT'S OWN (EVEN) GENERATION, AN ODD ONE IT HAS NOT REACHED, AN INDEX PAST THE TABLE */
+
+	a = Akuma_SessionOpen(&t, session_iv[0]);
+	Akuma_SessionClose(&t, a);
+
+	uint32_t closed = (uint32_t)(a >> 32) + 1;
+
+	Akuma_SessionClose(&t, ((uint64_t)closed << 32) | (uint32_t)a);
+	Akuma_SessionClose(&t, ((uint64_t)(closed + 1) << 32) | (uint32_t)a);
+	Akuma_SessionClose(&t, ((uint64_t)1 << 32) | SESSION_CAPACITY);
+
+	if (t.open != 0) {
+		fprintf(stderr, "forged handle: the open count changed\n");
+		ok = 0;
+	}
+
+	ok = session_fill(&t, &key, "forged handle") && ok;
+
+	Akuma_SessionTableFree(&t);
+	Akuma_KeyFree(&key);
+
+	printf("session table: %s\n", (ok)?"ok":"FAILED");
+
+	return (ok)?0:1;
+}
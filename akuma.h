@@ -1,13 +1,21 @@
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include <pthread.h>
+#include <unistd.h>
 
-#define AKUMA_DEBUG 0  //DEBUG MODE 1 = DEBUG OUTPUT
-		       //	    0 = NO DEBUG OUTPUT
+
+#ifndef AKUMA_STATS
+#define AKUMA_STATS 1	/* 0 COMPILES THE COUNTERS AND TRACE HOOKS OUT, SEE "STATISTICS AND TRACING" */
+#endif
 
 #ifdef AKUMA_BLOCK_SIZE
 #undef AKUMA_BLOCK_SIZE
@@ -34,19 +42,43 @@
 #endif
 
 #define AKUMA_BLOCK_SIZE 256
-#define AKUMA_BLOCK_SIZE_BYTES AKUMA_BLOCK_SIZE / 8
+#define AKUMA_BLOCK_SIZE_BYTES (AKUMA_BLOCK_SIZE / 8)
 
 #define AKUMA_KEY_LENGTH       256
-#define AKUMA_KEY_LENGTH_BYTES AKUMA_KEY_LENGTH / 8
+#define AKUMA_KEY_LENGTH_BYTES (AKUMA_KEY_LENGTH / 8)
 
 #define AKUMA_IV_LENGTH 256
-#define AKUMA_IV_LENGTH_BYTES AKUMA_IV_LENGTH / 8
+#define AKUMA_IV_LENGTH_BYTES (AKUMA_IV_LENGTH / 8)
 
 #define AKUMA_UPDATE_IV         1
 #define AKUMA_UPDATE_KEY        2
 #define AKUMA_UPDATE_PLAINTEXT  3
 #define AKUMA_UPDATE_CIPHERTEXT 4
 
+#define AKUMA_MODE_CHAIN 0	/* EACH BLOCK'S KEYROUND IS THE PREVIOUS XORED BLOCK (DEFAULT) */
+#define AKUMA_MODE_CTR   1	/* EACH BLOCK'S KEYROUND IS DERIVED FROM KEY, IV AND A BLOCK COUNTER */
+#define AKUMA_AUTH       0x100	/* OR INTO EITHER MODE: HMAC-SHA256 TAG OVER IV || CIPHERTEXT */
+
+#define AKUMA_TAG_LENGTH_BYTES SHA256_DIGEST_LENGTH
+#define AKUMA_AUTH_CHUNK       (16 * 1024)	/* CIPHERTEXT HASHED RIGHT NEXT TO ITS TRANSFORM, WHILE STILL IN CACHE */
+
+#define AKUMA_OWN_PLAINTEXT  1	/* ctx->plaintext WAS ALLOCATED BY THE LIBRARY */
+#define AKUMA_OWN_CIPHERTEXT 2	/* ctx->ciphertext WAS ALLOCATED BY THE LIBRARY */
+
+#define AKUMA_PARALLEL_MIN_BLOCKS 2048	/* SMALLEST SLICE (64 KB) WORTH HANDING TO A WORKER THREAD */
+#define AKUMA_MAX_THREADS         256
+#define AKUMA_CTR_BATCH           64	/* COUNTER MODE KEYROUNDS GENERATED PER ENGINE CALL */
+#define AKUMA_SMALL_MAX           256	/* LONGEST PLAINTEXT FOR Akuma_EncryptSmall(), 8 BLOCKS */
+#define AKUMA_IV_POOL             128	/* IVS PER REFILL OF A THREAD'S POOL, SEE "RANDOM IVS" */
+#define AKUMA_IV_SEED_BYTES       48	/* AES-256 KEY || 128 BIT COUNTER */
+#define AKUMA_IV_RESEED           (1024 * 1024)	/* POOL BYTES BETWEEN TWO RAND_bytes() SEEDS */
+
+#define AKUMA_PHASE_SETUP   0	/* STARTING A MESSAGE: KEYROUND, COUNTER AND MAC STATE */
+#define AKUMA_PHASE_ENCRYPT 1
+#define AKUMA_PHASE_DECRYPT 2
+#define AKUMA_PHASE_MAC     3	/* HMAC-SHA256 OVER THE CIPHERTEXT (AKUMA_AUTH) */
+#define AKUMA_PHASES        4
+
 
 struct AkumaMatrix {
       	size_t rows;
@@ -54,6 +86,67 @@ struct AkumaMatrix {
       	int table[4][8];
 };
 
+/* COUNTERS PER PHASE, SEE "STATISTICS AND TRACING" */
+
+struct AkumaStats {
+      	uint64_t calls[AKUMA_PHASES];
+      	uint64_t bytes[AKUMA_PHASES];
+      	uint64_t blocks[AKUMA_PHASES];	/* WHOLE BLOCKS THROUGH THE ENGINE, ENCRYPT AND DECRYPT ONLY */
+      	uint64_t ns[AKUMA_PHASES];	/* ONLY WHILE TIMING OR A TRACE HOOK IS ON */
+      	uint64_t auth_failures;
+};
+
+struct AkumaTraceEvent {
+      	int phase;			/* AKUMA_PHASE_* */
+      	size_t bytes;
+      	uint64_t ns;			/* 0 UNLESS TIMING OR A HOOK IS ON */
+      	const struct AkumaStats * stats;	/* THE COUNTERS OF THE CONTEXT OR BATCH, NULL FOR A BARE STREAM */
+};
+
+typedef void (*Akuma_TraceHook)(const struct AkumaTraceEvent * event, void * arg);
+
+/* A KEY AND ITS MODE, NEVER WRITTEN AFTER Akuma_KeyInit() SO ANY NUMBER OF THREADS CAN SHARE ONE */
+
+typedef struct __AKUMA_KEY {
+      	unsigned char key[AKUMA_KEY_LENGTH_BYTES];
+      	size_t key_len;
+      	int mode;		/* AKUMA_MODE_CHAIN OR AKUMA_MODE_CTR */
+      	int auth;		/* AKUMA_AUTH WAS GIVEN */
+      	SHA256_CTX mac_inner;	/* HMAC STATES AFTER THE KEY PADS, AUTHENTICATED KEYS ONLY */
+      	SHA256_CTX mac_outer;
+      	SHA256_CTX key_base;	/* COUNTER MODE ONLY: SHA-256 STATE AFTER KEY, EACH MESSAGE ADDS ITS IV */
+} Akuma_Key;
+
+/* AES-256 ROUND KEYS OF ONE COUNTER MODE MESSAGE, SEE "COUNTER MODE" */
+
+struct AkumaCounterKey {
+      	union {
+            	unsigned char aesni[15][16];	/* AES-NI: THE 15 ROUND KEYS AS LOADED INTO XMM REGISTERS */
+            	unsigned char key[32];		/* ANY OTHER CPU: THE KEY, FOR OPENSSL'S EVP AES-256-CTR */
+      	} rounds;
+      	bool aesni;
+};
+
+/* EVERYTHING ONE MESSAGE CHANGES WHILE IT IS ENCRYPTED OR DECRYPTED, ONE PER MESSAGE IN FLIGHT */
+
+typedef struct __AKUMA_STREAM {
+      	const Akuma_Key * key;
+
+      	unsigned char keyround[AKUMA_BLOCK_SIZE_BYTES];
+
+      	unsigned char buffer[AKUMA_BLOCK_SIZE_BYTES];	/* PARTIAL BLOCK CARRIED BETWEEN STREAMING CALLS */
+      	size_t buffer_len;
+
+      	uint64_t counter;	/* NEXT BLOCK NUMBER IN COUNTER MODE */
+      	struct AkumaCounterKey counter_key;	/* AES-256 UNDER SHA-256(KEY || IV) */
+
+      	SHA256_CTX mac;		/* INNER HMAC OVER IV || CIPHERTEXT SO FAR, AUTHENTICATED KEYS ONLY */
+
+      	unsigned int threads;	/* WORKER THREADS FOR LARGE UPDATES (1 = SERIAL) */
+
+      	struct AkumaStats * stats;	/* COUNTED INTO BESIDES THE GLOBAL STATISTICS, OR NULL */
+} Akuma_Stream;
+
 typedef struct __AKUMA_CTX {
       	size_t key_len;
       	size_t iv_len;
@@ -70,6 +163,18 @@ typedef struct __AKUMA_CTX {
 
       	unsigned char * ciphertext;
       	size_t ciphertext_len;
+
+      	unsigned int threads;	/* WORKER THREADS FOR DECRYPTION AND COUNTER MODE (1 = SERIAL) */
+
+      	int mode;		/* AKUMA_MODE_CHAIN OR AKUMA_MODE_CTR */
+      	int auth;		/* SET BY Akuma_SetMode(ctx, mode | AKUMA_AUTH) */
+
+      	Akuma_Key shared;	/* key AND mode AS OF THE LAST Akuma_EncryptInit()/Akuma_DecryptInit() */
+      	Akuma_Stream stream;	/* KEYROUND, PARTIAL BLOCK AND COUNTER OF THE MESSAGE IN PROGRESS */
+
+      	struct AkumaStats stats;	/* EVERY MESSAGE AND BATCH RUN THROUGH THIS CONTEXT, SEE Akuma_Stats() */
+
+      	unsigned int owned;	/* AKUMA_OWN_* BITS, RELEASED BY Akuma_Free() */
 } Akuma_CTX;
 
 struct sha256 {
@@ -86,14 +191,14 @@ void init_sha256(struct sha256 * hash) {
       	hash->plaintext_len = 0;
 }
 
+/* HASH plaintext_len BYTES OF plaintext, WHICH MAY BE BINARY: THE CALLER SETS THE LENGTH */
+
 static int sha256sum(struct sha256 * hash) {
       	if (hash->plaintext == NULL)
             	return 0;
 
       	int status;
 
-      	hash->plaintext_len = strlen(hash->plaintext);
-
       	SHA256_CTX ctx;
       	SHA256_Init(&ctx);
       	SHA256_Update(&ctx, hash->plaintext, hash->plaintext_len);
@@ -123,7 +228,10 @@ unsigned char * pkcs7pad(unsigned char * buf, size_t buf_len, size_t block_size)
 
       	unsigned char * s = (unsigned char *)malloc(buf_len + n);
 
-      	memcpy(s, buf, buf_len + n);
+      	if (s == NULL)
+            	return NULL;
+
+      	memcpy(s, buf, buf_len);
 
       	for (int i = 0; i < n; ++i) {
             	s[buf_len + i] = (char)n;
@@ -173,9 +281,59 @@ void Akuma_Init(Akuma_CTX * ctx) {
       	ctx->ciphertext_len     = 0;
       	ctx->matrix.rows        = 4;
       	ctx->matrix.columns     = 8;
+      	ctx->threads            = 1;
+      	ctx->mode               = AKUMA_MODE_CHAIN;
+      	ctx->auth               = 0;
+      	ctx->plaintext          = NULL;
+      	ctx->ciphertext         = NULL;
+      	ctx->owned              = 0;
 
       	memset(ctx->key, '\0', sizeof(ctx->key));
       	memset(ctx->iv, '\0', sizeof(ctx->iv));
+      	memset(&ctx->shared, '\0', sizeof(ctx->shared));
+      	memset(&ctx->stream, '\0', sizeof(ctx->stream));
+      	memset(&ctx->stats, '\0', sizeof(ctx->stats));
+}
+
+/* RELEASE ctx->plaintext OR ctx->ciphertext IF THE LIBRARY ALLOCATED IT */
+
+static void ctx_release(Akuma_CTX * ctx, int which) {
+      	unsigned char ** buf = (which == AKUMA_OWN_PLAINTEXT)?&ctx->plaintext:&ctx->ciphertext;
+
+      	if (ctx->owned & which)
+            	free(*buf);
+
+      	*buf = NULL;
+      	ctx->owned &= ~which;
+}
+
+/* REPLACE ctx->plaintext OR ctx->ciphertext WITH A NEW size BYTE BUFFER OWNED BY THE LIBRARY */
+
+static unsigned char * ctx_alloc(Akuma_CTX * ctx, int which, size_t size) {
+      	unsigned char ** buf = (which == AKUMA_OWN_PLAINTEXT)?&ctx->plaintext:&ctx->ciphertext;
+
+      	ctx_release(ctx, which);
+
+      	*buf = malloc(size);
+
+      	if (*buf != NULL)
+            	ctx->owned |= which;
+
+      	return *buf;
+}
+
+/* FREE EVERY BUFFER THE LIBRARY ALLOCATED FOR ctx, WIPE THE KEY MATERIAL AND RESET IT LIKE Akuma_Init() */
+
+void Akuma_Free(Akuma_CTX * ctx) {
+      	ctx_release(ctx, AKUMA_OWN_PLAINTEXT);
+      	ctx_release(ctx, AKUMA_OWN_CIPHERTEXT);
+
+      	OPENSSL_cleanse(ctx->keyround, sizeof(ctx->keyround));
+      	OPENSSL_cleanse(&ctx->shared, sizeof(ctx->shared));
+      	OPENSSL_cleanse(&ctx->stream, sizeof(ctx->stream));
+      	OPENSSL_cleanse(ctx->key, sizeof(ctx->key));
+
+      	Akuma_Init(ctx);
 }
 
 int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char * key, unsigned char * plaintext, unsigned char * ciphertext, size_t plaintext_len, size_t ciphertext_len) {
@@ -228,9 +386,12 @@ int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char *
 /* UPDATE PLAINTEXT */
 
       	else if (mode == AKUMA_UPDATE_PLAINTEXT) {
-            	if (plaintext_len < AKUMA_BLOCK_SIZE_BYTES)
+            	if (plaintext_len < AKUMA_BLOCK_SIZE_BYTES && ctx->mode == AKUMA_MODE_CHAIN)
                   	return 0;
 
+            	if (ctx->plaintext != plaintext)
+                  	ctx_release(ctx, AKUMA_OWN_PLAINTEXT);
+
 		ctx->plaintext = plaintext;
 
 		status = 1;
@@ -249,7 +410,7 @@ int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char *
 /* UPDATE CIPHERTEXT */
 
       	else if (mode == AKUMA_UPDATE_CIPHERTEXT) {
-	    	if (ciphertext_len < AKUMA_BLOCK_SIZE_BYTES)
+      	    	if (ciphertext_len < AKUMA_BLOCK_SIZE_BYTES && ctx->mode == AKUMA_MODE_CHAIN)
 			return 0;
 
 
@@ -264,7 +425,9 @@ int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char *
 */
 
 
-	    	ctx->ciphertext = malloc(ciphertext_len + 1);
+      	    	if (ctx_alloc(ctx, AKUMA_OWN_CIPHERTEXT, ciphertext_len + 1) == NULL)
+			return 0;
+
 	    	memcpy(ctx->ciphertext, ciphertext, ciphertext_len);
 
 //	    	if (status) {
@@ -282,393 +445,3487 @@ int Akuma_Update(int mode, Akuma_CTX * ctx, unsigned char * iv, unsigned char *
 }
 
 
-unsigned int Akuma_Encrypt(Akuma_CTX * ctx) {
-#if AKUMA_DEBUG
-      	printf("\n===== ENCRYPTION =====\n\n");
-#endif
-
-#if AKUMA_DEBUG
-        printf("Cipher Key:\t\t");
-        print_bytes(ctx->key, sizeof(ctx->key));
-
-        printf("Initialization Vector:\t");
-        print_bytes(ctx->iv, sizeof(ctx->iv));
-
-        putchar('\n');
-#endif
-
-/* INITIALIZE MATRIX TABLE */
+/* SELECT AKUMA_MODE_CHAIN OR AKUMA_MODE_CTR, OPTIONALLY | AKUMA_AUTH, CALL BEFORE THE PLAINTEXT/CIPHERTEXT IS SET */
 
-      	for (size_t r = 0; r < ctx->matrix.rows; ++r) {
-            	for (size_t c = 0; c < ctx->matrix.columns; ++c) {
-                  	ctx->matrix.table[r][c] = 022;
-            	}
-      	}
+int Akuma_SetMode(Akuma_CTX * ctx, int mode) {
+      	int auth = (mode & AKUMA_AUTH) != 0;
 
-/* CHECK IV, KEY AND PLAINTEXT EXIST IN STRUCT */
+      	mode &= ~AKUMA_AUTH;
 
-      	if (ctx->iv_len == 0 || ctx->key_len == 0 || ctx->plaintext_len == 0)
-            	return -1;
+      	if (mode != AKUMA_MODE_CHAIN && mode != AKUMA_MODE_CTR)
+            	return 0;
 
-/* XOR KEY AND INITIALIZATION VECTOR FOR FIRST KEYROUND */
+      	ctx->mode = mode;
+      	ctx->auth = auth;
 
-      	if (!xor(ctx->keyround, sizeof(ctx->keyround), ctx->key, ctx->key_len, ctx->iv, ctx->iv_len))
-            	return -1;
+      	return 1;
+}
 
-      // static unsigned char sbox[256] = { 0x8e, 0xaa, 0x51, 0x13, 0x81, 0x30, 0x28, 0xb5, 0x82, 0x8a, 0x4f, 0x29, 0x6a, 0x06, 0xcd, 0xa6,
-      //                           0x54, 0xd7, 0xb7, 0x3f, 0x91, 0x1a, 0xfc, 0x7c, 0xac, 0x6d, 0x90, 0xb2, 0xc2, 0x25, 0xd8, 0x39,
-      //                           0x2e, 0x15, 0xf5, 0xfb, 0xfe, 0x68, 0x05, 0xa1, 0x6c, 0x97, 0x6f, 0x99, 0x26, 0x4a, 0x3e, 0x1e,
-      //                           0x9e, 0x61, 0xf6, 0x71, 0xb6, 0x2c, 0x36, 0xd9, 0xfd, 0xff, 0x44, 0xfa, 0x32, 0x55, 0x19, 0x35,
-      //                           0xb1, 0x48, 0xa7, 0xcb, 0xf3, 0xec, 0xa3, 0xf2, 0x5e, 0x4d, 0x09, 0x59, 0xce, 0x6b, 0xe0, 0xab,
-      //                           0xde, 0x7e, 0x69, 0x77, 0x85, 0x0e, 0xdc, 0x52, 0x9d, 0x62, 0x78, 0xbe, 0x8d, 0xd0, 0x2a, 0x1d,
-      //                           0xa8, 0xf7, 0x23, 0x86, 0x8f, 0x3d, 0xea, 0x9a, 0xad, 0xe9, 0x5d, 0x42, 0x66, 0x31, 0xe7, 0x7a,
-      //                           0x00, 0x72, 0xc7, 0x5f, 0x93, 0x34, 0x38, 0xda, 0xd6, 0xf9, 0x2b, 0xa2, 0x5a, 0xbc, 0x37, 0x94,
-      //                           0x11, 0x64, 0xb0, 0xbd, 0x4c, 0x20, 0x9f, 0x95, 0xb9, 0x3b, 0x02, 0xed, 0xa9, 0x47, 0x88, 0xe6,
-      //                           0x04, 0xd5, 0xdd, 0xee, 0xc1, 0x96, 0xe5, 0x14, 0x50, 0xeb, 0x84, 0x0a, 0x27, 0xd3, 0x56, 0x63,
-      //                           0x87, 0x16, 0xaf, 0x24, 0x8b, 0x83, 0x4b, 0x9c, 0x40, 0xd1, 0x22, 0x10, 0x2d, 0x5c, 0xc6, 0x45,
-      //                           0x03, 0x60, 0x65, 0x21, 0x6e, 0xe1, 0xf8, 0x33, 0xae, 0x70, 0x07, 0x57, 0x7f, 0x0d, 0x2f, 0x53,
-      //                           0xef, 0x76, 0x80, 0xb4, 0x0f, 0xdb, 0xf1, 0x79, 0xe2, 0x4e, 0x9b, 0xa4, 0xcc, 0x7d, 0x43, 0xbb,
-      //                           0xbf, 0xc9, 0x8c, 0x0c, 0xba, 0xc4, 0xc8, 0x08, 0xe4, 0xb3, 0x49, 0xe8, 0xf4, 0xb8, 0xd4, 0x12,
-      //                           0x98, 0x01, 0x5b, 0x17, 0x1b, 0xa0, 0x75, 0x7b, 0x89, 0xf0, 0x58, 0x41, 0x46, 0xc0, 0x67, 0x1c,
-      //                           0x74, 0xcf, 0xd2, 0x18, 0x3c, 0xe3, 0x3a, 0xc5, 0xdf, 0x1f, 0x0b, 0xca, 0xa5, 0xc3, 0x73, 0x92 };
 
-/* CREATE FUNC LOCAL VARIABLES TO LIMIT STRUCT ACCESS */
+/* SINGLE BLOCK ROUNDS SHARED BY THE ONE-SHOT AND STREAMING FUNCTIONS */
 
-      	size_t plaintext_len = (size_t)ctx->plaintext_len;
-      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
-      	size_t nmemb = plaintext_len / block_size;
-      	size_t total_size = ((sizeof(unsigned char) * AKUMA_BLOCK_SIZE_BYTES) * nmemb);
+static void Akuma_EncryptBlock(Akuma_CTX * ctx, const unsigned char * block, unsigned char * out) {
+      	unsigned char c_plaintext_block[AKUMA_BLOCK_SIZE_BYTES];
       	size_t matrix_columns = ctx->matrix.columns;
       	size_t matrix_rows = ctx->matrix.rows;
       	size_t pos = 0;
 
-      	char c_plaintext_block[AKUMA_BLOCK_SIZE_BYTES];
+      	memcpy(c_plaintext_block, block, sizeof(c_plaintext_block));
 
-      	ctx->ciphertext = (unsigned char*)malloc(total_size);
+/* XOR CURRENT KEYROUND & "PLAINTEXT" MEMORY -> "PLAINTEXT" */
 
-#if AKUMA_DEBUG
-      	printf("Plaintext length: \t%ld\nBlock size: \t\t%ld\nNumber of Blocks: \t%ld\nTotal Buffer Size: \t%ld\n\n", plaintext_len, block_size, nmemb, total_size);
-#endif
+      	xor(c_plaintext_block, sizeof(c_plaintext_block), ctx->keyround, AKUMA_KEY_LENGTH_BYTES, c_plaintext_block, sizeof(c_plaintext_block));
 
-      	for (int e = 0; e < nmemb; ++e) { /* REPEAT ROUNDS FOR N BLOCKS OF PADDED PLAINTEXT */
+/* FILL MATRIX TABLE WITH RESULT */
 
-/* COPY "PLAINTEXT" INTO OTHER SECTION OF MEMORY FOR FUNC */
+      	for (size_t r = 0; r < matrix_rows; ++r) {
+            	for (size_t c = 0; c < matrix_columns; ++c) {
+                  	pos = c + (r * matrix_columns);
+                  	ctx->matrix.table[r][c] = (int)c_plaintext_block[pos];
+                  	ctx->keyround[pos] = c_plaintext_block[pos];
+		}
+      	}
 
-            	memset(c_plaintext_block, '\0', sizeof(c_plaintext_block));
-            	memcpy(c_plaintext_block, ctx->plaintext + (block_size * e), sizeof(c_plaintext_block));
+//R3
+//R4
+//R1
+//R2
 
-#if AKUMA_DEBUG
-            	printf("\n\n\t\tBlock %d ~\n\n", e);
-            	printf("\nCurrent Block:  \t");
+//SHIFT COLUMNS TO LEFT BY 1
 
-            	for (int i = 0; i < sizeof(c_plaintext_block); ++i)
-                  	putchar(c_plaintext_block[i]);
-            	putchar('\n');
+/* ROTATE MATRIX TABLE USING VALUES ABOVE */
 
-            	printf("Current Keyround: \t");
+      	int val;
 
-            	for (int i = 0; i < sizeof(c_plaintext_block); ++i)
-                  	printf("%02x  ", ctx->keyround[i] & 0xFF);
+      	for (size_t c = 0; c < matrix_columns; ++c) {
+            	val = ctx->matrix.table[0][c];
+            	ctx->matrix.table[0][c] = ctx->matrix.table[2][c];
+            	ctx->matrix.table[2][c] = val;
+      	}
 
-            	putchar('\n');
-#endif
+      	for (size_t c = 0; c < matrix_columns; ++c) {
+            	val = ctx->matrix.table[1][c];
+            	ctx->matrix.table[1][c] = ctx->matrix.table[3][c];
+            	ctx->matrix.table[3][c] = val;
+      	}
 
-/* XOR CURRENT KEYROUND & "PLAINTEXT" MEMORY -> "PLAINTEXT" */
+      	for (size_t r = 0; r < matrix_rows; ++r) {
+            	val = ctx->matrix.table[r][0];
+            	ctx->matrix.table[r][0] = ctx->matrix.table[r][7];
+            	ctx->matrix.table[r][7] = val;
 
-            	if (!xor((unsigned char*)c_plaintext_block, sizeof(c_plaintext_block), ctx->keyround, AKUMA_KEY_LENGTH_BYTES, (unsigned char*)c_plaintext_block, sizeof(c_plaintext_block))) {
-                  	break;
-            	}
+            	val = ctx->matrix.table[r][1];
+            	ctx->matrix.table[r][1] = ctx->matrix.table[r][6];
+            	ctx->matrix.table[r][6] = val;
 
-#if AKUMA_DEBUG
-            	printf("XOR Block:\t\t");
+            	val = ctx->matrix.table[r][2];
+            	ctx->matrix.table[r][2] = ctx->matrix.table[r][5];
+            	ctx->matrix.table[r][5] = val;
 
-            	for (int i = 0; i < sizeof(c_plaintext_block); ++i)
-                  	printf("%02x  ", c_plaintext_block[i] & 0xFF);
+            	val = ctx->matrix.table[r][3];
+            	ctx->matrix.table[r][3] = ctx->matrix.table[r][4];
+            	ctx->matrix.table[r][4] = val;
+      	}
 
-            	putchar('\n');
-            	putchar('\n');
-#endif
+/* EXPORT ROTATED MATRIX TABLE INTO "CIPHERTEXT" MEMORY */
 
+      	for (size_t r = 0; r < matrix_rows; ++r) {
+            	for (size_t c = 0; c < matrix_columns; ++c) {
+                  	pos = c + (r * matrix_columns);
+                  	out[pos] = (unsigned char)ctx->matrix.table[r][c] & 0xFF;
+		}
+      	}
+}
 
-/* FILL MATRIX TABLE WITH RESULT */
+static void Akuma_DecryptBlock(Akuma_CTX * ctx, const unsigned char * block, unsigned char * out) {
+      	unsigned char c_ciphertext_block[AKUMA_BLOCK_SIZE_BYTES];
+      	size_t matrix_columns = ctx->matrix.columns;
+      	size_t matrix_rows = ctx->matrix.rows;
+      	size_t pos = 0;
 
-            	for (size_t r = 0; r < matrix_rows; ++r) {
-                  	for (size_t c = 0; c < matrix_columns; ++c) {
-                        	pos = c + (r * matrix_columns);
-                        	ctx->matrix.table[r][c] = (int)c_plaintext_block[pos];
-                        	ctx->keyround[pos] = c_plaintext_block[pos];
-                  	}
-            	}
+      	memcpy(c_ciphertext_block, block, sizeof(c_ciphertext_block));
 
-#if AKUMA_DEBUG
-            	printf("Current Matrix:\n");
-            	show_matrix(&ctx->matrix);
-            	putchar('\n');
-#endif
+      	for (size_t r = 0; r < matrix_rows; ++r) {
+            	for (size_t c = 0; c < matrix_columns; ++c) {
+                  	pos = c + (r * matrix_columns);
+                  	ctx->matrix.table[r][c] = (int)c_ciphertext_block[pos];
+		}
+      	}
 
-//R3
-//R4
 //R1
 //R2
+//R3
+//R4
 
-//SHIFT COLUMNS TO LEFT BY 1
-
-/* ROTATE MATRIX TABLE USING VALUES ABOVE */
+//SHIFT COLUMNS TO RIGHT BY 1
 
-            	int val;
+/* UNROTATE MATRIX TABLE USING VALUES ABOVE */
 
-            	for (size_t c = 0; c < matrix_columns; ++c) {
-                  	val = ctx->matrix.table[0][c];
-                  	ctx->matrix.table[0][c] = ctx->matrix.table[2][c];
-                  	ctx->matrix.table[2][c] = val;
-            	}
+      	int val;
 
-            	for (size_t c = 0; c < matrix_columns; ++c) {
-                  	val = ctx->matrix.table[1][c];
-                  	ctx->matrix.table[1][c] = ctx->matrix.table[3][c];
-                  	ctx->matrix.table[3][c] = val;
-            	}
+      	for (size_t c = 0; c < matrix_columns; ++c) {
+            	val = ctx->matrix.table[2][c];
+            	ctx->matrix.table[2][c] = ctx->matrix.table[0][c];
+            	ctx->matrix.table[0][c] = val;
+      	}
 
-            	for (size_t r = 0; r < matrix_rows; ++r) {
-                  	val = ctx->matrix.table[r][0];
-                  	ctx->matrix.table[r][0] = ctx->matrix.table[r][7];
-                  	ctx->matrix.table[r][7] = val;
+      	for (size_t c = 0; c < matrix_columns; ++c) {
+            	val = ctx->matrix.table[3][c];
+            	ctx->matrix.table[3][c] = ctx->matrix.table[1][c];
+            	ctx->matrix.table[1][c] = val;
+      	}
 
-                  	val = ctx->matrix.table[r][1];
-                  	ctx->matrix.table[r][1] = ctx->matrix.table[r][6];
-                  	ctx->matrix.table[r][6] = val;
+      	for (size_t r = 0; r < matrix_rows; ++r) {
+            	val = ctx->matrix.table[r][7];
+            	ctx->matrix.table[r][7] = ctx->matrix.table[r][0];
+            	ctx->matrix.table[r][0] = val;
 
-                  	val = ctx->matrix.table[r][2];
-                  	ctx->matrix.table[r][2] = ctx->matrix.table[r][5];
-                  	ctx->matrix.table[r][5] = val;
+            	val = ctx->matrix.table[r][6];
+            	ctx->matrix.table[r][6] = ctx->matrix.table[r][1];
+            	ctx->matrix.table[r][1] = val;
 
-                  	val = ctx->matrix.table[r][3];
-                  	ctx->matrix.table[r][3] = ctx->matrix.table[r][4];
-                  	ctx->matrix.table[r][4] = val;
-            	}
+            	val = ctx->matrix.table[r][5];
+            	ctx->matrix.table[r][5] = ctx->matrix.table[r][2];
+            	ctx->matrix.table[r][2] = val;
 
-#if AKUMA_DEBUG
-            	printf("Rotated Matrix:\n");
-            	show_matrix(&ctx->matrix);
-            	putchar('\n');
-#endif
+            	val = ctx->matrix.table[r][4];
+            	ctx->matrix.table[r][4] = ctx->matrix.table[r][3];
+            	ctx->matrix.table[r][3] = val;
+      	}
 
-/* EXPORT ROTATED MATRIX TABLE INTO "CIPHERTEXT" MEMORY */
+/* EXPORT UNROTATED MATRIX TABLE INTO "CIPHERTEXT" MEMORY */
 
-            	for (size_t r = 0; r < matrix_rows; ++r) {
-                  	for (size_t c = 0; c < matrix_columns; ++c) {
-                        	pos = c + (r * matrix_columns);
-                        	ctx->ciphertext[(block_size * e) + pos] = (unsigned char)ctx->matrix.table[r][c] & 0xFF;
-                        	ctx->ciphertext_len++;
-                  	}
-            	}
+      	for (size_t r = 0; r < matrix_rows; ++r) {
+            	for (size_t c = 0; c < matrix_columns; ++c) {
+                  	pos = c + (r * matrix_columns);
+                  	c_ciphertext_block[pos] = (unsigned char)ctx->matrix.table[r][c] & 0xFF;
+		}
       	}
 
-//      for (size_t i = 0; i < total_size; ++i) {
-//	  buf[i] = ctx->ciphertext[i];
-//      }
+/* XOR CURRENT KEYROUND & "PLAINTEXT" MEMORY -> "PLAINTEXT" */
 
-      	ctx->ciphertext[total_size] = '\0';
+      	xor(c_ciphertext_block, sizeof(c_ciphertext_block), ctx->keyround, AKUMA_KEY_LENGTH_BYTES, c_ciphertext_block, sizeof(c_ciphertext_block));
 
-/* RETURN BYTES WRITTEN */
-	return total_size;
+      	memcpy(out, c_ciphertext_block, sizeof(c_ciphertext_block));
+
+      	xor(ctx->keyround, sizeof(ctx->keyround), ctx->keyround, AKUMA_KEY_LENGTH_BYTES, c_ciphertext_block, sizeof(c_ciphertext_block));
 }
 
 
+/* BLOCK KERNELS
+ *
+ * THE MATRIX ROUND ABOVE IS A FIXED BYTE PERMUTATION: SWAPPING ROWS 0<->2 AND
+ * 1<->3 AND REVERSING THE COLUMNS MOVES BYTE i TO POSITION i ^ 0x17, WHICH IS
+ * ITS OWN INVERSE. ON x86 THAT IS A SWAP OF THE 16 BYTE HALVES AND ONE pshufb
+ * REVERSING EVERY 8 BYTE ROW, SO A WHOLE ROUND IS ONE SHUFFLE AND ONE XOR.
+ *
+ * EVERY ENGINE IS BYTE IDENTICAL TO Akuma_EncryptBlock()/Akuma_DecryptBlock().
+ * THE BEST ONE THE CPU SUPPORTS IS PICKED ON FIRST USE (SEE Akuma_Engine()),
+ * THE AKUMA_ENGINE ENVIRONMENT VARIABLE CAN FORCE scalar, ssse3, avx2 OR avx512.
+ */
+
+struct AkumaEngine {
+      	const char * name;
+      	void (*encrypt)(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb);
+      	void (*decrypt)(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb);
+      	void (*counter)(const unsigned char * mask, const unsigned char * in, unsigned char * out, size_t nmemb);	/* out = ROTATE(in) ^ mask */
+      	size_t (*base64_encode)(const unsigned char * in, size_t len, char * out, bool url);	/* RETURNS THE BYTES TAKEN, A MULTIPLE OF 3 */
+      	size_t (*base64_decode)(const char * in, size_t len, unsigned char * out);		/* RETURNS THE CHARACTERS TAKEN, A MULTIPLE OF 4 */
+};
 
+/* SCALAR ENGINE: THE ORIGINAL MATRIX CODE ON A PRIVATE CONTEXT */
 
-unsigned int Akuma_Decrypt(Akuma_CTX * ctx) {
-#if AKUMA_DEBUG
-    	printf("\n\n===== DECRYPTION =====\n\n");
-#endif
+static void encrypt_blocks_scalar(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	Akuma_CTX ctx;
 
-#if AKUMA_DEBUG
-        printf("Cipher Key:\t\t");
-        print_bytes(ctx->key, sizeof(ctx->key));
+      	ctx.matrix.rows = 4;
+      	ctx.matrix.columns = 8;
+      	memcpy(ctx.keyround, keyround, sizeof(ctx.keyround));
 
-        printf("Initialization Vector:\t");
-        print_bytes(ctx->iv, sizeof(ctx->iv));
+      	for (size_t e = 0; e < nmemb; ++e)
+            	Akuma_EncryptBlock(&ctx, in + (AKUMA_BLOCK_SIZE_BYTES * e), out + (AKUMA_BLOCK_SIZE_BYTES * e));
 
-        putchar('\n');
-#endif
-/* CHECK IV, KEY AND CIPHERTEXT EXIST IN STRUCT */
+      	memcpy(keyround, ctx.keyround, sizeof(ctx.keyround));
+}
 
-      	if (ctx->iv_len == 0 || ctx->key_len == 0 || ctx->ciphertext_len == 0)
-            	return -1;
+static void decrypt_blocks_scalar(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	Akuma_CTX ctx;
 
-/* XOR KEY & INITIALIZATION VECTOR FOR FIRST KEYROUND */
+      	ctx.matrix.rows = 4;
+      	ctx.matrix.columns = 8;
+      	memcpy(ctx.keyround, keyround, sizeof(ctx.keyround));
 
-      	if (!xor(ctx->keyround, sizeof(ctx->keyround), ctx->key, ctx->key_len, ctx->iv, ctx->iv_len))
-            	return -1;
+      	for (size_t d = 0; d < nmemb; ++d)
+            	Akuma_DecryptBlock(&ctx, in + (AKUMA_BLOCK_SIZE_BYTES * d), out + (AKUMA_BLOCK_SIZE_BYTES * d));
 
-      // static unsigned char rbox[256] = { 0x8e, 0xaa, 0x51, 0x13, 0x81, 0x30, 0x28, 0xb5, 0x82, 0x8a, 0x4f, 0x29, 0x6a, 0x06, 0xcd, 0xa6,
-      //                           0x54, 0xd7, 0xb7, 0x3f, 0x91, 0x1a, 0xfc, 0x7c, 0xac, 0x6d, 0x90, 0xb2, 0xc2, 0x25, 0xd8, 0x39,
-      //                           0x2e, 0x15, 0xf5, 0xfb, 0xfe, 0x68, 0x05, 0xa1, 0x6c, 0x97, 0x6f, 0x99, 0x26, 0x4a, 0x3e, 0x1e,
-      //                           0x9e, 0x61, 0xf6, 0x71, 0xb6, 0x2c, 0x36, 0xd9, 0xfd, 0xff, 0x44, 0xfa, 0x32, 0x55, 0x19, 0x35,
-      //                           0xb1, 0x48, 0xa7, 0xcb, 0xf3, 0xec, 0xa3, 0xf2, 0x5e, 0x4d, 0x09, 0x59, 0xce, 0x6b, 0xe0, 0xab,
-      //                           0xde, 0x7e, 0x69, 0x77, 0x85, 0x0e, 0xdc, 0x52, 0x9d, 0x62, 0x78, 0xbe, 0x8d, 0xd0, 0x2a, 0x1d,
-      //                           0xa8, 0xf7, 0x23, 0x86, 0x8f, 0x3d, 0xea, 0x9a, 0xad, 0xe9, 0x5d, 0x42, 0x66, 0x31, 0xe7, 0x7a,
-      //                           0x00, 0x72, 0xc7, 0x5f, 0x93, 0x34, 0x38, 0xda, 0xd6, 0xf9, 0x2b, 0xa2, 0x5a, 0xbc, 0x37, 0x94,
-      //                           0x11, 0x64, 0xb0, 0xbd, 0x4c, 0x20, 0x9f, 0x95, 0xb9, 0x3b, 0x02, 0xed, 0xa9, 0x47, 0x88, 0xe6,
-      //                           0x04, 0xd5, 0xdd, 0xee, 0xc1, 0x96, 0xe5, 0x14, 0x50, 0xeb, 0x84, 0x0a, 0x27, 0xd3, 0x56, 0x63,
-      //                           0x87, 0x16, 0xaf, 0x24, 0x8b, 0x83, 0x4b, 0x9c, 0x40, 0xd1, 0x22, 0x10, 0x2d, 0x5c, 0xc6, 0x45,
-      //                           0x03, 0x60, 0x65, 0x21, 0x6e, 0xe1, 0xf8, 0x33, 0xae, 0x70, 0x07, 0x57, 0x7f, 0x0d, 0x2f, 0x53,
-      //                           0xef, 0x76, 0x80, 0xb4, 0x0f, 0xdb, 0xf1, 0x79, 0xe2, 0x4e, 0x9b, 0xa4, 0xcc, 0x7d, 0x43, 0xbb,
-      //                           0xbf, 0xc9, 0x8c, 0x0c, 0xba, 0xc4, 0xc8, 0x08, 0xe4, 0xb3, 0x49, 0xe8, 0xf4, 0xb8, 0xd4, 0x12,
-      //                           0x98, 0x01, 0x5b, 0x17, 0x1b, 0xa0, 0x75, 0x7b, 0x89, 0xf0, 0x58, 0x41, 0x46, 0xc0, 0x67, 0x1c,
-      //                           0x74, 0xcf, 0xd2, 0x18, 0x3c, 0xe3, 0x3a, 0xc5, 0xdf, 0x1f, 0x0b, 0xca, 0xa5, 0xc3, 0x73, 0x92 };
+      	memcpy(keyround, ctx.keyround, sizeof(ctx.keyround));
+}
 
-/* INITIALIZE MATRIX TABLE */
+static void counter_blocks_scalar(const unsigned char * mask, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	Akuma_CTX ctx;
 
-      	for (size_t r = 0; r < ctx->matrix.rows; ++r) {
-	  	for (size_t c = 0; c < ctx->matrix.columns; ++c) {
-			ctx->matrix.table[r][c] = 022;
-	  	}
+      	ctx.matrix.rows = 4;
+      	ctx.matrix.columns = 8;
+
+      	for (size_t d = 0; d < nmemb; ++d) {
+            	memcpy(ctx.keyround, mask + (AKUMA_BLOCK_SIZE_BYTES * d), sizeof(ctx.keyround));
+            	Akuma_DecryptBlock(&ctx, in + (AKUMA_BLOCK_SIZE_BYTES * d), out + (AKUMA_BLOCK_SIZE_BYTES * d));
       	}
+}
 
-      	size_t ciphertext_len = (size_t)ctx->ciphertext_len;
-      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
-      	size_t nmemb = ciphertext_len / block_size;
-      	size_t total_size = ((sizeof(unsigned char) * AKUMA_BLOCK_SIZE_BYTES) * nmemb);
-      	size_t matrix_columns = ctx->matrix.columns;
-      	size_t matrix_rows = ctx->matrix.rows;
-      	size_t pos = 0;
+/* SCALAR BASE64: WHOLE GROUPS ONLY, THE STREAMING FUNCTIONS IN "BASE64" DO PADDING AND WHITESPACE */
 
-      	char c_ciphertext_block[AKUMA_BLOCK_SIZE_BYTES];
+static const char akuma_base64_alphabet[2][65] = {
+      	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+      	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+};
 
-      	ctx->plaintext = malloc(total_size);
+/* VALUE OF EVERY CHARACTER IN EITHER ALPHABET, -1 FOR ANYTHING ELSE */
+
+static const signed char akuma_base64_values[256] = {
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63,
+      	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+      	-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+      	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+      	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+      	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
 
+static size_t base64_encode_scalar(const unsigned char * in, size_t len, char * out, bool url) {
+      	const char * alphabet = akuma_base64_alphabet[url?1:0];
+      	size_t done = 0;
 
-      	for (int d = 0; d < nmemb; ++d) {
-	  	memset(c_ciphertext_block, '\0', sizeof(c_ciphertext_block));
-		memcpy(c_ciphertext_block, ctx->ciphertext + (block_size * d), sizeof(c_ciphertext_block));
+      	for (; len - done >= 3; done += 3, out += 4) {
+            	uint32_t w = ((uint32_t)in[done] << 16) | ((uint32_t)in[done + 1] << 8) | in[done + 2];
 
-#if AKUMA_DEBUG
-            	printf("\n\n\t\tBlock %d ~\n\n", d);
-            	printf("\nCurrent Block:  \t\t");
+            	out[0] = alphabet[(w >> 18) & 63];
+            	out[1] = alphabet[(w >> 12) & 63];
+            	out[2] = alphabet[(w >> 6) & 63];
+            	out[3] = alphabet[w & 63];
+      	}
 
-            	for (int i = 0; i < sizeof(c_ciphertext_block); ++i)
-			printf("%02x  ", c_ciphertext_block[i] & 0xFF);
-            	putchar('\n');
+      	return done;
+}
 
-            	printf("Current Ciphertext Keyround: \t");
+/* STOPS AT THE FIRST GROUP WITH A CHARACTER OUTSIDE THE ALPHABETS (PADDING, WHITESPACE, GARBAGE) */
 
-            	for (int i = 0; i < sizeof(c_ciphertext_block); ++i)
-			printf("%02x  ", ctx->keyround[i] & 0xFF);
+static size_t base64_decode_scalar(const char * in, size_t len, unsigned char * out) {
+      	size_t done = 0;
 
-            	putchar('\n');
-            	putchar('\n');
-#endif
+      	for (; len - done >= 4; done += 4, out += 3) {
+            	int a = akuma_base64_values[(unsigned char)in[done]];
+            	int b = akuma_base64_values[(unsigned char)in[done + 1]];
+            	int c = akuma_base64_values[(unsigned char)in[done + 2]];
+            	int d = akuma_base64_values[(unsigned char)in[done + 3]];
 
+            	if ((a | b | c | d) < 0)
+			break;
 
+            	uint32_t w = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
 
-            	for (size_t r = 0; r < matrix_rows; ++r) {
-                  	for (size_t c = 0; c < matrix_columns; ++c) {
-                        	pos = c + (r * matrix_columns);
-                        	ctx->matrix.table[r][c] = (int)c_ciphertext_block[pos];
-//                      	ctx->keyround[pos] = c_ciphertext_block[pos];
-                  	}
-            	}
+            	out[0] = (unsigned char)(w >> 16);
+            	out[1] = (unsigned char)(w >> 8);
+            	out[2] = (unsigned char)w;
+      	}
 
+      	return done;
+}
 
-#if AKUMA_DEBUG
-            	printf("Current Matrix:\n");
-            	show_matrix(&ctx->matrix);
-            	putchar('\n');
-#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AKUMA_X86 1
+#include <immintrin.h>
 
-//R1
-//R2
-//R3
-//R4
+/* SSSE3 ENGINE: ONE BLOCK IN TWO XMM REGISTERS */
 
-//SHIFT COLUMNS TO RIGHT BY 1
+__attribute__((target("ssse3")))
+static void encrypt_blocks_ssse3(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m128i rows = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+      	__m128i k_lo = _mm_loadu_si128((const __m128i *)keyround);
+      	__m128i k_hi = _mm_loadu_si128((const __m128i *)(keyround + 16));
 
-/* UNROTATE MATRIX TABLE USING VALUES ABOVE */
+      	for (size_t e = 0; e < nmemb; ++e, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES) {
+            	k_lo = _mm_xor_si128(k_lo, _mm_loadu_si128((const __m128i *)in));
+            	k_hi = _mm_xor_si128(k_hi, _mm_loadu_si128((const __m128i *)(in + 16)));
 
-            	int val;
+            	_mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(k_hi, rows));
+            	_mm_storeu_si128((__m128i *)(out + 16), _mm_shuffle_epi8(k_lo, rows));
+      	}
 
-            	for (size_t c = 0; c < matrix_columns; ++c) {
-                  	val = ctx->matrix.table[2][c];
-                  	ctx->matrix.table[2][c] = ctx->matrix.table[0][c];
-                  	ctx->matrix.table[0][c] = val;
-            	}
+      	_mm_storeu_si128((__m128i *)keyround, k_lo);
+      	_mm_storeu_si128((__m128i *)(keyround + 16), k_hi);
+}
 
-            	for (size_t c = 0; c < matrix_columns; ++c) {
-                  	val = ctx->matrix.table[3][c];
-                  	ctx->matrix.table[3][c] = ctx->matrix.table[1][c];
-                  	ctx->matrix.table[1][c] = val;
-            	}
+__attribute__((target("ssse3")))
+static void decrypt_blocks_ssse3(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m128i rows = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+      	__m128i k_lo = _mm_loadu_si128((const __m128i *)keyround);
+      	__m128i k_hi = _mm_loadu_si128((const __m128i *)(keyround + 16));
 
-            	for (size_t r = 0; r < matrix_rows; ++r) {
-                  	val = ctx->matrix.table[r][7];
-                  	ctx->matrix.table[r][7] = ctx->matrix.table[r][0];
-                  	ctx->matrix.table[r][0] = val;
+      	for (size_t d = 0; d < nmemb; ++d, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES) {
+            	__m128i x_lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), rows);
+            	__m128i x_hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), rows);
 
-                  	val = ctx->matrix.table[r][6];
-                  	ctx->matrix.table[r][6] = ctx->matrix.table[r][1];
-                  	ctx->matrix.table[r][1] = val;
+            	_mm_storeu_si128((__m128i *)out, _mm_xor_si128(x_lo, k_lo));
+            	_mm_storeu_si128((__m128i *)(out + 16), _mm_xor_si128(x_hi, k_hi));
 
-                  	val = ctx->matrix.table[r][5];
-                  	ctx->matrix.table[r][5] = ctx->matrix.table[r][2];
-                  	ctx->matrix.table[r][2] = val;
+            	k_lo = x_lo;
+            	k_hi = x_hi;
+      	}
 
-                  	val = ctx->matrix.table[r][4];
-                  	ctx->matrix.table[r][4] = ctx->matrix.table[r][3];
-                  	ctx->matrix.table[r][3] = val;
-            	}
+      	_mm_storeu_si128((__m128i *)keyround, k_lo);
+      	_mm_storeu_si128((__m128i *)(keyround + 16), k_hi);
+}
 
+__attribute__((target("ssse3")))
+static void counter_blocks_ssse3(const unsigned char * mask, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m128i rows = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
 
+      	for (size_t d = 0; d < nmemb; ++d, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES, mask += AKUMA_BLOCK_SIZE_BYTES) {
+            	__m128i x_lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), rows);
+            	__m128i x_hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), rows);
 
+            	_mm_storeu_si128((__m128i *)out, _mm_xor_si128(x_lo, _mm_loadu_si128((const __m128i *)mask)));
+            	_mm_storeu_si128((__m128i *)(out + 16), _mm_xor_si128(x_hi, _mm_loadu_si128((const __m128i *)(mask + 16))));
+      	}
+}
 
-#if AKUMA_DEBUG
-            	printf("Unrotated Matrix:\n");
-            	show_matrix(&ctx->matrix);
-            	putchar('\n');
-#endif
+/* AVX2 ENGINE: ONE BLOCK PER YMM REGISTER */
 
+__attribute__((target("avx2")))
+static void encrypt_blocks_avx2(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m256i rows = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                              	      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+      	__m256i k = _mm256_loadu_si256((const __m256i *)keyround);
 
+      	for (size_t e = 0; e < nmemb; ++e, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES) {
+            	k = _mm256_xor_si256(k, _mm256_loadu_si256((const __m256i *)in));
+            	_mm256_storeu_si256((__m256i *)out, _mm256_shuffle_epi8(_mm256_permute4x64_epi64(k, 0x4E), rows));
+      	}
 
-/* EXPORT UNROTATED MATRIX TABLE INTO "CIPHERTEXT" MEMORY */
+      	_mm256_storeu_si256((__m256i *)keyround, k);
+}
 
-            	for (size_t r = 0; r < matrix_rows; ++r) {
-                  	for (size_t c = 0; c < matrix_columns; ++c) {
-                        	pos = c + (r * matrix_columns);
-                        	c_ciphertext_block[pos] = (unsigned char)ctx->matrix.table[r][c] & 0xFF;
-                  	}
-            	}
+__attribute__((target("avx2")))
+static void decrypt_blocks_avx2(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m256i rows = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                              	      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+      	__m256i k = _mm256_loadu_si256((const __m256i *)keyround);
 
+      	for (size_t d = 0; d < nmemb; ++d, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES) {
+            	__m256i x = _mm256_shuffle_epi8(_mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)in), 0x4E), rows);
 
-/* XOR CURRENT KEYROUND & "PLAINTEXT" MEMORY -> "PLAINTEXT" */
+            	_mm256_storeu_si256((__m256i *)out, _mm256_xor_si256(x, k));
+            	k = x;
+      	}
 
-            	if (!xor((unsigned char*)c_ciphertext_block, sizeof(c_ciphertext_block), ctx->keyround, AKUMA_KEY_LENGTH_BYTES, (unsigned char*)c_ciphertext_block, sizeof(c_ciphertext_block))) {
-                  	break;
-            	}
+      	_mm256_storeu_si256((__m256i *)keyround, k);
+}
 
-#if AKUMA_DEBUG
-            	printf("De-Ciphered text Block:\t\t");
-	    	print_bytes((unsigned char*)c_ciphertext_block, sizeof(c_ciphertext_block));
-            	putchar('\n');
-#endif
+__attribute__((target("avx2")))
+static void counter_blocks_avx2(const unsigned char * mask, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m256i rows = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                              	      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
 
-	  	for (size_t i = 0; i < block_size; ++i) {
-			ctx->plaintext_len++;
-			ctx->plaintext[i + (block_size * d)] = c_ciphertext_block[i];
-	  	}
+      	for (size_t d = 0; d < nmemb; ++d, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES, mask += AKUMA_BLOCK_SIZE_BYTES) {
+            	__m256i x = _mm256_shuffle_epi8(_mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)in), 0x4E), rows);
 
-          	if (!xor(ctx->keyround, sizeof(ctx->keyround), ctx->keyround, AKUMA_KEY_LENGTH_BYTES, (unsigned char*)c_ciphertext_block, sizeof(c_ciphertext_block))) {
-			break;
-		}
+            	_mm256_storeu_si256((__m256i *)out, _mm256_xor_si256(x, _mm256_loadu_si256((const __m256i *)mask)));
+      	}
+}
 
+/* AVX-512 ENGINE: TWO BLOCKS PER ZMM REGISTER
+ *
+ * DECRYPTION: THE KEYROUNDS OF A PAIR ARE THE PREVIOUS PAIR'S UPPER BLOCK AND
+ * THIS PAIR'S LOWER BLOCK, ONE LANE SHUFFLE ACROSS THE TWO REGISTERS.
+ *
+ * ENCRYPTION: THE PAIR NEEDS { k ^ p0, k ^ p0 ^ p1 }. THE PREFIX XOR OF THE
+ * PLAINTEXT IS COMPUTED OFF THE CHAIN AND THE KEYROUND IS KEPT BROADCAST IN
+ * BOTH HALVES, SO THE SERIAL DEPENDENCY IS ONE XOR PER TWO BLOCKS.
+ */
+
+__attribute__((target("avx512f,avx512bw")))
+static void encrypt_blocks_avx512(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m512i rows = _mm512_broadcast_i32x4(_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+      	__m512i k = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i *)keyround));
+      	size_t e = 0;
+
+      	for (; e + 2 <= nmemb; e += 2, in += 2 * AKUMA_BLOCK_SIZE_BYTES, out += 2 * AKUMA_BLOCK_SIZE_BYTES) {
+            	__m512i p = _mm512_loadu_si512((const void *)in);
+
+            	/* { p0, p1 } -> { p0, p0 ^ p1 } */
+            	p = _mm512_xor_si512(p, _mm512_maskz_shuffle_i64x2(0xF0, p, p, 0x44));
+
+            	__m512i x = _mm512_xor_si512(k, p);
+
+            	k = _mm512_xor_si512(k, _mm512_shuffle_i64x2(p, p, 0xEE));
+            	_mm512_storeu_si512((void *)out, _mm512_shuffle_epi8(_mm512_shuffle_i64x2(x, x, 0xB1), rows));
       	}
 
-/* REVERSE PKCS#7 PADDING ON LAST BLOCK OF PLAITEXT */
+      	_mm256_storeu_si256((__m256i *)keyround, _mm512_castsi512_si256(k));
 
-	int p = (int)ctx->plaintext[ctx->plaintext_len - 1];
+      	if (e < nmemb)
+            	encrypt_blocks_avx2(keyround, in, out, nmemb - e);
+}
 
-	ctx->plaintext[ctx->plaintext_len - p] = '\0';
-	ctx->plaintext_len = ctx->plaintext_len - p;
+__attribute__((target("avx512f,avx512bw")))
+static void decrypt_blocks_avx512(unsigned char * keyround, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m512i rows = _mm512_broadcast_i32x4(_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+      	__m512i prev = _mm512_setzero_si512();
+      	size_t d = 0;
 
+      	/* THE KEYROUND SITS IN THE UPPER BLOCK OF prev, AS IF IT WERE THE LAST PAIR */
+      	prev = _mm512_inserti64x4(prev, _mm256_loadu_si256((const __m256i *)keyround), 1);
 
-	return ctx->plaintext_len;
+      	for (; d + 2 <= nmemb; d += 2, in += 2 * AKUMA_BLOCK_SIZE_BYTES, out += 2 * AKUMA_BLOCK_SIZE_BYTES) {
+            	__m512i c = _mm512_loadu_si512((const void *)in);
+            	__m512i x = _mm512_shuffle_epi8(_mm512_shuffle_i64x2(c, c, 0xB1), rows);
+
+            	_mm512_storeu_si512((void *)out, _mm512_xor_si512(x, _mm512_shuffle_i64x2(prev, x, 0x4E)));
+            	prev = x;
+      	}
+
+      	_mm256_storeu_si256((__m256i *)keyround, _mm512_extracti64x4_epi64(prev, 1));
+
+      	if (d < nmemb)
+            	decrypt_blocks_avx2(keyround, in, out, nmemb - d);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void counter_blocks_avx512(const unsigned char * mask, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	const __m512i rows = _mm512_broadcast_i32x4(_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+      	size_t d = 0;
+
+      	for (; d + 2 <= nmemb; d += 2, in += 2 * AKUMA_BLOCK_SIZE_BYTES, out += 2 * AKUMA_BLOCK_SIZE_BYTES, mask += 2 * AKUMA_BLOCK_SIZE_BYTES) {
+            	__m512i c = _mm512_loadu_si512((const void *)in);
+            	__m512i x = _mm512_shuffle_epi8(_mm512_shuffle_i64x2(c, c, 0xB1), rows);
+
+            	_mm512_storeu_si512((void *)out, _mm512_xor_si512(x, _mm512_loadu_si512((const void *)mask)));
+      	}
+
+      	if (d < nmemb)
+            	counter_blocks_avx2(mask, in, out, nmemb - d);
+}
+
+/* SSSE3 BASE64, 12 BYTES <-> 16 CHARACTERS PER STEP
+ *
+ * ENCODING SPREADS EACH 3 BYTES OVER 4 BYTES WITH ONE SHUFFLE, CUTS THEM INTO
+ * 6 BIT INDICES WITH TWO MULTIPLIES AND TURNS THE INDICES INTO CHARACTERS WITH A
+ * 16 ENTRY TABLE OF OFFSETS, PICKED BY RANGE (A-Z, a-z, 0-9, 62, 63).
+ * DECODING MAPS '-' AND '_' ONTO '+' AND '/', CHECKS EVERY CHARACTER AGAINST TWO
+ * NIBBLE TABLES, ADDS THE OFFSET OF ITS RANGE AND PACKS FOUR 6 BIT VALUES BACK
+ * INTO 3 BYTES WITH TWO MULTIPLY-ADDS. A STEP WITH ANY OTHER CHARACTER IS LEFT TO
+ * THE SCALAR CODE. NEITHER READS NOR WRITES PAST ITS BUFFERS.
+ */
+
+__attribute__((target("ssse3")))
+static __m128i base64_indices_ssse3(__m128i x) {
+      	__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+      	__m128i t1 = _mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+
+      	return _mm_or_si128(t0, t1);
+}
+
+__attribute__((target("ssse3")))
+static __m128i base64_chars_ssse3(__m128i idx, __m128i offsets) {
+      	__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+
+      	r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+
+      	return _mm_add_epi8(_mm_shuffle_epi8(offsets, r), idx);
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(const unsigned char * in, size_t len, char * out, bool url) {
+      	const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+      	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                  	url?('-' - 62):('+' - 62), url?('_' - 63):('/' - 63), 'A', 0, 0);
+      	size_t done = 0;
+
+      	for (; len - done >= 16; done += 12, out += 16) {
+            	__m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + done)), spread);
+
+            	_mm_storeu_si128((__m128i *)out, base64_chars_ssse3(base64_indices_ssse3(x), offsets));
+      	}
+
+      	return done + base64_encode_scalar(in + done, len - done, out, url);
+}
+
+__attribute__((target("ssse3")))
+static __m128i base64_values_ssse3(__m128i x, bool * valid) {
+      	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+      	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+      	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+      	x = _mm_add_epi8(x, _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('-')), _mm_set1_epi8('+' - '-')));
+      	x = _mm_add_epi8(x, _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('_')), _mm_set1_epi8('/' - '_')));
+
+      	__m128i hi = _mm_and_si128(_mm_srli_epi32(x, 4), nibble);
+      	__m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, _mm_and_si128(x, nibble)), _mm_shuffle_epi8(lut_hi, hi));
+
+      	*valid = (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) == 0xFFFF);
+
+      	__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('/')), hi));
+
+      	return _mm_add_epi8(x, roll);
+}
+
+__attribute__((target("ssse3")))
+static __m128i base64_pack_ssse3(__m128i v) {
+      	v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+      	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+
+      	return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(const char * in, size_t len, unsigned char * out) {
+      	size_t done = 0;
+      	bool valid;
+
+      	for (; len - done >= 16; done += 16, out += 12) {
+            	__m128i v = base64_values_ssse3(_mm_loadu_si128((const __m128i *)(in + done)), &valid);
+
+            	if (!valid)
+			break;
+
+            	__m128i bytes = base64_pack_ssse3(v);
+            	uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+
+            	_mm_storel_epi64((__m128i *)out, bytes);
+            	memcpy(out + 8, &tail, sizeof(tail));
+      	}
+
+      	return done + base64_decode_scalar(in + done, len - done, out);
+}
+
+/* AVX2 BASE64: THE SSSE3 STEPS ON BOTH 128 BIT LANES, 24 BYTES <-> 32 CHARACTERS */
+
+__attribute__((target("avx2")))
+static size_t base64_encode_avx2(const unsigned char * in, size_t len, char * out, bool url) {
+      	const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                    	1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+      	const __m256i offsets = _mm256_broadcastsi128_si256(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                  	url?('-' - 62):('+' - 62), url?('_' - 63):('/' - 63), 'A', 0, 0));
+      	size_t done = 0;
+
+      	for (; len - done >= 28; done += 24, out += 32) {
+            	__m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + done))), _mm_loadu_si128((const __m128i *)(in + done + 12)), 1);
+
+            	x = _mm256_shuffle_epi8(x, spread);
+
+            	__m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            	__m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            	__m256i idx = _mm256_or_si256(t0, t1);
+            	__m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+
+            	r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+            	_mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(_mm256_shuffle_epi8(offsets, r), idx));
+      	}
+
+      	return done + base64_encode_ssse3(in + done, len - done, out, url);
+}
+
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(const char * in, size_t len, unsigned char * out) {
+      	const __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+      	const __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+      	const __m256i lut_roll = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+      	const __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+      	const __m256i nibble = _mm256_set1_epi8(0x0f);
+      	size_t done = 0;
+
+      	for (; len - done >= 32; done += 32, out += 24) {
+            	__m256i x = _mm256_loadu_si256((const __m256i *)(in + done));
+
+            	x = _mm256_add_epi8(x, _mm256_and_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('-')), _mm256_set1_epi8('+' - '-')));
+            	x = _mm256_add_epi8(x, _mm256_and_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')), _mm256_set1_epi8('/' - '_')));
+
+            	__m256i hi = _mm256_and_si256(_mm256_srli_epi32(x, 4), nibble);
+
+            	if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, _mm256_and_si256(x, nibble)), _mm256_shuffle_epi8(lut_hi, hi)))
+			break;
+
+            	x = _mm256_add_epi8(x, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('/')), hi)));
+            	x = _mm256_maddubs_epi16(x, _mm256_set1_epi32(0x01400140));
+            	x = _mm256_madd_epi16(x, _mm256_set1_epi32(0x00011000));
+            	x = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, pack), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+            	_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(x));
+            	_mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(x, 1));
+      	}
+
+      	return done + base64_decode_ssse3(in + done, len - done, out);
+}
+#endif
+
+static const struct AkumaEngine akuma_engines[] = {
+      	{ "scalar", encrypt_blocks_scalar, decrypt_blocks_scalar, counter_blocks_scalar, base64_encode_scalar, base64_decode_scalar },
+#ifdef AKUMA_X86
+      	{ "ssse3",  encrypt_blocks_ssse3,  decrypt_blocks_ssse3,  counter_blocks_ssse3,  base64_encode_ssse3,  base64_decode_ssse3  },
+      	{ "avx2",   encrypt_blocks_avx2,   decrypt_blocks_avx2,   counter_blocks_avx2,   base64_encode_avx2,   base64_decode_avx2   },
+      	{ "avx512", encrypt_blocks_avx512, decrypt_blocks_avx512, counter_blocks_avx512, base64_encode_avx2,   base64_decode_avx2   },
+#endif
+};
+
+static const struct AkumaEngine * akuma_engine = NULL;
+static pthread_once_t akuma_engine_once = PTHREAD_ONCE_INIT;
+
+static bool engine_supported(const struct AkumaEngine * engine) {
+#ifdef AKUMA_X86
+      	__builtin_cpu_init();
+
+      	if (strcmp(engine->name, "ssse3") == 0)
+            	return __builtin_cpu_supports("ssse3");
+
+      	if (strcmp(engine->name, "avx2") == 0)
+            	return __builtin_cpu_supports("avx2");
+
+      	if (strcmp(engine->name, "avx512") == 0)
+            	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+      	return true;
+}
+
+static void select_engine(void) {
+      	size_t count = sizeof(akuma_engines) / sizeof(akuma_engines[0]);
+      	const char * forced = getenv("AKUMA_ENGINE");
+
+/* AN UNKNOWN OR UNSUPPORTED AKUMA_ENGINE FALLS BACK TO THE AUTOMATIC CHOICE */
+
+      	if (forced != NULL) {
+            	for (size_t i = 0; i < count; ++i) {
+                  	if (strcmp(forced, akuma_engines[i].name) == 0 && engine_supported(&akuma_engines[i])) {
+                        	akuma_engine = &akuma_engines[i];
+                        	return;
+			}
+		}
+      	}
+
+/* OTHERWISE THE LAST (WIDEST) ENGINE THE CPU SUPPORTS */
+
+      	for (size_t i = count; i-- > 0;) {
+            	if (engine_supported(&akuma_engines[i])) {
+                  	akuma_engine = &akuma_engines[i];
+                  	return;
+		}
+      	}
+}
+
+static const struct AkumaEngine * get_engine(void) {
+      	pthread_once(&akuma_engine_once, select_engine);
+
+      	return akuma_engine;
+}
+
+/* NAME OF THE BLOCK ENGINE IN USE: "scalar", "ssse3", "avx2" OR "avx512" */
+
+const char * Akuma_Engine(void) {
+      	return get_engine()->name;
+}
+
+/* RUN nmemb WHOLE BLOCKS THROUGH THE SELECTED ENGINE */
+
+static void encrypt_blocks(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	get_engine()->encrypt(s->keyround, in, out, nmemb);
+}
+
+static void decrypt_blocks(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t nmemb) {
+      	get_engine()->decrypt(s->keyround, in, out, nmemb);
+}
+
+
+/* COUNTER MODE
+ *
+ * IN AKUMA_MODE_CTR THE KEYROUND OF BLOCK n DOES NOT COME FROM THE PREVIOUS
+ * BLOCK BUT FROM AN AES-256-CTR KEYSTREAM UNDER THE MESSAGE KEY SHA-256(KEY || IV):
+ *
+ *   keyround(n) = AES(2n) || AES(2n + 1)	(128 BIT BIG ENDIAN COUNTERS)
+ *
+ * A BLOCK IS STILL XORED WITH ITS KEYROUND AND ROTATED, BUT EVERY BLOCK IS
+ * INDEPENDENT, SO ENCRYPTION CAN BE SPLIT OVER THREADS LIKE DECRYPTION.
+ * A SHORT LAST BLOCK IS ONLY XORED WITH ITS KEYROUND, SO NO PADDING IS NEEDED
+ * AND THE CIPHERTEXT IS EXACTLY AS LONG AS THE PLAINTEXT.
+ *
+ * ONE SHA-256 PER MESSAGE SETS UP THE KEY, AFTER THAT A KEYROUND IS TWO AES
+ * BLOCKS. WITH AES-NI EIGHT OF THEM ARE IN FLIGHT AT ONCE AND THE KEYSTREAM
+ * COSTS LESS THAN A CYCLE PER BYTE. OTHER CPUS, AND AKUMA_ENGINE=scalar, RUN
+ * OPENSSL'S EVP AES-256-CTR (WHATEVER AES UNIT THE CPU HAS) FOR THE SAME KEYROUNDS.
+ * EACH THREAD KEEPS ONE EVP CONTEXT AND ONLY SETS IT UP AGAIN WHEN A MESSAGE
+ * WITH ANOTHER KEY COMES ALONG, SO A BATCH OF 64 KEYROUNDS JUST LOADS A COUNTER.
+ * THE STREAM ITSELF STAYS A PLAIN VALUE THAT WORKERS COPY AND NOTHING FREES.
+ * IF OPENSSL FAILS THE CALL FAILS, SEE THE RETURN VALUES OF THE CALLERS.
+ *
+ * ROTATE(p ^ k) == ROTATE(p) ^ ROTATE(k), SO BOTH DIRECTIONS RUN THROUGH THE
+ * ENGINE'S counter KERNEL (out = ROTATE(in) ^ mask) AND ENCRYPTION JUST USES
+ * THE ROTATED KEYROUND AS THE MASK.
+ */
+
+#ifdef AKUMA_X86
+#define AKUMA_AES_EXPAND(r, t1, t3, rcon) do {								\
+      	__m128i a = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(t3, rcon), 0xff);			\
+      	t1 = _mm_xor_si128(t1, _mm_slli_si128(t1, 4));							\
+      	t1 = _mm_xor_si128(t1, _mm_slli_si128(t1, 8));							\
+      	r[0] = t1 = _mm_xor_si128(t1, a);								\
+      	a = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(t1, 0), 0xaa);					\
+      	t3 = _mm_xor_si128(t3, _mm_slli_si128(t3, 4));							\
+      	t3 = _mm_xor_si128(t3, _mm_slli_si128(t3, 8));							\
+      	r[1] = t3 = _mm_xor_si128(t3, a);								\
+} while (0)
+
+__attribute__((target("aes,ssse3")))
+static void ctr_expand_aesni(struct AkumaCounterKey * ck, const unsigned char * key) {
+      	__m128i r[16];
+      	__m128i t1 = _mm_loadu_si128((const __m128i *)key);
+      	__m128i t3 = _mm_loadu_si128((const __m128i *)(key + 16));
+
+      	r[0] = t1;
+      	r[1] = t3;
+
+      	AKUMA_AES_EXPAND((r + 2), t1, t3, 0x01);
+      	AKUMA_AES_EXPAND((r + 4), t1, t3, 0x02);
+      	AKUMA_AES_EXPAND((r + 6), t1, t3, 0x04);
+      	AKUMA_AES_EXPAND((r + 8), t1, t3, 0x08);
+      	AKUMA_AES_EXPAND((r + 10), t1, t3, 0x10);
+      	AKUMA_AES_EXPAND((r + 12), t1, t3, 0x20);
+      	AKUMA_AES_EXPAND((r + 14), t1, t3, 0x40);	/* r[15] IS NOT A ROUND KEY */
+
+      	for (int i = 0; i < 15; ++i)
+            	_mm_storeu_si128((__m128i *)ck->rounds.aesni[i], r[i]);
+
+      	OPENSSL_cleanse(r, sizeof(r));
+}
+
+/* nmemb KEYROUNDS FROM BLOCK counter ON, FOUR (EIGHT AES BLOCKS) AT A TIME */
+
+__attribute__((target("aes,ssse3")))
+static void ctr_keyrounds_aesni(const struct AkumaCounterKey * ck, uint64_t counter, unsigned char * out, size_t nmemb, bool rotated) {
+      	const __m128i rows = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+      	__m128i r[15];
+
+      	for (int i = 0; i < 15; ++i)
+            	r[i] = _mm_loadu_si128((const __m128i *)ck->rounds.aesni[i]);
+
+      	while (nmemb > 0) {
+            	size_t n = (nmemb < 4)?nmemb:4;
+            	__m128i x[8];
+
+            	for (size_t b = 0; b < 2 * n; ++b)
+                  	x[b] = _mm_xor_si128(_mm_set_epi64x((long long)__builtin_bswap64(2 * counter + b), 0), r[0]);
+
+            	for (int i = 1; i < 14; ++i) {
+                  	for (size_t b = 0; b < 2 * n; ++b)
+                        	x[b] = _mm_aesenc_si128(x[b], r[i]);
+		}
+
+            	for (size_t b = 0; b < n; ++b, out += AKUMA_BLOCK_SIZE_BYTES) {
+                  	__m128i lo = _mm_aesenclast_si128(x[2 * b], r[14]);
+                  	__m128i hi = _mm_aesenclast_si128(x[2 * b + 1], r[14]);
+
+/* ROTATED: BYTE i TAKES BYTE i ^ 0x17, THE HALVES SWAPPED AND EACH 8 BYTE ROW REVERSED */
+
+                  	_mm_storeu_si128((__m128i *)out, rotated?_mm_shuffle_epi8(hi, rows):lo);
+                  	_mm_storeu_si128((__m128i *)(out + 16), rotated?_mm_shuffle_epi8(lo, rows):hi);
+		}
+
+            	counter += n;
+            	nmemb -= n;
+      	}
+}
+#endif
+
+static bool akuma_aesni = false;
+static pthread_once_t akuma_aesni_once = PTHREAD_ONCE_INIT;
+
+static void select_aesni(void) {
+#ifdef AKUMA_X86
+      	akuma_aesni = (strcmp(get_engine()->name, "scalar") != 0 && __builtin_cpu_supports("aes"));
+#endif
+}
+
+static void ctr_init(Akuma_Stream * s, const unsigned char * iv) {
+      	SHA256_CTX sha = s->key->key_base;
+      	unsigned char key[SHA256_DIGEST_LENGTH];
+
+      	SHA256_Update(&sha, iv, AKUMA_IV_LENGTH_BYTES);
+      	SHA256_Final(key, &sha);
+
+      	pthread_once(&akuma_aesni_once, select_aesni);
+      	s->counter_key.aesni = akuma_aesni;
+
+#ifdef AKUMA_X86
+      	if (akuma_aesni)
+            	ctr_expand_aesni(&s->counter_key, key);
+      	else
+#endif
+            	memcpy(s->counter_key.rounds.key, key, sizeof(key));
+
+      	OPENSSL_cleanse(key, sizeof(key));
+      	OPENSSL_cleanse(&sha, sizeof(sha));
+
+      	s->counter = 0;
+}
+
+/* THE CALLING THREAD'S EVP CONTEXT FOR THE PORTABLE PATH, WIPED WHEN THE THREAD EXITS */
+
+struct AkumaCounterEVP {
+      	EVP_CIPHER_CTX * aes;
+      	unsigned char key[32];	/* THE KEY aes IS SET UP WITH */
+      	bool keyed;
+};
+
+static __thread struct AkumaCounterEVP akuma_ctr_evp;
+static pthread_once_t akuma_ctr_once = PTHREAD_ONCE_INIT;
+static pthread_key_t akuma_ctr_key;
+
+static void ctr_evp_free(void * arg) {
+      	struct AkumaCounterEVP * c = (struct AkumaCounterEVP *)arg;
+
+      	EVP_CIPHER_CTX_free(c->aes);
+      	OPENSSL_cleanse(c, sizeof(*c));
+}
+
+static void ctr_evp_setup(void) {
+      	pthread_key_create(&akuma_ctr_key, ctr_evp_free);
+}
+
+static bool ctr_keyrounds(const Akuma_Stream * s, uint64_t counter, unsigned char * keyround, size_t nmemb, bool rotated) {
+#ifdef AKUMA_X86
+      	if (s->counter_key.aesni) {
+            	ctr_keyrounds_aesni(&s->counter_key, counter, keyround, nmemb, rotated);
+            	return true;
+      	}
+#endif
+      	struct AkumaCounterEVP * c = &akuma_ctr_evp;
+      	const unsigned char * key = s->counter_key.rounds.key;
+      	unsigned char start[16];
+      	int len;
+
+      	if (c->aes == NULL) {
+            	pthread_once(&akuma_ctr_once, ctr_evp_setup);
+
+            	if ((c->aes = EVP_CIPHER_CTX_new()) == NULL)
+                  	return false;
+
+            	pthread_setspecific(akuma_ctr_key, c);
+      	}
+
+      	memset(start, 0, sizeof(start));
+      	memset(keyround, 0, AKUMA_BLOCK_SIZE_BYTES * nmemb);
+
+      	for (int i = 0; i < 8; ++i)
+            	start[15 - i] = (unsigned char)((2 * counter) >> (8 * i));
+
+/* THE KEY SCHEDULE ONLY WHEN THE KEY CHANGES, OTHERWISE JUST THE COUNTER */
+
+      	if (!c->keyed || CRYPTO_memcmp(c->key, key, sizeof(c->key)) != 0) {
+            	c->keyed = false;
+
+            	if (!EVP_EncryptInit_ex(c->aes, EVP_aes_256_ctr(), NULL, key, start))
+                  	return false;
+
+            	memcpy(c->key, key, sizeof(c->key));
+            	c->keyed = true;
+      	} else if (!EVP_EncryptInit_ex(c->aes, NULL, NULL, NULL, start)) {
+            	return false;
+      	}
+
+      	if (!EVP_EncryptUpdate(c->aes, keyround, &len, keyround, (int)(AKUMA_BLOCK_SIZE_BYTES * nmemb))) {
+            	OPENSSL_cleanse(keyround, AKUMA_BLOCK_SIZE_BYTES * nmemb);
+            	return false;
+      	}
+
+/* ROTATED: BYTE i TAKES BYTE i ^ 0x17, ROWS 0<->2 AND 1<->3 SWAPPED AND EACH ONE bswap'D */
+
+      	for (size_t b = 0; rotated && b < nmemb; ++b, keyround += AKUMA_BLOCK_SIZE_BYTES) {
+            	uint64_t row[4];
+
+            	memcpy(row, keyround, sizeof(row));
+
+            	for (int i = 0; i < 4; ++i)
+                  	row[i] = __builtin_bswap64(row[i]);
+
+            	memcpy(keyround, row + 2, 16);
+            	memcpy(keyround + 16, row, 16);
+      	}
+
+      	return true;
+}
+
+static bool ctr_blocks(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t nmemb, bool encrypt) {
+      	unsigned char mask[AKUMA_BLOCK_SIZE_BYTES * AKUMA_CTR_BATCH];
+
+      	while (nmemb > 0) {
+            	size_t n = (nmemb < AKUMA_CTR_BATCH)?nmemb:AKUMA_CTR_BATCH;
+
+            	if (!ctr_keyrounds(s, s->counter, mask, n, encrypt))
+                  	return false;
+
+            	get_engine()->counter(mask, in, out, n);
+
+            	s->counter += n;
+            	in += AKUMA_BLOCK_SIZE_BYTES * n;
+            	out += AKUMA_BLOCK_SIZE_BYTES * n;
+            	nmemb -= n;
+      	}
+
+      	return true;
+}
+
+/* SHORT LAST BLOCK: XOR ONLY, THE SAME IN BOTH DIRECTIONS */
+
+static bool ctr_tail(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t len) {
+      	unsigned char keyround[AKUMA_BLOCK_SIZE_BYTES];
+
+      	if (len == 0)
+            	return true;
+
+      	if (!ctr_keyrounds(s, s->counter++, keyround, 1, false))
+            	return false;
+
+      	for (size_t i = 0; i < len; ++i)
+            	out[i] = in[i] ^ keyround[i];
+
+      	return true;
+}
+
+/* SERIAL WHOLE BLOCKS IN THE KEY'S MODE, false ONLY WHEN COUNTER MODE GOT NO KEYSTREAM */
+
+static bool crypt_blocks(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t nmemb, bool encrypt) {
+      	if (s->key->mode == AKUMA_MODE_CTR)
+            	return ctr_blocks(s, in, out, nmemb, encrypt);
+
+      	if (encrypt)
+            	encrypt_blocks(s, in, out, nmemb);
+      	else
+            	decrypt_blocks(s, in, out, nmemb);
+
+      	return true;
+}
+
+
+/* STATISTICS AND TRACING
+ *
+ * EVERY MESSAGE STARTED, ENGINE CALL (WHOLE BLOCKS OR A COUNTER MODE TAIL) AND MAC
+ * UPDATE IS COUNTED ONCE, ON THE THREAD THAT ISSUED IT: IN THAT THREAD'S OWN SHARE
+ * OF THE GLOBAL COUNTERS AND, FOR A STREAM OF AN Akuma_CTX OR A BATCH, IN ITS OWN
+ * COUNTERS AS WELL. A CALL SPREAD OVER WORKER THREADS COUNTS AS ONE, NOTHING IS
+ * COUNTED PER BLOCK, SO THE COST IS A FEW ADDS PER CALL TO A CACHE LINE NO OTHER
+ * THREAD WRITES.
+ *
+ * Akuma_Stats(NULL, ...) ADDS UP THE SHARES OF ALL THREADS UNDER A LOCK, A THREAD
+ * THAT EXITS FOLDS ITS SHARE INTO THE TOTAL OF FINISHED THREADS FIRST.
+ * Akuma_StatsReset(NULL) DOES NOT TOUCH THE SHARES, IT REMEMBERS THE CURRENT SUM
+ * AND LATER READS SUBTRACT IT.
+ *
+ * THE TIME OF EACH CALL IS ONLY TAKEN WHILE Akuma_StatsTiming() IS ON OR A HOOK IS
+ * SET WITH Akuma_SetTrace(). THE HOOK RUNS ON THE THREAD THAT MADE THE CALL, SET IT
+ * BEFORE STARTING ANY WORK. BUILDING WITH -DAKUMA_STATS=0 REMOVES ALL OF IT AND
+ * THE COUNTERS STAY ZERO.
+ */
+
+#if AKUMA_STATS
+#include <time.h>
+
+/* ONE THREAD'S SHARE, WRITTEN ONLY BY ITS THREAD, READ BY Akuma_Stats() */
+
+struct AkumaThreadStats {
+      	struct AkumaStats stats;
+      	struct AkumaThreadStats * next;
+      	struct AkumaThreadStats * prev;
+      	bool linked;
+} __attribute__((aligned(64)));
+
+static __thread struct AkumaThreadStats akuma_thread_stats;
+static struct AkumaThreadStats * akuma_stats_threads;	/* THREADS THAT COUNTED SOMETHING */
+static struct AkumaStats akuma_stats_exited;	/* SHARES OF THREADS THAT EXITED */
+static struct AkumaStats akuma_stats_base;	/* THE SUM AT THE LAST Akuma_StatsReset(NULL) */
+static pthread_mutex_t akuma_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t akuma_stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t akuma_stats_key;
+static int akuma_timing;
+static Akuma_TraceHook akuma_trace;
+static void * akuma_trace_arg;
+
+static uint64_t stats_clock(void) {
+      	struct timespec ts;
+
+      	if (!__atomic_load_n(&akuma_timing, __ATOMIC_RELAXED) && __atomic_load_n(&akuma_trace, __ATOMIC_RELAXED) == NULL)
+            	return 0;
+
+      	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+      	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* ONLY THE OWNER ADDS, SO A LOAD AND A STORE DO, NO LOCKED INSTRUCTION. BOTH ARE */
+/* ATOMIC SO A CONCURRENT Akuma_Stats() NEVER SEES A TORN COUNTER */
+
+static void stats_bump(uint64_t * counter, uint64_t n) {
+      	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/* ADD (sign 1) OR SUBTRACT (sign -1) from, AS READ WHILE ITS OWNER MAY BE ADDING, TO to */
+
+static void stats_gather(struct AkumaStats * to, const struct AkumaStats * from, int sign) {
+      	for (int p = 0; p < AKUMA_PHASES; ++p) {
+            	to->calls[p] += sign * __atomic_load_n(&from->calls[p], __ATOMIC_RELAXED);
+            	to->bytes[p] += sign * __atomic_load_n(&from->bytes[p], __ATOMIC_RELAXED);
+            	to->blocks[p] += sign * __atomic_load_n(&from->blocks[p], __ATOMIC_RELAXED);
+            	to->ns[p] += sign * __atomic_load_n(&from->ns[p], __ATOMIC_RELAXED);
+      	}
+
+      	to->auth_failures += sign * __atomic_load_n(&from->auth_failures, __ATOMIC_RELAXED);
+}
+
+/* THREAD EXIT: MOVE THE SHARE INTO akuma_stats_exited AND UNLINK IT */
+
+static void stats_thread_exit(void * arg) {
+      	struct AkumaThreadStats * ts = (struct AkumaThreadStats *)arg;
+
+      	pthread_mutex_lock(&akuma_stats_lock);
+      	stats_gather(&akuma_stats_exited, &ts->stats, 1);
+
+      	if (ts->prev != NULL)
+            	ts->prev->next = ts->next;
+      	else
+            	akuma_stats_threads = ts->next;
+
+      	if (ts->next != NULL)
+            	ts->next->prev = ts->prev;
+
+      	pthread_mutex_unlock(&akuma_stats_lock);
+}
+
+/* fork() WHILE ANOTHER THREAD HOLDS THE LOCK WOULD LEAVE IT LOCKED IN THE CHILD */
+
+static void stats_before_fork(void) {
+      	pthread_mutex_lock(&akuma_stats_lock);
+}
+
+static void stats_after_fork(void) {
+      	pthread_mutex_unlock(&akuma_stats_lock);
+}
+
+static void stats_setup(void) {
+      	pthread_key_create(&akuma_stats_key, stats_thread_exit);
+      	pthread_atfork(stats_before_fork, stats_after_fork, stats_after_fork);
+}
+
+/* THE CALLING THREAD'S SHARE, LINKED INTO THE LIST ON FIRST USE */
+
+static struct AkumaStats * stats_thread(void) {
+      	struct AkumaThreadStats * ts = &akuma_thread_stats;
+
+      	if (!ts->linked) {
+            	pthread_once(&akuma_stats_once, stats_setup);
+            	pthread_mutex_lock(&akuma_stats_lock);
+
+            	ts->prev = NULL;
+            	ts->next = akuma_stats_threads;
+
+            	if (ts->next != NULL)
+                  	ts->next->prev = ts;
+
+            	akuma_stats_threads = ts;
+            	ts->linked = true;
+
+            	pthread_mutex_unlock(&akuma_stats_lock);
+            	pthread_setspecific(akuma_stats_key, ts);
+      	}
+
+      	return &ts->stats;
+}
+
+/* ONE CALL OF phase OVER bytes THAT STARTED AT stats_clock() == start */
+
+static void stats_add(struct AkumaStats * local, int phase, size_t bytes, uint64_t start) {
+      	uint64_t now = (start != 0)?stats_clock():0;
+      	uint64_t ns = (now > start)?(now - start):0;
+      	uint64_t blocks = (phase == AKUMA_PHASE_ENCRYPT || phase == AKUMA_PHASE_DECRYPT)?(bytes / AKUMA_BLOCK_SIZE_BYTES):0;
+      	struct AkumaStats * shared = stats_thread();
+
+      	stats_bump(&shared->calls[phase], 1);
+      	stats_bump(&shared->bytes[phase], bytes);
+      	stats_bump(&shared->blocks[phase], blocks);
+
+      	if (ns > 0)
+            	stats_bump(&shared->ns[phase], ns);
+
+      	if (local != NULL) {
+            	local->calls[phase] += 1;
+            	local->bytes[phase] += bytes;
+            	local->blocks[phase] += blocks;
+            	local->ns[phase] += ns;
+      	}
+
+      	Akuma_TraceHook hook = __atomic_load_n(&akuma_trace, __ATOMIC_ACQUIRE);
+
+      	if (hook != NULL) {
+            	struct AkumaTraceEvent event = { phase, bytes, ns, local };
+
+            	hook(&event, akuma_trace_arg);
+      	}
+}
+
+static void stats_auth_failure(struct AkumaStats * local) {
+      	stats_bump(&stats_thread()->auth_failures, 1);
+
+      	if (local != NULL)
+            	local->auth_failures += 1;
+}
+#else
+static uint64_t stats_clock(void) {
+      	return 0;
+}
+
+static void stats_add(struct AkumaStats * local, int phase, size_t bytes, uint64_t start) {
+      	(void)local; (void)phase; (void)bytes; (void)start;
+}
+
+static void stats_auth_failure(struct AkumaStats * local) {
+      	(void)local;
+}
+#endif
+
+/* ADD from INTO to, BOTH PRIVATE TO THE CALLING THREAD */
+
+static void stats_merge(struct AkumaStats * to, const struct AkumaStats * from) {
+      	for (int p = 0; p < AKUMA_PHASES; ++p) {
+            	to->calls[p] += from->calls[p];
+            	to->bytes[p] += from->bytes[p];
+            	to->blocks[p] += from->blocks[p];
+            	to->ns[p] += from->ns[p];
+      	}
+
+      	to->auth_failures += from->auth_failures;
+}
+
+/* COPY THE COUNTERS OF ctx, OR THE GLOBAL ONES FOR ctx == NULL */
+
+void Akuma_Stats(const Akuma_CTX * ctx, struct AkumaStats * stats) {
+      	memset(stats, '\0', sizeof(*stats));
+
+      	if (ctx != NULL) {
+            	*stats = ctx->stats;
+            	return;
+      	}
+
+#if AKUMA_STATS
+      	pthread_mutex_lock(&akuma_stats_lock);
+
+      	*stats = akuma_stats_exited;
+
+      	for (struct AkumaThreadStats * ts = akuma_stats_threads; ts != NULL; ts = ts->next)
+            	stats_gather(stats, &ts->stats, 1);
+
+      	stats_gather(stats, &akuma_stats_base, -1);
+      	pthread_mutex_unlock(&akuma_stats_lock);
+#endif
+}
+
+void Akuma_StatsReset(Akuma_CTX * ctx) {
+      	if (ctx != NULL) {
+            	memset(&ctx->stats, '\0', sizeof(ctx->stats));
+            	return;
+      	}
+
+#if AKUMA_STATS
+      	pthread_mutex_lock(&akuma_stats_lock);
+
+      	akuma_stats_base = akuma_stats_exited;
+
+      	for (struct AkumaThreadStats * ts = akuma_stats_threads; ts != NULL; ts = ts->next)
+            	stats_gather(&akuma_stats_base, &ts->stats, 1);
+
+      	pthread_mutex_unlock(&akuma_stats_lock);
+#endif
+}
+
+/* TIME EVERY CALL (1) OR ONLY COUNT THEM (0, THE DEFAULT) */
+
+void Akuma_StatsTiming(int on) {
+#if AKUMA_STATS
+      	__atomic_store_n(&akuma_timing, on?1:0, __ATOMIC_RELAXED);
+#else
+      	(void)on;
+#endif
+}
+
+/* CALL hook(event, arg) AFTER EVERY COUNTED CALL, NULL TURNS IT OFF */
+
+void Akuma_SetTrace(Akuma_TraceHook hook, void * arg) {
+#if AKUMA_STATS
+      	akuma_trace_arg = arg;
+      	__atomic_store_n(&akuma_trace, hook, __ATOMIC_RELEASE);
+#else
+      	(void)hook; (void)arg;
+#endif
+}
+
+/* WRITE stats AS ONE LINE OF JSON, THROUGHPUT IN MB/s WHERE THE CALLS WERE TIMED */
+
+void Akuma_StatsJSON(FILE * f, const struct AkumaStats * stats) {
+      	static const char * const names[AKUMA_PHASES] = { "setup", "encrypt", "decrypt", "mac" };
+
+      	fprintf(f, "{\"engine\":\"%s\",\"auth_failures\":%llu,\"phases\":{", Akuma_Engine(), (unsigned long long)stats->auth_failures);
+
+      	for (int p = 0; p < AKUMA_PHASES; ++p) {
+            	double mb_s = (stats->ns[p] > 0)?(stats->bytes[p] * 1e3 / stats->ns[p]):0;
+
+            	fprintf(f, "%s\"%s\":{\"calls\":%llu,\"bytes\":%llu,\"blocks\":%llu,\"ns\":%llu,\"mb_per_s\":%.1f}", (p > 0)?",":"", names[p],
+                        	(unsigned long long)stats->calls[p], (unsigned long long)stats->bytes[p], (unsigned long long)stats->blocks[p], (unsigned long long)stats->ns[p], mb_s);
+      	}
+
+      	fprintf(f, "}}\n");
+}
+
+
+/* AUTHENTICATION
+ *
+ * WITH AKUMA_AUTH THE CIPHERTEXT CARRIES AN HMAC-SHA256 TAG OVER IV || CIPHERTEXT.
+ * THE MAC KEY IS SHA-256(KEY || "AKUMA-HMAC"), SO THE CIPHER AND THE MAC NEVER
+ * SHARE A KEY, AND ITS PADDED INNER AND OUTER STATES ARE HASHED ONCE PER KEY.
+ *
+ * THE CIPHERTEXT IS FED TO THE MAC IN AKUMA_AUTH_CHUNK PIECES RIGHT BEFORE
+ * (DECRYPTING) OR AFTER (ENCRYPTING) EACH PIECE GOES THROUGH THE ENGINE, SO IT
+ * IS READ FROM MEMORY ONCE FOR BOTH. DECRYPTION CHECKS THE TAG IN THE SAME PASS,
+ * THE ONE-SHOT FUNCTIONS WIPE THE PLAINTEXT AND FAIL IF IT DOES NOT MATCH.
+ */
+
+static void mac_key_init(Akuma_Key * key) {
+      	static const char label[] = "AKUMA-HMAC";
+      	unsigned char mac_key[SHA256_DIGEST_LENGTH];
+      	unsigned char pad[SHA256_CBLOCK];
+      	SHA256_CTX sha;
+
+      	SHA256_Init(&sha);
+      	SHA256_Update(&sha, key->key, key->key_len);
+      	SHA256_Update(&sha, label, sizeof(label) - 1);
+      	SHA256_Final(mac_key, &sha);
+
+      	memset(pad, 0x36, sizeof(pad));
+
+      	for (size_t i = 0; i < sizeof(mac_key); ++i)
+            	pad[i] ^= mac_key[i];
+
+      	SHA256_Init(&key->mac_inner);
+      	SHA256_Update(&key->mac_inner, pad, sizeof(pad));
+
+      	memset(pad, 0x5c, sizeof(pad));
+
+      	for (size_t i = 0; i < sizeof(mac_key); ++i)
+            	pad[i] ^= mac_key[i];
+
+      	SHA256_Init(&key->mac_outer);
+      	SHA256_Update(&key->mac_outer, pad, sizeof(pad));
+
+      	OPENSSL_cleanse(mac_key, sizeof(mac_key));
+      	OPENSSL_cleanse(pad, sizeof(pad));
+}
+
+static void mac_update(Akuma_Stream * s, const unsigned char * ciphertext, size_t len) {
+      	if (s->key->auth && len > 0) {
+            	uint64_t start = stats_clock();
+
+            	SHA256_Update(&s->mac, ciphertext, len);
+            	stats_add(s->stats, AKUMA_PHASE_MAC, len, start);
+      	}
+}
+
+static void stream_tag(Akuma_Stream * s, unsigned char * tag) {
+      	unsigned char inner[SHA256_DIGEST_LENGTH];
+      	SHA256_CTX outer = s->key->mac_outer;
+
+      	SHA256_Final(inner, &s->mac);
+      	SHA256_Update(&outer, inner, sizeof(inner));
+      	SHA256_Final(tag, &outer);
+}
+
+/* 1 IF tag MATCHES, COMPARED IN CONSTANT TIME */
+
+static bool stream_verify(Akuma_Stream * s, const unsigned char * tag) {
+      	unsigned char expected[AKUMA_TAG_LENGTH_BYTES];
+
+      	stream_tag(s, expected);
+
+      	if (CRYPTO_memcmp(expected, tag, sizeof(expected)) == 0)
+            	return true;
+
+      	stats_auth_failure(s->stats);
+
+      	return false;
+}
+
+
+/* SHARED KEYS
+ *
+ * AN Akuma_Key HOLDS THE KEY, THE MODE AND THE SHA-256 STATES DERIVED FROM THE
+ * KEY AND IS ONLY READ ONCE Akuma_KeyInit() RETURNS, SO ONE KEY CAN SERVE ANY NUMBER OF
+ * THREADS WITHOUT LOCKS. EVERYTHING A MESSAGE CHANGES (KEYROUND, PARTIAL BLOCK,
+ * COUNTER) LIVES IN AN Akuma_Stream, ONE PER MESSAGE IN FLIGHT, WHICH STARTS A
+ * MESSAGE WITH ONE KEY ^ IV (AND ONE SHA-256 UPDATE IN COUNTER MODE) INSTEAD OF
+ * A FULL Akuma_Init()/Akuma_Update() ROUND.
+ *
+ * THE KEY MUST OUTLIVE EVERY STREAM STARTED FROM IT. Akuma_CTX KEEPS ONE OF
+ * EACH AND Akuma_EncryptInit()/Akuma_DecryptInit() REFRESH THEM FROM ctx.
+ */
+
+int Akuma_KeyInit(Akuma_Key * key, const unsigned char * bytes, int mode) {
+      	int auth = (mode & AKUMA_AUTH) != 0;
+
+      	mode &= ~AKUMA_AUTH;
+
+      	if (bytes == NULL || (mode != AKUMA_MODE_CHAIN && mode != AKUMA_MODE_CTR))
+            	return 0;
+
+      	memcpy(key->key, bytes, sizeof(key->key));
+      	key->key_len = sizeof(key->key);
+      	key->mode = mode;
+      	key->auth = auth;
+
+      	if (auth)
+            	mac_key_init(key);
+
+      	if (mode == AKUMA_MODE_CTR) {
+            	SHA256_Init(&key->key_base);
+            	SHA256_Update(&key->key_base, key->key, key->key_len);
+      	}
+
+      	return 1;
+}
+
+/* WIPE THE KEY ONCE NO STREAM USES IT ANY MORE */
+
+void Akuma_KeyFree(Akuma_Key * key) {
+      	OPENSSL_cleanse(key, sizeof(*key));
+}
+
+/* Akuma_StreamInit() COUNTING INTO stats AS WELL */
+
+static int stream_init(Akuma_Stream * s, const Akuma_Key * key, const unsigned char * iv, struct AkumaStats * stats) {
+      	uint64_t start = stats_clock();
+
+      	if (key == NULL || key->key_len == 0 || iv == NULL)
+            	return 0;
+
+      	s->key = key;
+      	s->stats = stats;
+      	s->threads = 1;
+      	s->buffer_len = 0;
+
+      	for (size_t i = 0; i < AKUMA_BLOCK_SIZE_BYTES; ++i)
+            	s->keyround[i] = key->key[i] ^ iv[i];
+
+      	if (key->mode == AKUMA_MODE_CTR)
+            	ctr_init(s, iv);
+      	else
+            	s->counter = 0;
+
+      	if (key->auth) {
+            	s->mac = key->mac_inner;
+            	SHA256_Update(&s->mac, iv, AKUMA_IV_LENGTH_BYTES);
+      	}
+
+      	stats_add(stats, AKUMA_PHASE_SETUP, 0, start);
+
+      	return 1;
+}
+
+int Akuma_StreamInit(Akuma_Stream * s, const Akuma_Key * key, const unsigned char * iv) {
+      	return stream_init(s, key, iv, NULL);
+}
+
+/* ctx->stream AFTER A STRUCT COPY OF ctx STILL POINTS AT THE OLD ctx->shared, SO RE-POINT IT ON EVERY USE */
+
+static Akuma_Stream * ctx_stream(Akuma_CTX * ctx) {
+      	ctx->stream.key = &ctx->shared;
+      	ctx->stream.threads = ctx->threads;
+      	ctx->stream.stats = &ctx->stats;
+
+      	return &ctx->stream;
+}
+
+/* REFRESH ctx->shared FROM THE KEY AND MODE IN ctx AND START ctx->stream WITH ctx->iv */
+
+static Akuma_Stream * ctx_start(Akuma_CTX * ctx) {
+      	if (ctx->iv_len == 0 || ctx->key_len == 0)
+            	return NULL;
+
+      	if (!Akuma_KeyInit(&ctx->shared, ctx->key, ctx->mode | (ctx->auth?AKUMA_AUTH:0)) || !stream_init(&ctx->stream, &ctx->shared, ctx->iv, &ctx->stats))
+            	return NULL;
+
+      	return ctx_stream(ctx);
+}
+
+
+/* PARALLEL BLOCKS
+ *
+ * THE KEYROUND FOR CIPHERTEXT BLOCK d IS THE UNROTATED CIPHERTEXT BLOCK d-1
+ * (OR KEY ^ IV FOR d = 0), SO DECRYPTION HAS NO SERIAL DEPENDENCY. THE BLOCKS
+ * ARE SPLIT INTO ONE SLICE PER THREAD AND EVERY WORKER GETS A PRIVATE COPY OF
+ * THE STREAM, PRIMED BY DECRYPTING THE BLOCK IN FRONT OF ITS SLICE BEFORE ANY
+ * WORKER STARTS, SO in AND out MAY BE THE SAME BUFFER.
+ *
+ * IN COUNTER MODE BOTH DIRECTIONS ARE SPLIT, A SLICE JUST STARTS AT ITS OWN
+ * COUNTER. CHAINED ENCRYPTION IS ALWAYS SERIAL.
+ */
+
+struct AkumaJob {
+      	Akuma_Stream stream;		/* PRIVATE KEYROUND AND COUNTER, THE KEY IS SHARED */
+      	const unsigned char * in;
+      	unsigned char * out;
+      	size_t nmemb;
+      	bool encrypt;
+      	bool ok;
+};
+
+static void * Akuma_Worker(void * arg) {
+      	struct AkumaJob * job = (struct AkumaJob *)arg;
+
+      	job->ok = crypt_blocks(&job->stream, job->in, job->out, job->nmemb, job->encrypt);
+
+      	return NULL;
+}
+
+unsigned int Akuma_Threads(unsigned int threads) {
+      	if (threads == 0) {
+            	long n = sysconf(_SC_NPROCESSORS_ONLN);
+            	threads = (n > 0)?(unsigned int)n:1;
+      	}
+
+      	if (threads > AKUMA_MAX_THREADS)
+            	threads = AKUMA_MAX_THREADS;
+
+      	return threads;
+}
+
+/* RUN nmemb WHOLE BLOCKS FROM in TO out, LEAVING THE KEYROUND/COUNTER READY FOR THE NEXT BLOCK */
+/* false IF ANY SLICE GOT NO COUNTER MODE KEYSTREAM, out IS THEN INCOMPLETE */
+
+static bool Akuma_CryptBlocks(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t nmemb, unsigned int threads, bool encrypt) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	bool chained = (s->key->mode != AKUMA_MODE_CTR);
+      	uint64_t start = stats_clock();
+
+      	threads = Akuma_Threads(threads);
+
+      	if (threads > nmemb / AKUMA_PARALLEL_MIN_BLOCKS)
+            	threads = (unsigned int)(nmemb / AKUMA_PARALLEL_MIN_BLOCKS);
+
+      	struct AkumaJob * jobs = NULL;
+      	pthread_t * workers = NULL;
+      	bool * started = NULL;
+
+      	if (threads > 1 && !(chained && encrypt)) {
+            	jobs = malloc(sizeof(struct AkumaJob) * threads);
+            	workers = malloc(sizeof(pthread_t) * threads);
+            	started = calloc(threads, sizeof(bool));
+      	}
+
+/* ONE THREAD, CHAINED ENCRYPTION OR NO MEMORY FOR THE JOBS: ALL OF IT ON THE CALLING THREAD */
+
+      	if (jobs == NULL || workers == NULL || started == NULL) {
+            	free(started);
+            	free(workers);
+            	free(jobs);
+
+            	if (!crypt_blocks(s, in, out, nmemb, encrypt))
+                  	return false;
+
+            	stats_add(s->stats, encrypt?AKUMA_PHASE_ENCRYPT:AKUMA_PHASE_DECRYPT, block_size * nmemb, start);
+            	return true;
+      	}
+
+      	unsigned char scratch[AKUMA_BLOCK_SIZE_BYTES];
+      	size_t slice = nmemb / threads;
+      	size_t first = 0;
+
+      	for (unsigned int t = 0; t < threads; ++t) {
+            	jobs[t].stream = *s;
+            	jobs[t].stream.counter = s->counter + first;
+
+            	if (t > 0 && chained)
+                  	decrypt_blocks(&jobs[t].stream, in + (block_size * (first - 1)), scratch, 1);
+
+            	jobs[t].in = in + (block_size * first);
+            	jobs[t].out = out + (block_size * first);
+            	jobs[t].nmemb = (t == threads - 1)?(nmemb - first):slice;
+            	jobs[t].encrypt = encrypt;
+
+            	first += jobs[t].nmemb;
+      	}
+
+/* SLICE 0 RUNS ON THE CALLING THREAD, ANY WORKER THAT FAILS TO START DOES TOO */
+
+      	for (unsigned int t = 1; t < threads; ++t)
+            	started[t] = (pthread_create(&workers[t], NULL, Akuma_Worker, &jobs[t]) == 0);
+
+      	Akuma_Worker(&jobs[0]);
+
+      	for (unsigned int t = 1; t < threads; ++t) {
+            	if (started[t])
+                  	pthread_join(workers[t], NULL);
+            	else
+                  	Akuma_Worker(&jobs[t]);
+      	}
+
+      	bool ok = true;
+
+      	for (unsigned int t = 0; t < threads; ++t)
+            	ok = ok && jobs[t].ok;
+
+      	memcpy(s->keyround, jobs[threads - 1].stream.keyround, sizeof(s->keyround));
+      	s->counter += nmemb;
+
+      	if (ok)
+            	stats_add(s->stats, encrypt?AKUMA_PHASE_ENCRYPT:AKUMA_PHASE_DECRYPT, block_size * nmemb, start);
+
+      	free(started);
+      	free(workers);
+      	free(jobs);
+
+      	return ok;
+}
+
+/* Akuma_CryptBlocks() THAT ALSO FEEDS THE CIPHERTEXT TO THE MAC OF AN AUTHENTICATED STREAM, ONE CACHE SIZED CHUNK AT A TIME */
+/* THE CHUNK GROWS TO ONE FULL SLICE PER THREAD WHEN THE BLOCKS ARE SPREAD OVER SEVERAL */
+
+static bool crypt_blocks_mac(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t nmemb, unsigned int threads, bool encrypt) {
+      	size_t chunk = AKUMA_AUTH_CHUNK / AKUMA_BLOCK_SIZE_BYTES;
+
+      	if (!s->key->auth)
+            	return Akuma_CryptBlocks(s, in, out, nmemb, threads, encrypt);
+
+      	threads = Akuma_Threads(threads);
+
+      	if (threads > 1 && chunk < (size_t)threads * AKUMA_PARALLEL_MIN_BLOCKS)
+            	chunk = (size_t)threads * AKUMA_PARALLEL_MIN_BLOCKS;
+
+      	while (nmemb > 0) {
+            	size_t n = (nmemb < chunk)?nmemb:chunk;
+            	size_t len = AKUMA_BLOCK_SIZE_BYTES * n;
+
+            	if (!encrypt)
+                  	mac_update(s, in, len);
+
+            	if (!Akuma_CryptBlocks(s, in, out, n, threads, encrypt))
+                  	return false;
+
+            	if (encrypt)
+                  	mac_update(s, out, len);
+
+            	in += len;
+            	out += len;
+            	nmemb -= n;
+      	}
+
+      	return true;
+}
+
+/* ctr_tail() WITH THE TAIL'S CIPHERTEXT FED TO THE MAC */
+
+static bool ctr_tail_mac(Akuma_Stream * s, const unsigned char * in, unsigned char * out, size_t len, bool encrypt) {
+      	if (!encrypt)
+            	mac_update(s, in, len);
+
+      	uint64_t start = stats_clock();
+
+      	if (!ctr_tail(s, in, out, len))
+            	return false;
+
+      	if (len > 0)
+            	stats_add(s->stats, encrypt?AKUMA_PHASE_ENCRYPT:AKUMA_PHASE_DECRYPT, len, start);
+
+      	if (encrypt)
+            	mac_update(s, out, len);
+
+      	return true;
+}
+
+/* ONE-SHOT COUNTER MODE FOR Akuma_Encrypt()/Akuma_Decrypt() ON A FRESH STREAM, RETURNS THE BYTES WRITTEN */
+/* OR (size_t)-1 WITHOUT A KEYSTREAM, out IS WIPED THEN */
+
+static size_t ctr_oneshot(Akuma_Stream * s, const unsigned char * in, size_t len, unsigned char * out, unsigned int threads, bool encrypt) {
+      	size_t nmemb = len / AKUMA_BLOCK_SIZE_BYTES;
+      	size_t whole = AKUMA_BLOCK_SIZE_BYTES * nmemb;
+
+      	if (!crypt_blocks_mac(s, in, out, nmemb, threads, encrypt) || !ctr_tail_mac(s, in + whole, out + whole, len - whole, encrypt)) {
+            	OPENSSL_cleanse(out, len);
+            	return -1;
+      	}
+
+      	return len;
+}
+
+/* PKCS#7 PAD LENGTH OF A DECRYPTED LAST BLOCK, 0 IF THE PADDING IS MALFORMED */
+
+static size_t pkcs7_length(const unsigned char * block) {
+      	size_t p = block[AKUMA_BLOCK_SIZE_BYTES - 1];
+
+      	if (p < 1 || p > AKUMA_BLOCK_SIZE_BYTES)
+            	return 0;
+
+      	for (size_t i = AKUMA_BLOCK_SIZE_BYTES - p; i < AKUMA_BLOCK_SIZE_BYTES; ++i) {
+            	if (block[i] != p)
+                  	return 0;
+      	}
+
+      	return p;
+}
+
+/* DROP p BYTES OF PADDING FROM ctx->plaintext, OR WIPE IT WHEN p IS 0 (BAD PADDING) */
+
+static bool ctx_unpad(Akuma_CTX * ctx, size_t p) {
+      	if (p == 0) {
+            	OPENSSL_cleanse(ctx->plaintext, ctx->plaintext_len);
+            	ctx->plaintext_len = 0;
+            	return false;
+      	}
+
+      	ctx->plaintext_len -= p;
+
+      	return true;
+}
+
+/* AKUMA_AUTH: CHECK THE TAG AFTER THE FIRST len BYTES OF ctx->ciphertext, WIPE THE PLAINTEXT IF IT DOES NOT MATCH */
+
+static bool ctx_verify(Akuma_CTX * ctx, size_t len, size_t plaintext_size) {
+      	if (!ctx->auth || stream_verify(&ctx->stream, ctx->ciphertext + len))
+            	return true;
+
+      	OPENSSL_cleanse(ctx->plaintext, plaintext_size);
+      	ctx->plaintext_len = 0;
+
+      	return false;
+}
+
+
+unsigned int Akuma_Encrypt(Akuma_CTX * ctx) {
+/* INITIALIZE MATRIX TABLE */
+
+      	for (size_t r = 0; r < ctx->matrix.rows; ++r) {
+            	for (size_t c = 0; c < ctx->matrix.columns; ++c) {
+                  	ctx->matrix.table[r][c] = 022;
+            	}
+      	}
+
+/* CHECK IV, KEY AND PLAINTEXT EXIST IN STRUCT */
+
+      	if (ctx->iv_len == 0 || ctx->key_len == 0 || ctx->plaintext_len == 0)
+            	return -1;
+
+/* XOR KEY AND INITIALIZATION VECTOR FOR FIRST KEYROUND */
+
+      	if (ctx_start(ctx) == NULL)
+            	return -1;
+
+      // static unsigned char sbox[256] = { 0x8e, 0xaa, 0x51, 0x13, 0x81, 0x30, 0x28, 0xb5, 0x82, 0x8a, 0x4f, 0x29, 0x6a, 0x06, 0xcd, 0xa6,
+      //                           0x54, 0xd7, 0xb7, 0x3f, 0x91, 0x1a, 0xfc, 0x7c, 0xac, 0x6d, 0x90, 0xb2, 0xc2, 0x25, 0xd8, 0x39,
+      //                           0x2e, 0x15, 0xf5, 0xfb, 0xfe, 0x68, 0x05, 0xa1, 0x6c, 0x97, 0x6f, 0x99, 0x26, 0x4a, 0x3e, 0x1e,
+      //                           0x9e, 0x61, 0xf6, 0x71, 0xb6, 0x2c, 0x36, 0xd9, 0xfd, 0xff, 0x44, 0xfa, 0x32, 0x55, 0x19, 0x35,
+      //                           0xb1, 0x48, 0xa7, 0xcb, 0xf3, 0xec, 0xa3, 0xf2, 0x5e, 0x4d, 0x09, 0x59, 0xce, 0x6b, 0xe0, 0xab,
+      //                           0xde, 0x7e, 0x69, 0x77, 0x85, 0x0e, 0xdc, 0x52, 0x9d, 0x62, 0x78, 0xbe, 0x8d, 0xd0, 0x2a, 0x1d,
+      //                           0xa8, 0xf7, 0x23, 0x86, 0x8f, 0x3d, 0xea, 0x9a, 0xad, 0xe9, 0x5d, 0x42, 0x66, 0x31, 0xe7, 0x7a,
+      //                           0x00, 0x72, 0xc7, 0x5f, 0x93, 0x34, 0x38, 0xda, 0xd6, 0xf9, 0x2b, 0xa2, 0x5a, 0xbc, 0x37, 0x94,
+      //                           0x11, 0x64, 0xb0, 0xbd, 0x4c, 0x20, 0x9f, 0x95, 0xb9, 0x3b, 0x02, 0xed, 0xa9, 0x47, 0x88, 0xe6,
+      //                           0x04, 0xd5, 0xdd, 0xee, 0xc1, 0x96, 0xe5, 0x14, 0x50, 0xeb, 0x84, 0x0a, 0x27, 0xd3, 0x56, 0x63,
+      //                           0x87, 0x16, 0xaf, 0x24, 0x8b, 0x83, 0x4b, 0x9c, 0x40, 0xd1, 0x22, 0x10, 0x2d, 0x5c, 0xc6, 0x45,
+      //                           0x03, 0x60, 0x65, 0x21, 0x6e, 0xe1, 0xf8, 0x33, 0xae, 0x70, 0x07, 0x57, 0x7f, 0x0d, 0x2f, 0x53,
+      //                           0xef, 0x76, 0x80, 0xb4, 0x0f, 0xdb, 0xf1, 0x79, 0xe2, 0x4e, 0x9b, 0xa4, 0xcc, 0x7d, 0x43, 0xbb,
+      //                           0xbf, 0xc9, 0x8c, 0x0c, 0xba, 0xc4, 0xc8, 0x08, 0xe4, 0xb3, 0x49, 0xe8, 0xf4, 0xb8, 0xd4, 0x12,
+      //                           0x98, 0x01, 0x5b, 0x17, 0x1b, 0xa0, 0x75, 0x7b, 0x89, 0xf0, 0x58, 0x41, 0x46, 0xc0, 0x67, 0x1c,
+      //                           0x74, 0xcf, 0xd2, 0x18, 0x3c, 0xe3, 0x3a, 0xc5, 0xdf, 0x1f, 0x0b, 0xca, 0xa5, 0xc3, 0x73, 0x92 };
+
+/* CREATE FUNC LOCAL VARIABLES TO LIMIT STRUCT ACCESS */
+
+      	size_t plaintext_len = (size_t)ctx->plaintext_len;
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	size_t nmemb = plaintext_len / block_size;
+      	size_t total_size = ((sizeof(unsigned char) * AKUMA_BLOCK_SIZE_BYTES) * nmemb);
+      	size_t tag_len = ctx->auth?AKUMA_TAG_LENGTH_BYTES:0;	/* AKUMA_AUTH APPENDS THE TAG TO THE CIPHERTEXT */
+
+/* COUNTER MODE NEEDS NO PADDING, THE CIPHERTEXT IS AS LONG AS THE PLAINTEXT */
+
+      	if (ctx->mode == AKUMA_MODE_CTR) {
+            	if (ctx_alloc(ctx, AKUMA_OWN_CIPHERTEXT, plaintext_len + tag_len + 1) == NULL)
+                  	return -1;
+
+            	ctx->ciphertext_len = ctr_oneshot(&ctx->stream, ctx->plaintext, plaintext_len, ctx->ciphertext, ctx->threads, true);
+
+            	if (ctx->ciphertext_len == (size_t)-1) {
+                  	ctx->ciphertext_len = 0;
+                  	return -1;
+            	}
+
+            	if (ctx->auth)
+                  	stream_tag(&ctx->stream, ctx->ciphertext + plaintext_len);
+
+            	ctx->ciphertext_len += tag_len;
+            	return ctx->ciphertext_len;
+      	}
+
+      	if (ctx_alloc(ctx, AKUMA_OWN_CIPHERTEXT, total_size + tag_len + 1) == NULL)	/* + 1 FOR THE TERMINATOR BELOW */
+            	return -1;
+
+/* REPEAT ROUNDS FOR N BLOCKS OF PADDED PLAINTEXT */
+
+      	crypt_blocks_mac(&ctx->stream, ctx->plaintext, ctx->ciphertext, nmemb, 1, true);
+
+      	if (ctx->auth) {
+            	stream_tag(&ctx->stream, ctx->ciphertext + total_size);
+            	total_size += tag_len;
+      	}
+
+      	ctx->ciphertext_len += total_size;
+
+//      for (size_t i = 0; i < total_size; ++i) {
+//	  buf[i] = ctx->ciphertext[i];
+//      }
+
+      	ctx->ciphertext[total_size] = '\0';
+
+/* RETURN BYTES WRITTEN */
+	return total_size;
+}
+
+
+
+
+unsigned int Akuma_Decrypt(Akuma_CTX * ctx) {
+/* CHECK IV, KEY AND CIPHERTEXT EXIST IN STRUCT */
+
+      	if (ctx->iv_len == 0 || ctx->key_len == 0 || ctx->ciphertext_len == 0)
+            	return -1;
+
+/* XOR KEY & INITIALIZATION VECTOR FOR FIRST KEYROUND */
+
+      	if (ctx_start(ctx) == NULL)
+            	return -1;
+
+      // static unsigned char rbox[256] = { 0x8e, 0xaa, 0x51, 0x13, 0x81, 0x30, 0x28, 0xb5, 0x82, 0x8a, 0x4f, 0x29, 0x6a, 0x06, 0xcd, 0xa6,
+      //                           0x54, 0xd7, 0xb7, 0x3f, 0x91, 0x1a, 0xfc, 0x7c, 0xac, 0x6d, 0x90, 0xb2, 0xc2, 0x25, 0xd8, 0x39,
+      //                           0x2e, 0x15, 0xf5, 0xfb, 0xfe, 0x68, 0x05, 0xa1, 0x6c, 0x97, 0x6f, 0x99, 0x26, 0x4a, 0x3e, 0x1e,
+      //                           0x9e, 0x61, 0xf6, 0x71, 0xb6, 0x2c, 0x36, 0xd9, 0xfd, 0xff, 0x44, 0xfa, 0x32, 0x55, 0x19, 0x35,
+      //                           0xb1, 0x48, 0xa7, 0xcb, 0xf3, 0xec, 0xa3, 0xf2, 0x5e, 0x4d, 0x09, 0x59, 0xce, 0x6b, 0xe0, 0xab,
+      //                           0xde, 0x7e, 0x69, 0x77, 0x85, 0x0e, 0xdc, 0x52, 0x9d, 0x62, 0x78, 0xbe, 0x8d, 0xd0, 0x2a, 0x1d,
+      //                           0xa8, 0xf7, 0x23, 0x86, 0x8f, 0x3d, 0xea, 0x9a, 0xad, 0xe9, 0x5d, 0x42, 0x66, 0x31, 0xe7, 0x7a,
+      //                           0x00, 0x72, 0xc7, 0x5f, 0x93, 0x34, 0x38, 0xda, 0xd6, 0xf9, 0x2b, 0xa2, 0x5a, 0xbc, 0x37, 0x94,
+      //                           0x11, 0x64, 0xb0, 0xbd, 0x4c, 0x20, 0x9f, 0x95, 0xb9, 0x3b, 0x02, 0xed, 0xa9, 0x47, 0x88, 0xe6,
+      //                           0x04, 0xd5, 0xdd, 0xee, 0xc1, 0x96, 0xe5, 0x14, 0x50, 0xeb, 0x84, 0x0a, 0x27, 0xd3, 0x56, 0x63,
+      //                           0x87, 0x16, 0xaf, 0x24, 0x8b, 0x83, 0x4b, 0x9c, 0x40, 0xd1, 0x22, 0x10, 0x2d, 0x5c, 0xc6, 0x45,
+      //                           0x03, 0x60, 0x65, 0x21, 0x6e, 0xe1, 0xf8, 0x33, 0xae, 0x70, 0x07, 0x57, 0x7f, 0x0d, 0x2f, 0x53,
+      //                           0xef, 0x76, 0x80, 0xb4, 0x0f, 0xdb, 0xf1, 0x79, 0xe2, 0x4e, 0x9b, 0xa4, 0xcc, 0x7d, 0x43, 0xbb,
+      //                           0xbf, 0xc9, 0x8c, 0x0c, 0xba, 0xc4, 0xc8, 0x08, 0xe4, 0xb3, 0x49, 0xe8, 0xf4, 0xb8, 0xd4, 0x12,
+      //                           0x98, 0x01, 0x5b, 0x17, 0x1b, 0xa0, 0x75, 0x7b, 0x89, 0xf0, 0x58, 0x41, 0x46, 0xc0, 0x67, 0x1c,
+      //                           0x74, 0xcf, 0xd2, 0x18, 0x3c, 0xe3, 0x3a, 0xc5, 0xdf, 0x1f, 0x0b, 0xca, 0xa5, 0xc3, 0x73, 0x92 };
+
+/* INITIALIZE MATRIX TABLE */
+
+      	for (size_t r = 0; r < ctx->matrix.rows; ++r) {
+	  	for (size_t c = 0; c < ctx->matrix.columns; ++c) {
+			ctx->matrix.table[r][c] = 022;
+	  	}
+      	}
+
+      	size_t tag_len = ctx->auth?AKUMA_TAG_LENGTH_BYTES:0;	/* AKUMA_AUTH: THE TAG FOLLOWS THE CIPHERTEXT */
+
+      	if (ctx->ciphertext_len < tag_len)
+            	return -1;
+
+      	size_t ciphertext_len = (size_t)ctx->ciphertext_len - tag_len;
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	size_t nmemb = ciphertext_len / block_size;
+      	size_t total_size = ((sizeof(unsigned char) * AKUMA_BLOCK_SIZE_BYTES) * nmemb);
+
+      	if (ctx->mode == AKUMA_MODE_CTR) {
+            	if (ctx_alloc(ctx, AKUMA_OWN_PLAINTEXT, ciphertext_len + 1) == NULL)
+                  	return -1;
+
+            	ctx->plaintext_len = ctr_oneshot(&ctx->stream, ctx->ciphertext, ciphertext_len, ctx->plaintext, ctx->threads, false);
+
+            	if (ctx->plaintext_len == (size_t)-1) {
+                  	ctx->plaintext_len = 0;
+                  	return -1;
+            	}
+
+            	if (!ctx_verify(ctx, ciphertext_len, ciphertext_len))
+                  	return -1;
+
+            	return ctx->plaintext_len;
+      	}
+
+      	if (total_size == 0 || total_size != ciphertext_len || ctx_alloc(ctx, AKUMA_OWN_PLAINTEXT, total_size) == NULL)
+            	return -1;
+
+      	crypt_blocks_mac(&ctx->stream, ctx->ciphertext, ctx->plaintext, nmemb, 1, false);
+      	ctx->plaintext_len = total_size;
+
+      	if (!ctx_verify(ctx, ciphertext_len, total_size))
+            	return -1;
+
+/* REVERSE PKCS#7 PADDING ON LAST BLOCK OF PLAITEXT */
+
+      	if (!ctx_unpad(ctx, pkcs7_length(ctx->plaintext + total_size - block_size)))
+            	return -1;
+
+      	ctx->plaintext[ctx->plaintext_len] = '\0';	/* p >= 1, STILL INSIDE THE BUFFER */
+
+      	return ctx->plaintext_len;
+}
+
+
+/* SAME CONTRACT AS Akuma_Decrypt(), threads = 0 USES EVERY ONLINE CPU */
+
+unsigned int Akuma_DecryptParallel(Akuma_CTX * ctx, unsigned int threads) {
+      	if (ctx->iv_len == 0 || ctx->key_len == 0 || ctx->ciphertext_len == 0)
+            	return -1;
+
+      	if (ctx_start(ctx) == NULL)
+            	return -1;
+
+      	for (size_t r = 0; r < ctx->matrix.rows; ++r) {
+            	for (size_t c = 0; c < ctx->matrix.columns; ++c) {
+			ctx->matrix.table[r][c] = 022;
+		}
+      	}
+
+      	size_t tag_len = ctx->auth?AKUMA_TAG_LENGTH_BYTES:0;
+
+      	if (ctx->ciphertext_len < tag_len)
+            	return -1;
+
+      	size_t ciphertext_len = ctx->ciphertext_len - tag_len;
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	size_t nmemb = ciphertext_len / block_size;
+      	size_t total_size = block_size * nmemb;
+
+      	if (ctx->mode == AKUMA_MODE_CTR) {
+            	if (ctx_alloc(ctx, AKUMA_OWN_PLAINTEXT, ciphertext_len + 1) == NULL)
+                  	return -1;
+
+            	ctx->plaintext_len = ctr_oneshot(&ctx->stream, ctx->ciphertext, ciphertext_len, ctx->plaintext, threads, false);
+
+            	if (ctx->plaintext_len == (size_t)-1) {
+                  	ctx->plaintext_len = 0;
+                  	return -1;
+            	}
+
+            	if (!ctx_verify(ctx, ciphertext_len, ciphertext_len))
+                  	return -1;
+
+            	return ctx->plaintext_len;
+      	}
+
+      	if (total_size == 0 || total_size != ciphertext_len || ctx_alloc(ctx, AKUMA_OWN_PLAINTEXT, total_size) == NULL)
+            	return -1;
+
+      	crypt_blocks_mac(&ctx->stream, ctx->ciphertext, ctx->plaintext, nmemb, threads, false);
+
+      	ctx->plaintext_len = total_size;
+
+      	if (!ctx_verify(ctx, ciphertext_len, total_size))
+            	return -1;
+
+/* REVERSE PKCS#7 PADDING ON LAST BLOCK OF PLAITEXT */
+
+      	if (!ctx_unpad(ctx, pkcs7_length(ctx->plaintext + total_size - block_size)))
+            	return -1;
+
+      	return ctx->plaintext_len;
+}
+
+
+/* STREAMING ENCRYPTION
+ *
+ * Akuma_EncryptInit() -> Akuma_EncryptUpdate() ... -> Akuma_EncryptFinal()
+ *
+ * THE KEY AND IV MUST BE SET WITH Akuma_Update() BEFORE Akuma_EncryptInit().
+ * PARTIAL BLOCKS ARE KEPT IN THE STREAM BETWEEN CALLS AND THE KEYROUND CARRIES
+ * THE CHAIN, SO THE INPUT CAN BE FED IN CHUNKS OF ANY SIZE.
+ *
+ * WITH A SHARED KEY THE SAME RUNS ON AN Akuma_Stream:
+ * Akuma_StreamInit() -> Akuma_StreamEncrypt() ... -> Akuma_StreamEncryptFinal()
+ *
+ * out MUST HAVE ROOM FOR in_len + AKUMA_BLOCK_SIZE_BYTES BYTES.
+ * Akuma_EncryptFinal() APPLIES PKCS#7 PADDING AND ALWAYS WRITES ONE BLOCK.
+ * IN COUNTER MODE IT ONLY WRITES THE BUFFERED TAIL (0 TO 31 BYTES), UNPADDED.
+ *
+ * IN COUNTER MODE WITHOUT AES-NI THE UPDATE CALLS RETURN (size_t)-1 AND THE FINAL
+ * CALLS -1 IF OPENSSL CANNOT PRODUCE THE KEYSTREAM, THE MESSAGE IS THEN LOST.
+ */
+
+int Akuma_EncryptInit(Akuma_CTX * ctx) {
+      	for (size_t r = 0; r < ctx->matrix.rows; ++r) {
+            	for (size_t c = 0; c < ctx->matrix.columns; ++c) {
+			ctx->matrix.table[r][c] = 022;
+		}
+      	}
+
+      	return ctx_start(ctx) != NULL;
+}
+
+/* SHARED BY BOTH DIRECTIONS, CHAINED DECRYPTION HOLDS THE LAST BLOCK BACK FOR ITS PADDING */
+
+static size_t stream_update(Akuma_Stream * s, const unsigned char * in, size_t in_len, unsigned char * out, bool encrypt) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	size_t keep = (!encrypt && s->key->mode == AKUMA_MODE_CHAIN)?1:0;
+      	size_t written = 0;
+
+      	if (in_len == 0)
+            	return 0;
+
+/* COMPLETE THE BUFFERED PARTIAL BLOCK FIRST */
+
+      	if (s->buffer_len > 0) {
+            	size_t n = block_size - s->buffer_len;
+
+            	if (n > in_len)
+                  	n = in_len;
+
+            	memcpy(s->buffer + s->buffer_len, in, n);
+            	s->buffer_len += n;
+            	in += n;
+            	in_len -= n;
+
+            	if (s->buffer_len < block_size || in_len < keep)
+			return 0;
+
+            	if (!encrypt)
+                  	mac_update(s, s->buffer, block_size);
+
+            	if (!Akuma_CryptBlocks(s, s->buffer, out, 1, 1, encrypt))
+                  	return -1;
+
+            	if (encrypt)
+                  	mac_update(s, out, block_size);
+
+            	s->buffer_len = 0;
+            	written += block_size;
+      	}
+
+/* WHOLE BLOCKS GO STRAIGHT FROM in TO out */
+
+      	size_t nmemb = (in_len - keep) / block_size;
+
+      	if (!crypt_blocks_mac(s, in, out + written, nmemb, s->threads, encrypt))
+            	return -1;
+
+      	in += block_size * nmemb;
+      	in_len -= block_size * nmemb;
+      	written += block_size * nmemb;
+
+      	memcpy(s->buffer, in, in_len);
+      	s->buffer_len = in_len;
+
+      	return written;
+}
+
+/* COUNTER MODE FINAL IN EITHER DIRECTION: THE BUFFERED TAIL, XOR ONLY */
+
+static int stream_ctr_final(Akuma_Stream * s, unsigned char * out, bool encrypt) {
+      	int tail = (int)s->buffer_len;
+
+      	if (!ctr_tail_mac(s, s->buffer, out, s->buffer_len, encrypt))
+            	tail = -1;
+
+      	s->buffer_len = 0;
+
+      	return tail;
+}
+
+static int stream_encrypt_final(Akuma_Stream * s, unsigned char * out) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	unsigned char n = (unsigned char)(block_size - s->buffer_len);
+
+      	if (s->key->mode == AKUMA_MODE_CTR)
+            	return stream_ctr_final(s, out, true);
+
+/* PKCS#7 PAD WHATEVER IS LEFT (A FULL BLOCK OF PADDING IF NOTHING IS LEFT) */
+
+      	memset(s->buffer + s->buffer_len, n, n);
+
+      	Akuma_CryptBlocks(s, s->buffer, out, 1, 1, true);
+      	mac_update(s, out, block_size);
+
+      	memset(s->buffer, '\0', sizeof(s->buffer));
+      	s->buffer_len = 0;
+
+      	return (int)block_size;
+}
+
+size_t Akuma_EncryptUpdate(Akuma_CTX * ctx, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	return stream_update(ctx_stream(ctx), in, in_len, out, true);
+}
+
+int Akuma_EncryptFinal(Akuma_CTX * ctx, unsigned char * out) {
+      	return stream_encrypt_final(ctx_stream(ctx), out);
+}
+
+size_t Akuma_StreamEncrypt(Akuma_Stream * s, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	return stream_update(s, in, in_len, out, true);
+}
+
+int Akuma_StreamEncryptFinal(Akuma_Stream * s, unsigned char * out) {
+      	return stream_encrypt_final(s, out);
+}
+
+
+/* STREAMING DECRYPTION
+ *
+ * Akuma_DecryptInit() -> Akuma_DecryptUpdate() ... -> Akuma_DecryptFinal()
+ * Akuma_StreamInit() -> Akuma_StreamDecrypt() ... -> Akuma_StreamDecryptFinal()
+ *
+ * THE LAST BLOCK SEEN IS HELD BACK IN THE STREAM UNTIL THE FINAL CALL, WHICH
+ * REMOVES THE PKCS#7 PADDING FROM IT. COUNTER MODE HOLDS BACK ONLY A PARTIAL
+ * BLOCK AND HAS NO PADDING TO REMOVE.
+ *
+ * LARGE UPDATES ARE SPREAD OVER ctx->threads (OR s->threads) WORKER THREADS.
+ *
+ * out MUST HAVE ROOM FOR in_len + AKUMA_BLOCK_SIZE_BYTES BYTES.
+ * Akuma_DecryptFinal() RETURNS THE NUMBER OF BYTES WRITTEN OR -1 IF THE
+ * CIPHERTEXT WAS NOT A WHOLE NUMBER OF BLOCKS OR THE PADDING IS INVALID.
+ */
+
+static int stream_decrypt_final(Akuma_Stream * s, unsigned char * out) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	unsigned char c_block[AKUMA_BLOCK_SIZE_BYTES];
+
+      	if (s->key->mode == AKUMA_MODE_CTR)
+            	return stream_ctr_final(s, out, false);
+
+      	if (s->buffer_len != block_size)
+            	return -1;
+
+      	mac_update(s, s->buffer, block_size);
+      	Akuma_CryptBlocks(s, s->buffer, c_block, 1, 1, false);
+
+      	memset(s->buffer, '\0', sizeof(s->buffer));
+      	s->buffer_len = 0;
+
+/* CHECK AND REVERSE PKCS#7 PADDING */
+
+      	size_t p = c_block[block_size - 1];
+
+      	if (p < 1 || p > block_size)
+            	return -1;
+
+      	for (size_t i = block_size - p; i < block_size; ++i) {
+            	if (c_block[i] != p)
+                  	return -1;
+      	}
+
+      	memcpy(out, c_block, block_size - p);
+
+      	return (int)(block_size - p);
+}
+
+int Akuma_DecryptInit(Akuma_CTX * ctx) {
+      	return Akuma_EncryptInit(ctx);
+}
+
+size_t Akuma_DecryptUpdate(Akuma_CTX * ctx, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	return stream_update(ctx_stream(ctx), in, in_len, out, false);
+}
+
+int Akuma_DecryptFinal(Akuma_CTX * ctx, unsigned char * out) {
+      	return stream_decrypt_final(ctx_stream(ctx), out);
+}
+
+size_t Akuma_StreamDecrypt(Akuma_Stream * s, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	return stream_update(s, in, in_len, out, false);
+}
+
+int Akuma_StreamDecryptFinal(Akuma_Stream * s, unsigned char * out) {
+      	return stream_decrypt_final(s, out);
+}
+
+/* AKUMA_AUTH: AFTER THE FINAL CALL, Akuma_EncryptTag()/Akuma_StreamTag() WRITE THE
+ * AKUMA_TAG_LENGTH_BYTES TAG TO STORE WITH THE CIPHERTEXT AND Akuma_DecryptVerify()/
+ * Akuma_StreamVerify() CHECK IT. STREAMED PLAINTEXT MUST NOT BE TRUSTED (AND SHOULD
+ * BE DISCARDED) UNTIL THE TAG CHECKS OUT. ALL RETURN 0 FOR A KEY WITHOUT AKUMA_AUTH.
+ */
+
+int Akuma_StreamTag(Akuma_Stream * s, unsigned char * tag) {
+      	if (!s->key->auth)
+            	return 0;
+
+      	stream_tag(s, tag);
+
+      	return 1;
+}
+
+int Akuma_StreamVerify(Akuma_Stream * s, const unsigned char * tag) {
+      	return s->key->auth && stream_verify(s, tag);
+}
+
+int Akuma_EncryptTag(Akuma_CTX * ctx, unsigned char * tag) {
+      	return Akuma_StreamTag(ctx_stream(ctx), tag);
+}
+
+int Akuma_DecryptVerify(Akuma_CTX * ctx, const unsigned char * tag) {
+      	return Akuma_StreamVerify(ctx_stream(ctx), tag);
+}
+
+
+/* RANDOM ACCESS DECRYPTION
+ *
+ * A CHAINED BLOCK ONLY DEPENDS ON THE CIPHERTEXT BLOCK BEFORE IT (KEY ^ IV FOR
+ * BLOCK 0) AND A COUNTER BLOCK ONLY ON ITS INDEX, SO A RANGE OF THE PLAINTEXT
+ * CAN BE RECOVERED WITHOUT DECRYPTING ANYTHING BEFORE IT.
+ *
+ * Akuma_DecryptSeek() MOVES A CONTEXT FROM Akuma_DecryptInit() TO BLOCK block,
+ * prev IS CIPHERTEXT BLOCK block - 1 (UNUSED FOR BLOCK 0 AND IN COUNTER MODE).
+ * Akuma_StreamSeek() DOES THE SAME FOR A STREAM, GIVEN ITS MESSAGE'S IV.
+ * AN AKUMA_AUTH TAG COVERS THE WHOLE CIPHERTEXT, SO AUTHENTICATED STREAMS CAN
+ * ONLY SEEK TO BLOCK 0 AND Akuma_DecryptRange() REFUSES THEM.
+ * Akuma_DecryptUpdate() THEN CONTINUES FROM THERE AS USUAL, Akuma_DecryptFinal()
+ * IS ONLY MEANINGFUL ONCE THE LAST BLOCK OF THE CIPHERTEXT HAS BEEN FED IN.
+ */
+
+int Akuma_StreamSeek(Akuma_Stream * s, const unsigned char * iv, uint64_t block, const unsigned char * prev) {
+      	unsigned char scratch[AKUMA_BLOCK_SIZE_BYTES];
+      	unsigned int threads = s->threads;
+
+      	if (!stream_init(s, s->key, iv, s->stats) || (s->key->auth && block > 0))
+            	return 0;
+
+      	s->threads = threads;
+
+      	if (s->key->mode == AKUMA_MODE_CTR) {
+            	s->counter = block;
+            	return 1;
+      	}
+
+      	if (block == 0)
+            	return 1;
+
+      	if (prev == NULL)
+            	return 0;
+
+/* DECRYPTING THE PREVIOUS BLOCK LEAVES ITS UNROTATED FORM AS THE KEYROUND */
+
+      	decrypt_blocks(s, prev, scratch, 1);
+
+      	return 1;
+}
+
+int Akuma_DecryptSeek(Akuma_CTX * ctx, uint64_t block, const unsigned char * prev) {
+      	if (ctx->iv_len == 0 || ctx->key_len == 0)
+            	return 0;
+
+      	return Akuma_StreamSeek(ctx_stream(ctx), ctx->iv, block, prev);
+}
+
+/* DECRYPT length BYTES OF PLAINTEXT STARTING AT offset FROM ctx->ciphertext INTO ctx->plaintext
+ * ONLY THE BLOCKS COVERING THE RANGE (AND ONE BEFORE AND AFTER IT) ARE TOUCHED.
+ * A RANGE RUNNING PAST THE END OF THE PLAINTEXT IS CUT SHORT, RETURNS THE BYTES WRITTEN OR (size_t)-1
+ */
+
+size_t Akuma_DecryptRange(Akuma_CTX * ctx, size_t offset, size_t length) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	size_t ciphertext_len = ctx->ciphertext_len;
+
+      	if (ctx->auth || (ctx->ciphertext == NULL && ciphertext_len > 0) || (ctx->mode == AKUMA_MODE_CHAIN && (ciphertext_len == 0 || ciphertext_len % block_size != 0)))
+            	return -1;
+
+      	if (!Akuma_DecryptInit(ctx))
+            	return -1;
+
+      	if (offset > ciphertext_len)
+            	offset = ciphertext_len;
+
+      	if (length > ciphertext_len - offset)
+            	length = ciphertext_len - offset;
+
+      	if (length == 0) {
+            	if (ctx_alloc(ctx, AKUMA_OWN_PLAINTEXT, 1) == NULL)
+                  	return -1;
+
+            	ctx->plaintext[0] = '\0';
+            	ctx->plaintext_len = 0;
+            	return 0;
+      	}
+
+/* WINDOW OF WHOLE BLOCKS AROUND THE RANGE, CHAINED MODE TAKES ONE MORE SO THE HELD BACK BLOCK IS PAST IT */
+
+      	size_t first = offset / block_size;
+      	size_t end = (offset + length + block_size - 1) / block_size * block_size + ((ctx->mode == AKUMA_MODE_CHAIN)?block_size:0);
+
+      	if (end > ciphertext_len)
+            	end = ciphertext_len;
+
+      	const unsigned char * window = ctx->ciphertext + (block_size * first);
+      	size_t window_len = end - (block_size * first);
+
+      	ctx->plaintext_len = 0;
+
+      	if (ctx_alloc(ctx, AKUMA_OWN_PLAINTEXT, window_len + block_size) == NULL)
+            	return -1;
+
+      	if (!Akuma_DecryptSeek(ctx, first, (first > 0)?(window - block_size):NULL))
+            	return -1;
+
+      	size_t n = Akuma_DecryptUpdate(ctx, window, window_len, ctx->plaintext);
+
+      	if (n == (size_t)-1)
+            	return -1;
+
+      	if (end == ciphertext_len) {
+            	int final_len = Akuma_DecryptFinal(ctx, ctx->plaintext + n);
+
+            	if (final_len < 0)
+                  	return -1;
+
+            	n += final_len;
+      	}
+
+/* DROP THE PART OF THE FIRST BLOCK BEFORE offset */
+
+      	size_t skip = offset - (block_size * first);
+
+      	if (n < skip)
+            	n = skip;
+
+      	if (length > n - skip)
+            	length = n - skip;
+
+      	memmove(ctx->plaintext, ctx->plaintext + skip, length);
+      	ctx->plaintext_len = length;
+
+	return ctx->plaintext_len;
+}
+
+
+/* APPENDING
+ *
+ * A CHAINED STREAM ONLY CARRIES ITS KEYROUND FROM ONE BLOCK TO THE NEXT, AND THAT
+ * IS THE PREVIOUS CIPHERTEXT BLOCK UNROTATED. Akuma_StreamAppend() PICKS A FINISHED
+ * MESSAGE UP FROM ITS LAST TWO BLOCKS: THE ONE BEFORE THE LAST GIVES THE KEYROUND,
+ * THE LAST ONE IS DECRYPTED, ITS PADDING STRIPPED AND ITS PLAINTEXT PUT BACK INTO
+ * THE STREAM AS THE PARTIAL BLOCK. IN COUNTER MODE THE UNPADDED TAIL IS TAKEN BACK
+ * THE SAME WAY AND THE COUNTER RESUMES AT ITS BLOCK.
+ *
+ * ciphertext IS THE WHOLE OLD CIPHERTEXT WITHOUT IV AND TAG, BUT ONLY ITS LAST TWO
+ * BLOCKS ARE READ, SO IT CAN BE A MAPPING OF A FILE OF ANY SIZE. WITH AKUMA_AUTH
+ * ALL OF IT IS HASHED (NOT DECRYPTED) TO CHECK tag AND TO CARRY THE MAC ON.
+ *
+ * s MUST COME FROM Akuma_StreamInit() UNDER THE OLD MESSAGE'S KEY, iv IS ITS IV.
+ * Akuma_EncryptAppend() DOES THE SAME FOR A CONTEXT IN PLACE OF Akuma_EncryptInit(),
+ * WITH THE OLD KEY AND IV SET BY Akuma_Update(). BOTH RETURN HOW MANY BYTES OF
+ * ciphertext STAY, WHAT FOLLOWS THEM IS REPLACED BY THE OUTPUT OF THE USUAL UPDATE
+ * AND FINAL CALLS, OR -1 IF THE LENGTH, PADDING OR TAG DO NOT CHECK OUT.
+ *
+ * ONLY THE TAG RELIABLY CATCHES A WRONG KEY, MODE OR IV. WITHOUT AKUMA_AUTH THE LAST
+ * CHAINED BLOCK DECRYPTS WITH THE PREVIOUS CIPHERTEXT BLOCK AS ITS KEYROUND, NOT
+ * THE KEY, AND COUNTER MODE HAS NO PADDING TO CHECK, SO A WRONG KEY IS USUALLY
+ * ACCEPTED AND THE APPENDED DATA CANNOT BE DECRYPTED. encrypt --append NEEDS -a.
+ */
+
+size_t Akuma_StreamAppend(Akuma_Stream * s, const unsigned char * iv, const unsigned char * ciphertext, size_t ciphertext_len, const unsigned char * tag) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	unsigned int threads = s->threads;
+      	unsigned char block[AKUMA_BLOCK_SIZE_BYTES];
+      	size_t keep;
+
+      	if (!stream_init(s, s->key, iv, s->stats) || (s->key->auth && tag == NULL))
+            	return -1;
+
+      	s->threads = threads;
+
+      	if (s->key->mode == AKUMA_MODE_CTR)
+            	keep = ciphertext_len - ciphertext_len % block_size;
+      	else if (ciphertext_len >= block_size && ciphertext_len % block_size == 0)
+            	keep = ciphertext_len - block_size;
+      	else
+            	return -1;
+
+/* THE MAC GOES ON FROM THE BYTES THAT STAY, THE OLD TAG IS CHECKED ON A COPY */
+
+      	if (s->key->auth) {
+            	Akuma_Stream check;
+
+            	mac_update(s, ciphertext, keep);
+
+            	check = *s;
+            	mac_update(&check, ciphertext + keep, ciphertext_len - keep);
+
+            	bool ok = stream_verify(&check, tag);
+
+            	OPENSSL_cleanse(&check, sizeof(check));
+
+            	if (!ok)
+                  	return -1;
+      	}
+
+      	if (s->key->mode == AKUMA_MODE_CTR) {
+            	s->counter = keep / block_size;
+
+            	if (!ctr_tail(s, ciphertext + keep, s->buffer, ciphertext_len - keep))
+                  	return -1;
+
+            	s->counter = keep / block_size;
+            	s->buffer_len = ciphertext_len - keep;
+
+            	return keep;
+      	}
+
+/* DECRYPTING THE BLOCK BEFORE THE LAST LEAVES THE KEYROUND THE LAST ONE WAS ENCRYPTED WITH */
+
+      	unsigned char keyround[AKUMA_BLOCK_SIZE_BYTES];
+
+      	if (keep > 0)
+            	decrypt_blocks(s, ciphertext + keep - block_size, block, 1);
+
+      	memcpy(keyround, s->keyround, block_size);
+      	decrypt_blocks(s, ciphertext + keep, block, 1);
+      	memcpy(s->keyround, keyround, block_size);
+
+/* CHECK AND REVERSE PKCS#7 PADDING */
+
+      	size_t p = block[block_size - 1];
+      	bool ok = (p >= 1 && p <= block_size);
+
+      	for (size_t i = block_size - (ok?p:0); i < block_size; ++i)
+            	ok = ok && block[i] == p;
+
+      	if (ok) {
+            	memcpy(s->buffer, block, block_size - p);
+            	s->buffer_len = block_size - p;
+      	}
+
+      	OPENSSL_cleanse(block, sizeof(block));
+      	OPENSSL_cleanse(keyround, sizeof(keyround));
+
+      	return ok?keep:(size_t)-1;
+}
+
+size_t Akuma_EncryptAppend(Akuma_CTX * ctx, const unsigned char * ciphertext, size_t ciphertext_len, const unsigned char * tag) {
+      	Akuma_Stream * s = ctx_start(ctx);
+
+      	if (s == NULL)
+            	return -1;
+
+      	return Akuma_StreamAppend(s, ctx->iv, ciphertext, ciphertext_len, tag);
+}
+
+
+/* CALLER OWNED BUFFERS
+ *
+ * Akuma_EncryptTo()/Akuma_DecryptTo() ARE THE ONE-SHOT FUNCTIONS WITHOUT ANY
+ * HEAP ALLOCATION: THE MESSAGE GOES STRAIGHT FROM in TO out AND ONLY THE LAST
+ * BLOCK IS PADDED, ON THE STACK. out MAY BE in TO WORK IN PLACE. THE KEY AND IV
+ * MUST BE SET WITH Akuma_Update(), ctx->plaintext/ciphertext ARE NOT USED.
+ * Akuma_KeyEncryptTo()/Akuma_KeyDecryptTo() DO THE SAME UNDER A SHARED KEY ON
+ * A STREAM ON THE STACK, SO THEY CAN BE CALLED FROM ANY THREAD AT ONCE.
+ *
+ * out_size IS THE ROOM IN out, AT LEAST Akuma_EncryptedSize() WHEN ENCRYPTING
+ * AND in_len WHEN DECRYPTING (PADDING INCLUDED, IT IS CUT OFF AFTERWARDS).
+ * WITH AKUMA_AUTH THE TAG IS APPENDED TO THE CIPHERTEXT AND CHECKED BEFORE THE
+ * PADDING, out IS WIPED IF IT DOES NOT MATCH.
+ * BOTH RETURN THE BYTES WRITTEN OR -1 IF out IS TOO SMALL, THE KEY OR IV IS
+ * MISSING OR (DECRYPTING) THE LENGTH, TAG OR PADDING IS INVALID.
+ * MORE THAN ONE ctx->threads ALLOCATES THE THREAD BOOKKEEPING FOR LARGE INPUTS.
+ */
+
+static size_t encrypted_size(int mode, int auth, size_t plaintext_len) {
+      	size_t tag_len = auth?AKUMA_TAG_LENGTH_BYTES:0;
+
+      	if (mode == AKUMA_MODE_CTR)
+            	return plaintext_len + tag_len;
+
+      	return (plaintext_len / AKUMA_BLOCK_SIZE_BYTES + 1) * AKUMA_BLOCK_SIZE_BYTES + tag_len;
+}
+
+size_t Akuma_EncryptedSize(const Akuma_CTX * ctx, size_t plaintext_len) {
+      	return encrypted_size(ctx->mode, ctx->auth, plaintext_len);
+}
+
+static size_t stream_encrypt_to(Akuma_Stream * s, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	size_t whole = in_len - (in_len % block_size);
+      	size_t tail = in_len - whole;
+      	size_t len = in_len;
+      	unsigned char block[AKUMA_BLOCK_SIZE_BYTES];
+
+      	if (out_size < encrypted_size(s->key->mode, s->key->auth, in_len))
+            	return -1;
+
+      	if (!crypt_blocks_mac(s, in, out, whole / block_size, s->threads, true))
+            	return -1;
+
+      	if (s->key->mode == AKUMA_MODE_CTR) {
+            	if (!ctr_tail_mac(s, in + whole, out + whole, tail, true))
+                  	return -1;
+      	} else {
+
+/* PKCS#7 PAD THE TAIL (A FULL BLOCK OF PADDING IF THERE IS NONE) */
+
+            	if (tail > 0)
+                  	memcpy(block, in + whole, tail);
+
+            	memset(block + tail, (int)(block_size - tail), block_size - tail);
+
+            	Akuma_CryptBlocks(s, block, out + whole, 1, 1, true);
+            	mac_update(s, out + whole, block_size);
+
+            	len = whole + block_size;
+      	}
+
+      	if (s->key->auth) {
+            	stream_tag(s, out + len);
+            	len += AKUMA_TAG_LENGTH_BYTES;
+      	}
+
+      	return len;
+}
+
+static size_t stream_decrypt_to(Akuma_Stream * s, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+      	size_t block_size = AKUMA_BLOCK_SIZE_BYTES;
+      	unsigned char tag[AKUMA_TAG_LENGTH_BYTES];
+
+      	if (out_size < in_len)
+            	return -1;
+
+/* COPY THE TAG OUT FIRST, out MAY OVERLAP in */
+
+      	if (s->key->auth) {
+            	if (in_len < sizeof(tag))
+                  	return -1;
+
+            	in_len -= sizeof(tag);
+            	memcpy(tag, in + in_len, sizeof(tag));
+      	}
+
+      	size_t whole = in_len - (in_len % block_size);
+
+      	if (s->key->mode == AKUMA_MODE_CHAIN && (in_len == 0 || whole != in_len))
+            	return -1;
+
+      	if (!crypt_blocks_mac(s, in, out, whole / block_size, s->threads, false) || (s->key->mode == AKUMA_MODE_CTR && !ctr_tail_mac(s, in + whole, out + whole, in_len - whole, false))) {
+            	OPENSSL_cleanse(out, in_len);
+            	return -1;
+      	}
+
+      	if (s->key->auth && !stream_verify(s, tag)) {
+            	OPENSSL_cleanse(out, in_len);
+            	return -1;
+      	}
+
+      	if (s->key->mode == AKUMA_MODE_CTR)
+            	return in_len;
+
+/* CHECK AND REVERSE PKCS#7 PADDING */
+
+      	size_t p = out[in_len - 1];
+
+      	if (p < 1 || p > block_size)
+            	return -1;
+
+      	for (size_t i = in_len - p; i < in_len; ++i) {
+            	if (out[i] != p)
+                  	return -1;
+      	}
+
+      	return in_len - p;
+}
+
+size_t Akuma_EncryptTo(Akuma_CTX * ctx, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+      	if (!Akuma_EncryptInit(ctx))
+            	return -1;
+
+      	return stream_encrypt_to(ctx_stream(ctx), in, in_len, out, out_size);
+}
+
+size_t Akuma_DecryptTo(Akuma_CTX * ctx, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+      	if (!Akuma_DecryptInit(ctx))
+            	return -1;
+
+      	return stream_decrypt_to(ctx_stream(ctx), in, in_len, out, out_size);
+}
+
+size_t Akuma_KeyEncryptTo(const Akuma_Key * key, const unsigned char * iv, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+      	Akuma_Stream s;
+
+      	if (!Akuma_StreamInit(&s, key, iv))
+            	return -1;
+
+      	return stream_encrypt_to(&s, in, in_len, out, out_size);
+}
+
+size_t Akuma_KeyDecryptTo(const Akuma_Key * key, const unsigned char * iv, const unsigned char * in, size_t in_len, unsigned char * out, size_t out_size) {
+      	Akuma_Stream s;
+
+      	if (!Akuma_StreamInit(&s, key, iv))
+            	return -1;
+
+      	return stream_decrypt_to(&s, in, in_len, out, out_size);
+}
+
+
+/* SMALL MESSAGES
+ *
+ * FOR A MESSAGE OF A FEW BLOCKS THE WORK IS NOT THE CIPHER BUT EVERYTHING AROUND
+ * IT: Akuma_Init() AND THE MATRIX RESET, pkcs7pad()'S COPY, THE OUTPUT malloc()
+ * AND THE ENGINE DISPATCH. Akuma_EncryptSmall()/Akuma_DecryptSmall() SKIP ALL OF
+ * IT FOR UP TO AKUMA_SMALL_MAX BYTES UNDER A SHARED Akuma_Key: THE KEYROUND LIVES
+ * IN FOUR REGISTERS, THE PADDED LAST BLOCK ON THE STACK AND EVERY LENGTH FROM 1
+ * TO 8 BLOCKS HAS ITS OWN FULLY UNROLLED COPY OF THE LOOP.
+ *
+ * SEEN AS FOUR 64 BIT ROWS THE ROUND PERMUTATION (i ^ 0x17) SWAPS ROWS 0<->2 AND
+ * 1<->3 AND REVERSES THE BYTES OF EACH, ONE bswap PER ROW ON ANY CPU.
+ *
+ * THE OUTPUT IS THAT OF Akuma_KeyEncryptTo()/Akuma_KeyDecryptTo(), WHICH THEY
+ * FALL BACK TO FOR A KEY IN COUNTER MODE OR WITH AKUMA_AUTH. out NEEDS in_len +
+ * AKUMA_BLOCK_SIZE_BYTES (+ AKUMA_TAG_LENGTH_BYTES) BYTES TO ENCRYPT AND in_len
+ * TO DECRYPT. BOTH RETURN THE BYTES WRITTEN OR -1 IF THE MESSAGE IS TOO LONG OR
+ * (DECRYPTING) ITS LENGTH, TAG OR PADDING IS INVALID.
+ */
+
+static inline __attribute__((always_inline)) uint64_t small_row(const unsigned char * p) {
+      	uint64_t r;
+
+      	memcpy(&r, p, sizeof(r));
+
+      	return r;
+}
+
+static inline __attribute__((always_inline)) void small_store(unsigned char * p, uint64_t r) {
+      	memcpy(p, &r, sizeof(r));
+}
+
+/* THE KEYROUND STAYS IN k0..k3 FOR THE WHOLE MESSAGE, k IS ONLY READ AND WRITTEN ONCE */
+
+static inline __attribute__((always_inline)) void small_encrypt(uint64_t * k, const unsigned char * in, unsigned char * out, const size_t nmemb) {
+      	uint64_t k0 = k[0], k1 = k[1], k2 = k[2], k3 = k[3];
+
+#pragma GCC unroll 8
+      	for (size_t e = 0; e < nmemb; ++e, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES) {
+            	k0 ^= small_row(in);
+            	k1 ^= small_row(in + 8);
+            	k2 ^= small_row(in + 16);
+            	k3 ^= small_row(in + 24);
+
+            	small_store(out, __builtin_bswap64(k2));
+            	small_store(out + 8, __builtin_bswap64(k3));
+            	small_store(out + 16, __builtin_bswap64(k0));
+            	small_store(out + 24, __builtin_bswap64(k1));
+      	}
+
+      	k[0] = k0, k[1] = k1, k[2] = k2, k[3] = k3;
+}
+
+static inline __attribute__((always_inline)) void small_decrypt(uint64_t * k, const unsigned char * in, unsigned char * out, const size_t nmemb) {
+      	uint64_t k0 = k[0], k1 = k[1], k2 = k[2], k3 = k[3];
+
+#pragma GCC unroll 8
+      	for (size_t d = 0; d < nmemb; ++d, in += AKUMA_BLOCK_SIZE_BYTES, out += AKUMA_BLOCK_SIZE_BYTES) {
+            	uint64_t x0 = __builtin_bswap64(small_row(in + 16));
+            	uint64_t x1 = __builtin_bswap64(small_row(in + 24));
+            	uint64_t x2 = __builtin_bswap64(small_row(in));
+            	uint64_t x3 = __builtin_bswap64(small_row(in + 8));
+
+            	small_store(out, x0 ^ k0);
+            	small_store(out + 8, x1 ^ k1);
+            	small_store(out + 16, x2 ^ k2);
+            	small_store(out + 24, x3 ^ k3);
+
+            	k0 = x0, k1 = x1, k2 = x2, k3 = x3;
+      	}
+
+      	k[0] = k0, k[1] = k1, k[2] = k2, k[3] = k3;
+}
+
+/* ONE CONSTANT nmemb PER CASE, SO EACH ONE UNROLLS COMPLETELY */
+
+static void small_blocks(uint64_t * k, const unsigned char * in, unsigned char * out, size_t nmemb, bool encrypt) {
+      	switch (nmemb) {
+      	case 0: break;
+      	case 1: encrypt?small_encrypt(k, in, out, 1):small_decrypt(k, in, out, 1); break;
+      	case 2: encrypt?small_encrypt(k, in, out, 2):small_decrypt(k, in, out, 2); break;
+      	case 3: encrypt?small_encrypt(k, in, out, 3):small_decrypt(k, in, out, 3); break;
+      	case 4: encrypt?small_encrypt(k, in, out, 4):small_decrypt(k, in, out, 4); break;
+      	case 5: encrypt?small_encrypt(k, in, out, 5):small_decrypt(k, in, out, 5); break;
+      	case 6: encrypt?small_encrypt(k, in, out, 6):small_decrypt(k, in, out, 6); break;
+      	case 7: encrypt?small_encrypt(k, in, out, 7):small_decrypt(k, in, out, 7); break;
+      	default: encrypt?small_encrypt(k, in, out, 8):small_decrypt(k, in, out, 8); break;
+      	}
+}
+
+static void small_keyround(uint64_t * k, const Akuma_Key * key, const unsigned char * iv) {
+      	uint64_t x[4];
+
+      	memcpy(k, key->key, sizeof(x));
+      	memcpy(x, iv, sizeof(x));
+
+      	for (int r = 0; r < 4; ++r)
+            	k[r] ^= x[r];
+}
+
+size_t Akuma_EncryptSmall(const Akuma_Key * key, const unsigned char * iv, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	uint64_t start = stats_clock();
+      	unsigned char block[AKUMA_BLOCK_SIZE_BYTES];
+      	uint64_t k[4];
+
+      	if (in_len > AKUMA_SMALL_MAX || key == NULL || key->key_len == 0 || iv == NULL)
+            	return -1;
+
+      	if (key->mode != AKUMA_MODE_CHAIN || key->auth)
+            	return Akuma_KeyEncryptTo(key, iv, in, in_len, out, encrypted_size(key->mode, key->auth, in_len));
+
+      	size_t whole = in_len & ~(size_t)(AKUMA_BLOCK_SIZE_BYTES - 1);
+      	size_t tail = in_len - whole;
+
+      	small_keyround(k, key, iv);
+      	small_blocks(k, in, out, whole / AKUMA_BLOCK_SIZE_BYTES, true);
+
+/* PKCS#7 PAD THE TAIL (A FULL BLOCK OF PADDING IF THERE IS NONE) */
+
+      	memcpy(block, in + whole, tail);
+      	memset(block + tail, (int)(AKUMA_BLOCK_SIZE_BYTES - tail), AKUMA_BLOCK_SIZE_BYTES - tail);
+      	small_encrypt(k, block, out + whole, 1);
+
+      	OPENSSL_cleanse(k, sizeof(k));
+      	stats_add(NULL, AKUMA_PHASE_ENCRYPT, whole + AKUMA_BLOCK_SIZE_BYTES, start);
+
+      	return whole + AKUMA_BLOCK_SIZE_BYTES;
+}
+
+size_t Akuma_DecryptSmall(const Akuma_Key * key, const unsigned char * iv, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	uint64_t start = stats_clock();
+      	unsigned char block[AKUMA_BLOCK_SIZE_BYTES];
+      	uint64_t k[4];
+
+      	if (key == NULL || key->key_len == 0 || iv == NULL || in_len > AKUMA_SMALL_MAX + AKUMA_BLOCK_SIZE_BYTES + (key->auth?AKUMA_TAG_LENGTH_BYTES:0))
+            	return -1;
+
+      	if (key->mode != AKUMA_MODE_CHAIN || key->auth)
+            	return Akuma_KeyDecryptTo(key, iv, in, in_len, out, in_len);
+
+      	if (in_len == 0 || in_len % AKUMA_BLOCK_SIZE_BYTES != 0)
+            	return -1;
+
+      	size_t whole = in_len - AKUMA_BLOCK_SIZE_BYTES;
+
+      	small_keyround(k, key, iv);
+      	small_blocks(k, in, out, whole / AKUMA_BLOCK_SIZE_BYTES, false);
+      	small_decrypt(k, in + whole, block, 1);
+
+      	OPENSSL_cleanse(k, sizeof(k));
+      	stats_add(NULL, AKUMA_PHASE_DECRYPT, in_len, start);
+
+/* CHECK AND REVERSE PKCS#7 PADDING */
+
+      	size_t p = block[AKUMA_BLOCK_SIZE_BYTES - 1];
+      	bool ok = (p >= 1 && p <= AKUMA_BLOCK_SIZE_BYTES);
+
+      	for (size_t i = AKUMA_BLOCK_SIZE_BYTES - (ok?p:0); i < AKUMA_BLOCK_SIZE_BYTES; ++i)
+            	ok = ok && block[i] == p;
+
+      	if (ok)
+            	memcpy(out + whole, block, AKUMA_BLOCK_SIZE_BYTES - p);
+
+      	OPENSSL_cleanse(block, sizeof(block));
+
+      	return ok?(whole + AKUMA_BLOCK_SIZE_BYTES - p):(size_t)-1;
+}
+
+
+/* BATCHES
+ *
+ * Akuma_EncryptBatch()/Akuma_DecryptBatch() PROCESS count INDEPENDENT MESSAGES
+ * UNDER THE KEY AND MODE OF ctx, EACH WITH ITS OWN IV. THERE IS NO Akuma_Init()/
+ * Akuma_Update() ROUND, CONTEXT COPY OR ALLOCATION PER MESSAGE: A MESSAGE COSTS
+ * ONE KEY ^ IV AND ONE ENGINE CALL UNDER AN Akuma_Key SET UP ONCE PER BATCH.
+ * ctx ONLY NEEDS THE KEY AND MODE SET.
+ *
+ * THE MESSAGES ARE INDEPENDENT, SO LARGE BATCHES ARE SPLIT OVER ctx->threads.
+ * INTERLEAVING SEVERAL CHAINS IN ONE THREAD DOES NOT PAY OFF HERE: THE CHAIN IS
+ * A SINGLE XOR PER BLOCK AND THE ENGINES ARE ALREADY BOUND BY THE SHUFFLES.
+ *
+ * out MUST HAVE ROOM FOR in_len + AKUMA_BLOCK_SIZE_BYTES BYTES, PLUS
+ * AKUMA_TAG_LENGTH_BYTES WHEN ENCRYPTING WITH AKUMA_AUTH. out_len IS SET TO THE
+ * BYTES WRITTEN, OR -1 FOR A MESSAGE WITH NO IV, A BAD LENGTH, TAG OR PADDING.
+ * RETURNS THE NUMBER OF MESSAGES THAT SUCCEEDED.
+ *
+ * Akuma_KeyEncryptBatch()/Akuma_KeyDecryptBatch() RUN A BATCH SERIALLY UNDER A
+ * SHARED KEY, FOR CALLERS THAT KEEP THEIR OWN THREADS AND THEIR KEYS SET UP.
+ */
+
+struct AkumaMessage {
+      	const unsigned char * iv;	/* AKUMA_IV_LENGTH_BYTES */
+      	const unsigned char * in;
+      	size_t in_len;
+      	unsigned char * out;
+      	size_t out_len;
+};
+
+struct AkumaBatchJob {
+      	const Akuma_Key * key;
+      	struct AkumaMessage * msgs;
+      	size_t count;
+      	bool encrypt;
+      	size_t done;
+      	struct AkumaStats stats;	/* MERGED INTO ctx->stats ONCE EVERY WORKER IS DONE */
+};
+
+static void * batch_worker(void * arg) {
+      	struct AkumaBatchJob * job = (struct AkumaBatchJob *)arg;
+
+      	for (size_t i = 0; i < job->count; ++i) {
+            	struct AkumaMessage * m = &job->msgs[i];
+
+            	m->out_len = -1;
+
+            	if (m->out == NULL || (m->in == NULL && m->in_len > 0))
+                  	continue;
+
+            	Akuma_Stream s;
+
+            	if (!stream_init(&s, job->key, m->iv, &job->stats))
+                  	continue;
+
+            	if (job->encrypt)
+                  	m->out_len = stream_encrypt_to(&s, m->in, m->in_len, m->out, encrypted_size(job->key->mode, job->key->auth, m->in_len));
+            	else
+                  	m->out_len = stream_decrypt_to(&s, m->in, m->in_len, m->out, m->in_len);
+
+            	if (m->out_len != (size_t)-1)
+                  	++job->done;
+      	}
+
+      	return NULL;
+}
+
+static size_t Akuma_CryptBatch(Akuma_CTX * ctx, struct AkumaMessage * msgs, size_t count, bool encrypt) {
+      	size_t nmemb = 0;
+      	size_t done = 0;
+      	Akuma_Key key;
+
+      	if (ctx->key_len == 0 || !Akuma_KeyInit(&key, ctx->key, ctx->mode | (ctx->auth?AKUMA_AUTH:0)))
+            	return 0;
+
+      	for (size_t i = 0; i < count; ++i)
+            	nmemb += msgs[i].in_len / AKUMA_BLOCK_SIZE_BYTES + 1;
+
+      	unsigned int threads = Akuma_Threads(ctx->threads);
+
+      	if (threads > nmemb / AKUMA_PARALLEL_MIN_BLOCKS)
+            	threads = (unsigned int)(nmemb / AKUMA_PARALLEL_MIN_BLOCKS);
+
+      	if (threads > count)
+            	threads = (unsigned int)count;
+
+      	struct AkumaBatchJob * jobs = NULL;
+      	pthread_t * workers = NULL;
+      	bool * started = NULL;
+
+      	if (threads > 1) {
+            	jobs = malloc(sizeof(struct AkumaBatchJob) * threads);
+            	workers = malloc(sizeof(pthread_t) * threads);
+            	started = calloc(threads, sizeof(bool));
+      	}
+
+/* ONE THREAD OR NO MEMORY FOR THE JOBS: THE WHOLE BATCH AS ONE JOB ON THE CALLING THREAD */
+
+      	if (jobs == NULL || workers == NULL || started == NULL) {
+            	struct AkumaBatchJob job = { .key = &key, .msgs = msgs, .count = count, .encrypt = encrypt };
+
+            	free(started);
+            	free(workers);
+            	free(jobs);
+
+            	batch_worker(&job);
+            	stats_merge(&ctx->stats, &job.stats);
+            	Akuma_KeyFree(&key);
+
+            	return job.done;
+      	}
+
+      	size_t slice = count / threads;
+      	size_t first = 0;
+
+      	for (unsigned int t = 0; t < threads; ++t) {
+            	jobs[t].key = &key;
+            	jobs[t].msgs = msgs + first;
+            	jobs[t].count = (t == threads - 1)?(count - first):slice;
+            	jobs[t].encrypt = encrypt;
+            	jobs[t].done = 0;
+
+            	memset(&jobs[t].stats, '\0', sizeof(jobs[t].stats));
+
+            	first += jobs[t].count;
+      	}
+
+/* SLICE 0 RUNS ON THE CALLING THREAD, ANY WORKER THAT FAILS TO START DOES TOO */
+
+      	for (unsigned int t = 1; t < threads; ++t)
+            	started[t] = (pthread_create(&workers[t], NULL, batch_worker, &jobs[t]) == 0);
+
+      	batch_worker(&jobs[0]);
+
+      	for (unsigned int t = 1; t < threads; ++t) {
+            	if (started[t])
+                  	pthread_join(workers[t], NULL);
+            	else
+                  	batch_worker(&jobs[t]);
+      	}
+
+      	for (unsigned int t = 0; t < threads; ++t) {
+            	done += jobs[t].done;
+            	stats_merge(&ctx->stats, &jobs[t].stats);
+      	}
+
+      	free(jobs);
+      	free(workers);
+      	free(started);
+      	Akuma_KeyFree(&key);
+
+      	return done;
+}
+
+size_t Akuma_EncryptBatch(Akuma_CTX * ctx, struct AkumaMessage * msgs, size_t count) {
+      	return Akuma_CryptBatch(ctx, msgs, count, true);
+}
+
+size_t Akuma_DecryptBatch(Akuma_CTX * ctx, struct AkumaMessage * msgs, size_t count) {
+      	return Akuma_CryptBatch(ctx, msgs, count, false);
+}
+
+size_t Akuma_KeyEncryptBatch(const Akuma_Key * key, struct AkumaMessage * msgs, size_t count) {
+      	struct AkumaBatchJob job = { .key = key, .msgs = msgs, .count = count, .encrypt = true };
+
+      	batch_worker(&job);
+
+      	return job.done;
+}
+
+size_t Akuma_KeyDecryptBatch(const Akuma_Key * key, struct AkumaMessage * msgs, size_t count) {
+      	struct AkumaBatchJob job = { .key = key, .msgs = msgs, .count = count, .encrypt = false };
+
+      	batch_worker(&job);
+
+      	return job.done;
+}
+
+
+/* SESSION TABLES
+ *
+ * AN Akuma_Stream CARRIES A PARTIAL BLOCK, A COUNTER, AN AES KEY SCHEDULE AND A SHA-256 STATE, BUT
+ * ONE CHAINED STREAM PER CONNECTION ONLY NEEDS ITS KEYROUND BETWEEN CALLS. A
+ * SESSION TABLE KEEPS JUST THAT, ONE 64 BYTE SLOT (ONE CACHE LINE) PER STREAM,
+ * UNDER ONE SHARED Akuma_Key IN AKUMA_MODE_CHAIN WITHOUT AKUMA_AUTH. A MILLION
+ * LIVE STREAMS TAKE 64 MB AND A CALL TOUCHES ONE LINE OF STATE. THE SLOTS ARE
+ * ONE ALLOCATION AND PAGES NO SESSION HAS USED YET ARE NEVER TOUCHED.
+ *
+ * Akuma_SessionOpen() RETURNS A HANDLE, THE SLOT INDEX AND ITS GENERATION, OR 0
+ * WHEN THE TABLE IS FULL. LOOKUP IS AN INDEX AND A COMPARE, AND A HANDLE GOES
+ * STALE WHEN ITS SESSION CLOSES, SO IT NEVER REACHES THE NEXT SESSION IN THE SLOT.
+ *
+ * THERE IS NO ROOM FOR A PARTIAL BLOCK: Akuma_SessionEncrypt()/Akuma_SessionDecrypt()
+ * ONLY TAKE WHOLE BLOCKS AND RETURN THE BYTES THEY USED (DECRYPTION LEAVES THE
+ * LAST BLOCK FOR ITS PADDING), THE CALLER KEEPS THE REST IN ITS OWN RECEIVE
+ * BUFFER AND HANDS IT IN AGAIN. AT THE END OF THE STREAM THE FINAL CALLS TAKE
+ * WHAT IS LEFT (LESS THAN A BLOCK TO ENCRYPT, ONE BLOCK TO DECRYPT) AND CLOSE THE
+ * SESSION. THE OUTPUT IS BYTE IDENTICAL TO Akuma_StreamEncrypt() AND FRIENDS.
+ *
+ * A TABLE BELONGS TO ONE THREAD, GIVE EVERY THREAD ITS OWN UNDER THE SAME KEY.
+ */
+
+#define AKUMA_SESSION_NONE UINT32_MAX	/* END OF THE FREE LIST */
+
+struct AkumaSession {
+      	unsigned char keyround[AKUMA_BLOCK_SIZE_BYTES];
+      	uint64_t offset;	/* BYTES OF INPUT SO FAR */
+      	uint32_t generation;	/* ODD WHILE THE SESSION IS OPEN */
+      	uint32_t next;		/* NEXT CLOSED SLOT, WHILE ON THE FREE LIST */
+      	unsigned char unused[16];
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct AkumaSession) == 64, "A SESSION IS ONE CACHE LINE");
+
+typedef struct __AKUMA_SESSION_TABLE {
+      	const Akuma_Key * key;
+      	struct AkumaSession * slots;
+      	uint32_t capacity;
+      	uint32_t used;		/* SLOTS EVER HANDED OUT, THE REST ARE UNTOUCHED */
+      	uint32_t free;		/* MOST RECENTLY CLOSED SLOT */
+      	uint32_t open;
+} Akuma_SessionTable;
+
+int Akuma_SessionTableInit(Akuma_SessionTable * t, const Akuma_Key * key, size_t capacity) {
+      	memset(t, 0, sizeof(*t));
+
+      	if (key == NULL || key->key_len == 0 || key->mode != AKUMA_MODE_CHAIN || key->auth || capacity == 0 || capacity >= AKUMA_SESSION_NONE)
+            	return 0;
+
+      	t->slots = aligned_alloc(sizeof(struct AkumaSession), capacity * sizeof(struct AkumaSession));
+
+      	if (t->slots == NULL)
+            	return 0;
+
+      	t->key = key;
+      	t->capacity = (uint32_t)capacity;
+      	t->free = AKUMA_SESSION_NONE;
+
+      	return 1;
+}
+
+void Akuma_SessionTableFree(Akuma_SessionTable * t) {
+      	if (t->slots != NULL) {
+            	OPENSSL_cleanse(t->slots, (size_t)t->used * sizeof(struct AkumaSession));
+            	free(t->slots);
+      	}
+
+      	memset(t, 0, sizeof(*t));
+}
+
+/* ONLY AN OPEN SLOT (ODD GENERATION) IS RETURNED: A FORGED OR WRAPPED HANDLE MUST NOT */
+/* REACH A CLOSED ONE, CLOSING IT AGAIN WOULD PUT IT ON THE FREE LIST TWICE */
+
+static struct AkumaSession * session_get(Akuma_SessionTable * t, uint64_t handle) {
+      	uint32_t index = (uint32_t)handle;
+
+      	if (index >= t->used || (t->slots[index].generation & 1) == 0 || t->slots[index].generation != (uint32_t)(handle >> 32))
+            	return NULL;
+
+      	return &t->slots[index];
+}
+
+uint64_t Akuma_SessionOpen(Akuma_SessionTable * t, const unsigned char * iv) {
+      	uint64_t start = stats_clock();
+      	uint32_t index;
+
+      	if (iv == NULL)
+            	return 0;
+
+      	if (t->free != AKUMA_SESSION_NONE) {
+            	index = t->free;
+            	t->free = t->slots[index].next;
+      	} else if (t->used < t->capacity) {
+            	index = t->used++;
+            	t->slots[index].generation = 0;
+      	} else {
+            	return 0;
+      	}
+
+      	struct AkumaSession * slot = &t->slots[index];
+
+      	slot->generation += 1;
+      	slot->offset = 0;
+
+      	for (size_t i = 0; i < AKUMA_BLOCK_SIZE_BYTES; ++i)
+            	slot->keyround[i] = t->key->key[i] ^ iv[i];
+
+      	t->open += 1;
+      	stats_add(NULL, AKUMA_PHASE_SETUP, 0, start);
+
+      	return ((uint64_t)slot->generation << 32) | index;
+}
+
+/* WIPE THE KEYROUND AND PUT THE SLOT ON THE FREE LIST, STALE HANDLES ARE IGNORED */
+
+void Akuma_SessionClose(Akuma_SessionTable * t, uint64_t handle) {
+      	struct AkumaSession * slot = session_get(t, handle);
+
+      	if (slot == NULL)
+            	return;
+
+      	OPENSSL_cleanse(slot->keyround, sizeof(slot->keyround));
+      	slot->generation += 1;
+      	slot->next = t->free;
+      	t->free = (uint32_t)handle;
+      	t->open -= 1;
+}
+
+/* BYTES OF INPUT THE SESSION HAS TAKEN, (uint64_t)-1 FOR A STALE HANDLE */
+
+uint64_t Akuma_SessionOffset(Akuma_SessionTable * t, uint64_t handle) {
+      	struct AkumaSession * slot = session_get(t, handle);
+
+      	return (slot != NULL)?slot->offset:(uint64_t)-1;
+}
+
+/* WHOLE BLOCKS OF in, RETURNS THE BYTES USED (AND WRITTEN) OR (size_t)-1 FOR A STALE HANDLE */
+
+size_t Akuma_SessionEncrypt(Akuma_SessionTable * t, uint64_t handle, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	struct AkumaSession * slot = session_get(t, handle);
+      	uint64_t start = stats_clock();
+
+      	if (slot == NULL)
+            	return -1;
+
+      	size_t nmemb = in_len / AKUMA_BLOCK_SIZE_BYTES;
+
+      	get_engine()->encrypt(slot->keyround, in, out, nmemb);
+      	slot->offset += nmemb * AKUMA_BLOCK_SIZE_BYTES;
+
+      	stats_add(NULL, AKUMA_PHASE_ENCRYPT, nmemb * AKUMA_BLOCK_SIZE_BYTES, start);
+
+      	return nmemb * AKUMA_BLOCK_SIZE_BYTES;
+}
+
+/* THE LAST BLOCK OF in IS ALWAYS LEFT, IT MAY BE THE ONE WITH THE PADDING */
+
+size_t Akuma_SessionDecrypt(Akuma_SessionTable * t, uint64_t handle, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	struct AkumaSession * slot = session_get(t, handle);
+      	uint64_t start = stats_clock();
+
+      	if (slot == NULL)
+            	return -1;
+
+      	size_t nmemb = (in_len > 0)?(in_len - 1) / AKUMA_BLOCK_SIZE_BYTES:0;
+
+      	get_engine()->decrypt(slot->keyround, in, out, nmemb);
+      	slot->offset += nmemb * AKUMA_BLOCK_SIZE_BYTES;
+
+      	stats_add(NULL, AKUMA_PHASE_DECRYPT, nmemb * AKUMA_BLOCK_SIZE_BYTES, start);
+
+      	return nmemb * AKUMA_BLOCK_SIZE_BYTES;
+}
+
+/* PAD THE LAST in_len < AKUMA_BLOCK_SIZE_BYTES BYTES INTO ONE BLOCK AND CLOSE, RETURNS THE BYTES WRITTEN OR -1 */
+
+int Akuma_SessionEncryptFinal(Akuma_SessionTable * t, uint64_t handle, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	struct AkumaSession * slot = session_get(t, handle);
+      	unsigned char block[AKUMA_BLOCK_SIZE_BYTES];
+      	uint64_t start = stats_clock();
+
+      	if (slot == NULL || in_len >= AKUMA_BLOCK_SIZE_BYTES)
+            	return -1;
+
+      	memcpy(block, in, in_len);
+      	memset(block + in_len, (int)(AKUMA_BLOCK_SIZE_BYTES - in_len), AKUMA_BLOCK_SIZE_BYTES - in_len);
+
+      	get_engine()->encrypt(slot->keyround, block, out, 1);
+      	OPENSSL_cleanse(block, sizeof(block));
+
+      	stats_add(NULL, AKUMA_PHASE_ENCRYPT, AKUMA_BLOCK_SIZE_BYTES, start);
+      	Akuma_SessionClose(t, handle);
+
+      	return AKUMA_BLOCK_SIZE_BYTES;
+}
+
+/* DECRYPT THE LAST BLOCK, REMOVE ITS PADDING AND CLOSE, RETURNS THE BYTES WRITTEN OR -1 (THE SESSION IS CLOSED EITHER WAY) */
+
+int Akuma_SessionDecryptFinal(Akuma_SessionTable * t, uint64_t handle, const unsigned char * in, size_t in_len, unsigned char * out) {
+      	struct AkumaSession * slot = session_get(t, handle);
+      	unsigned char block[AKUMA_BLOCK_SIZE_BYTES];
+      	uint64_t start = stats_clock();
+
+      	if (slot == NULL)
+            	return -1;
+
+      	if (in_len != AKUMA_BLOCK_SIZE_BYTES) {
+            	Akuma_SessionClose(t, handle);
+            	return -1;
+      	}
+
+      	get_engine()->decrypt(slot->keyround, in, block, 1);
+
+      	stats_add(NULL, AKUMA_PHASE_DECRYPT, AKUMA_BLOCK_SIZE_BYTES, start);
+      	Akuma_SessionClose(t, handle);
+
+/* CHECK AND REVERSE PKCS#7 PADDING */
+
+      	size_t p = block[AKUMA_BLOCK_SIZE_BYTES - 1];
+      	bool ok = (p >= 1 && p <= AKUMA_BLOCK_SIZE_BYTES);
+
+      	for (size_t i = AKUMA_BLOCK_SIZE_BYTES - (ok?p:0); i < AKUMA_BLOCK_SIZE_BYTES; ++i)
+            	ok = ok && block[i] == p;
+
+      	if (ok)
+            	memcpy(out, block, AKUMA_BLOCK_SIZE_BYTES - p);
+
+      	OPENSSL_cleanse(block, sizeof(block));
+
+      	return ok?(int)(AKUMA_BLOCK_SIZE_BYTES - p):-1;
+}
+
+
+/* RANDOM IVS
+ *
+ * Akuma_IV() AND Akuma_IVs() HAND OUT IVS FROM A POOL OWNED BY THE CALLING
+ * THREAD, SO A SERVER OR A BATCH THAT STARTS MILLIONS OF MESSAGES PAYS A
+ * memcpy() PER IV INSTEAD OF A RAND_bytes() CALL AND ITS LOCK. THE POOL IS
+ * AES-256-CTR KEYSTREAM (AES-NI WHEREVER THE CPU HAS IT) FILLED AKUMA_IV_POOL
+ * IVS AT A TIME.
+ *
+ * EVERY REFILL TAKES THE NEXT KEY AND COUNTER FROM THE FRONT OF ITS OWN OUTPUT
+ * AND WIPES THEM, AND IVS ARE WIPED AS THEY ARE HANDED OUT, SO NOTHING LEFT IN
+ * MEMORY RECOVERS AN EARLIER IV. THE KEY COMES FRESH FROM RAND_bytes() ON FIRST
+ * USE, AFTER EVERY AKUMA_IV_RESEED BYTES AND IN THE CHILD AFTER fork(), WHICH
+ * WOULD OTHERWISE REPEAT THE PARENT'S NEXT IVS. A THREAD'S POOL IS WIPED WHEN
+ * THE THREAD EXITS.
+ *
+ * BOTH RETURN 1, OR 0 WHEN RAND_bytes() OR OPENSSL FAILED, LIKE RAND_bytes().
+ */
+
+struct AkumaIVPool {
+      	EVP_CIPHER_CTX * aes;
+      	unsigned char bytes[AKUMA_IV_SEED_BYTES + AKUMA_IV_POOL * AKUMA_IV_LENGTH_BYTES];
+      	size_t next;		/* FIRST BYTE NOT HANDED OUT YET, sizeof(bytes) WHEN EMPTY */
+      	uint64_t since_seed;	/* BYTES GENERATED SINCE RAND_bytes() */
+      	unsigned int generation;	/* akuma_iv_generation WHEN SEEDED */
+};
+
+static __thread struct AkumaIVPool akuma_iv_pool;
+static pthread_once_t akuma_iv_once = PTHREAD_ONCE_INIT;
+static pthread_key_t akuma_iv_key;
+static volatile unsigned int akuma_iv_generation = 1;	/* BUMPED IN EVERY fork() CHILD */
+
+static void iv_pool_free(void * arg) {
+      	struct AkumaIVPool * pool = (struct AkumaIVPool *)arg;
+
+      	EVP_CIPHER_CTX_free(pool->aes);
+      	OPENSSL_cleanse(pool, sizeof(*pool));
+}
+
+static void iv_after_fork(void) {
+      	++akuma_iv_generation;
+}
+
+static void iv_setup(void) {
+      	pthread_key_create(&akuma_iv_key, iv_pool_free);
+      	pthread_atfork(NULL, NULL, iv_after_fork);
+}
+
+static bool iv_refill(struct AkumaIVPool * pool) {
+      	unsigned char seed[AKUMA_IV_SEED_BYTES];
+      	int len;
+
+      	if (pool->aes == NULL) {
+            	pthread_once(&akuma_iv_once, iv_setup);
+
+            	if ((pool->aes = EVP_CIPHER_CTX_new()) == NULL)
+                  	return false;
+
+            	pthread_setspecific(akuma_iv_key, pool);
+      	}
+
+/* A FRESH KEY || COUNTER FROM RAND_bytes(), OTHERWISE aes ALREADY HOLDS THE ONE THE LAST REFILL LEFT */
+
+      	if (pool->generation != akuma_iv_generation || pool->since_seed >= AKUMA_IV_RESEED) {
+            	bool ok = RAND_bytes(seed, sizeof(seed)) && EVP_EncryptInit_ex(pool->aes, EVP_aes_256_ctr(), NULL, seed, seed + 32);
+
+            	OPENSSL_cleanse(seed, sizeof(seed));
+
+            	if (!ok) {
+                  	pool->generation = 0;
+                  	return false;
+		}
+
+            	pool->generation = akuma_iv_generation;
+            	pool->since_seed = 0;
+      	}
+
+      	memset(pool->bytes, 0, sizeof(pool->bytes));
+
+/* THE FRONT OF THE KEYSTREAM KEYS THE NEXT REFILL AND IS WIPED, THE REST ARE THE IVS */
+
+      	if (!EVP_EncryptUpdate(pool->aes, pool->bytes, &len, pool->bytes, (int)sizeof(pool->bytes)) || !EVP_EncryptInit_ex(pool->aes, NULL, NULL, pool->bytes, pool->bytes + 32)) {
+            	pool->generation = 0;
+            	return false;
+      	}
+
+      	OPENSSL_cleanse(pool->bytes, AKUMA_IV_SEED_BYTES);
+      	pool->next = AKUMA_IV_SEED_BYTES;
+      	pool->since_seed += sizeof(pool->bytes);
+
+      	return true;
+}
+
+int Akuma_IVs(unsigned char * ivs, size_t count) {
+      	struct AkumaIVPool * pool = &akuma_iv_pool;
+
+      	while (count > 0) {
+            	if (pool->next >= sizeof(pool->bytes) || pool->generation != akuma_iv_generation) {
+                  	if (!iv_refill(pool)) {
+                        	pool->next = sizeof(pool->bytes);
+                        	return 0;
+			}
+		}
+
+            	size_t n = (sizeof(pool->bytes) - pool->next) / AKUMA_IV_LENGTH_BYTES;
+
+            	if (n > count)
+                  	n = count;
+
+            	memcpy(ivs, pool->bytes + pool->next, n * AKUMA_IV_LENGTH_BYTES);
+            	OPENSSL_cleanse(pool->bytes + pool->next, n * AKUMA_IV_LENGTH_BYTES);
+
+            	pool->next += n * AKUMA_IV_LENGTH_BYTES;
+            	ivs += n * AKUMA_IV_LENGTH_BYTES;
+            	count -= n;
+      	}
+
+      	return 1;
+}
+
+int Akuma_IV(unsigned char * iv) {
+      	return Akuma_IVs(iv, 1);
+}
+
+
+/* BASE64
+ *
+ * TEXT SAFE CIPHERTEXT: STANDARD BASE64 (RFC 4648 SECTION 4, PADDED WITH '=') OR
+ * BASE64URL (SECTION 5, '-' AND '_', UNPADDED). THE CODEC RUNS ON THE BLOCK
+ * ENGINE'S SIMD UNIT, SO AKUMA_ENGINE PICKS IT TOO. DECODING ACCEPTS EITHER
+ * ALPHABET, WITH OR WITHOUT PADDING, AND SKIPS SPACES, TABS AND LINE BREAKS.
+ *
+ * Akuma_Base64Init() -> Akuma_Base64Encode() ... -> Akuma_Base64EncodeFinal()
+ * Akuma_Base64Init() -> Akuma_Base64Decode() ... -> Akuma_Base64DecodeFinal()
+ *
+ * THE STATE CARRIES AN UNFINISHED GROUP BETWEEN CALLS, SO INPUT CAN COME IN
+ * PIECES OF ANY SIZE. Akuma_Base64Encode() NEEDS AKUMA_BASE64_LENGTH(len + 2)
+ * BYTES OF out AND Akuma_Base64EncodeFinal() UP TO 4, Akuma_Base64Decode() NEEDS
+ * len BYTES AND Akuma_Base64DecodeFinal() UP TO 2. THE DECODER RETURNS -1 FOR A
+ * CHARACTER OUTSIDE THE ALPHABETS, DATA AFTER PADDING OR A TRUNCATED GROUP.
+ * NOTHING IS NUL TERMINATED.
+ *
+ * Akuma_EncryptUpdateBase64()/Akuma_DecryptUpdateBase64() FUSE THE CODEC WITH
+ * Akuma_EncryptUpdate()/Akuma_DecryptUpdate(): EACH AKUMA_AUTH_CHUNK SLICE IS
+ * TRANSFORMED AND ENCODED (OR DECODED AND TRANSFORMED) WHILE IT IS STILL IN
+ * CACHE, THROUGH ONE STACK BUFFER, INSTEAD OF A SECOND PASS OVER A SECOND COPY.
+ */
+
+#define AKUMA_BASE64_LENGTH(n) (4 * (((n) + 2) / 3))	/* PADDED LENGTH OF n BYTES */
+
+struct AkumaBase64 {
+      	bool url;			/* ENCODE BASE64URL */
+      	unsigned char carry[4];		/* BYTES (ENCODING) OR VALUES (DECODING) OF AN UNFINISHED GROUP */
+      	size_t carry_len;
+      	int padding;			/* DECODING: '=' STILL EXPECTED, -1 BEFORE ANY */
+};
+
+void Akuma_Base64Init(struct AkumaBase64 * b, int url) {
+      	memset(b, '\0', sizeof(*b));
+      	b->url = (url != 0);
+      	b->padding = -1;
+}
+
+size_t Akuma_Base64Encode(struct AkumaBase64 * b, const unsigned char * in, size_t len, char * out) {
+      	size_t written = 0;
+
+      	if (b->carry_len > 0) {
+            	while (b->carry_len < 3 && len > 0) {
+                  	b->carry[b->carry_len++] = *in++;
+                  	--len;
+            	}
+
+            	if (b->carry_len < 3)
+                  	return 0;
+
+            	base64_encode_scalar(b->carry, 3, out, b->url);
+            	b->carry_len = 0;
+            	written = 4;
+      	}
+
+      	size_t n = get_engine()->base64_encode(in, len, out + written, b->url);
+
+      	b->carry_len = len - n;
+      	memcpy(b->carry, in + n, b->carry_len);
+
+      	return written + n / 3 * 4;
+}
+
+size_t Akuma_Base64EncodeFinal(struct AkumaBase64 * b, char * out) {
+      	const char * alphabet = akuma_base64_alphabet[b->url?1:0];
+      	size_t n = b->carry_len;
+
+      	if (n == 0)
+            	return 0;
+
+      	uint32_t w = ((uint32_t)b->carry[0] << 16) | ((n > 1)?((uint32_t)b->carry[1] << 8):0);
+
+      	out[0] = alphabet[(w >> 18) & 63];
+      	out[1] = alphabet[(w >> 12) & 63];
+      	out[2] = (n > 1)?alphabet[(w >> 6) & 63]:'=';
+      	out[3] = '=';
+
+      	memset(b->carry, '\0', sizeof(b->carry));
+      	b->carry_len = 0;
+
+      	return b->url?(n + 1):4;
+}
+
+size_t Akuma_Base64Decode(struct AkumaBase64 * b, const char * in, size_t len, unsigned char * out) {
+      	size_t written = 0;
+      	size_t i = 0;
+
+      	while (i < len) {
+
+/* ON A GROUP BOUNDARY THE ENGINE TAKES EVERY WHOLE GROUP UP TO THE NEXT ODD CHARACTER */
+
+            	if (b->carry_len == 0 && b->padding < 0) {
+                  	size_t n = get_engine()->base64_decode(in + i, len - i, out + written);
+
+                  	i += n;
+                  	written += n / 4 * 3;
+
+                  	if (i == len)
+                        	break;
+            	}
+
+            	unsigned char c = (unsigned char)in[i++];
+
+            	if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                  	continue;
+
+            	if (c == '=') {
+                  	if (b->padding > 0) {
+                        	--b->padding;
+                        	continue;
+                  	}
+
+                  	if (b->padding == 0 || b->carry_len < 2)
+                        	return (size_t)-1;
+
+/* xx== OR xxx=: EMIT WHAT THE GROUP HOLDS, THEN ONLY PADDING AND WHITESPACE MAY FOLLOW */
+
+                  	uint32_t w = ((uint32_t)b->carry[0] << 18) | ((uint32_t)b->carry[1] << 12) | ((uint32_t)b->carry[2] << 6);
+
+                  	out[written++] = (unsigned char)(w >> 16);
+
+                  	if (b->carry_len == 3)
+                        	out[written++] = (unsigned char)(w >> 8);
+
+                  	b->padding = (b->carry_len == 2)?1:0;
+                  	b->carry_len = 0;
+                  	continue;
+            	}
+
+            	int v = akuma_base64_values[c];
+
+            	if (v < 0 || b->padding >= 0)
+                  	return (size_t)-1;
+
+            	b->carry[b->carry_len++] = (unsigned char)v;
+
+            	if (b->carry_len == 4) {
+                  	uint32_t w = ((uint32_t)b->carry[0] << 18) | ((uint32_t)b->carry[1] << 12) | ((uint32_t)b->carry[2] << 6) | b->carry[3];
+
+                  	out[written++] = (unsigned char)(w >> 16);
+                  	out[written++] = (unsigned char)(w >> 8);
+                  	out[written++] = (unsigned char)w;
+                  	b->carry_len = 0;
+            	}
+      	}
+
+      	return written;
+}
+
+/* AN UNPADDED TAIL OF 2 OR 3 CHARACTERS IS FINE, A LONE CHARACTER OR A MISSING '=' IS NOT */
+
+int Akuma_Base64DecodeFinal(struct AkumaBase64 * b, unsigned char * out) {
+      	size_t n = b->carry_len;
+      	int written = -1;
+
+      	if (n != 1 && b->padding <= 0) {
+            	uint32_t w = ((uint32_t)b->carry[0] << 18) | ((uint32_t)b->carry[1] << 12) | ((uint32_t)b->carry[2] << 6);
+
+            	written = (n > 1)?(int)(n - 1):0;
+
+            	if (n > 1)
+                  	out[0] = (unsigned char)(w >> 16);
+
+            	if (n > 2)
+                  	out[1] = (unsigned char)(w >> 8);
+      	}
+
+      	memset(b->carry, '\0', sizeof(b->carry));
+      	b->carry_len = 0;
+      	b->padding = -1;
+
+      	return written;
+}
+
+/* SLICE OF THE FUSED FUNCTIONS, ONE FULL SLICE PER THREAD WHEN THE STREAM RUNS SEVERAL */
+
+static size_t base64_slice(const Akuma_Stream * s, unsigned char ** scratch, unsigned char * stack) {
+      	unsigned int threads = Akuma_Threads(s->threads);
+      	size_t slice = (size_t)threads * AKUMA_PARALLEL_MIN_BLOCKS * AKUMA_BLOCK_SIZE_BYTES;
+
+      	*scratch = stack;
+
+      	if (threads <= 1 || slice <= AKUMA_AUTH_CHUNK || (*scratch = malloc(slice + AKUMA_BLOCK_SIZE_BYTES)) == NULL) {
+            	*scratch = stack;
+            	return AKUMA_AUTH_CHUNK;
+      	}
+
+      	return slice;
+}
+
+/* out NEEDS AKUMA_BASE64_LENGTH(in_len + AKUMA_BLOCK_SIZE_BYTES + 2) BYTES, RETURNS THE CHARACTERS WRITTEN OR -1 (SEE Akuma_EncryptUpdate()) */
+
+size_t Akuma_EncryptUpdateBase64(Akuma_CTX * ctx, struct AkumaBase64 * b, const unsigned char * in, size_t in_len, char * out) {
+      	unsigned char stack[AKUMA_AUTH_CHUNK + AKUMA_BLOCK_SIZE_BYTES];
+      	unsigned char * scratch;
+      	Akuma_Stream * s = ctx_stream(ctx);
+      	size_t slice = base64_slice(s, &scratch, stack);
+      	size_t written = 0;
+
+      	for (size_t pos = 0; pos < in_len; pos += slice) {
+            	size_t n = (in_len - pos < slice)?(in_len - pos):slice;
+
+            	n = stream_update(s, in + pos, n, scratch, true);
+
+            	if (n == (size_t)-1) {
+                  	written = (size_t)-1;
+                  	break;
+            	}
+
+            	written += Akuma_Base64Encode(b, scratch, n, out + written);
+      	}
+
+      	if (scratch != stack)
+            	free(scratch);
+
+      	return written;
+}
+
+/* out NEEDS in_len + AKUMA_BLOCK_SIZE_BYTES BYTES, RETURNS THE BYTES WRITTEN OR -1 FOR BAD BASE64 OR NO KEYSTREAM */
+
+size_t Akuma_DecryptUpdateBase64(Akuma_CTX * ctx, struct AkumaBase64 * b, const char * in, size_t in_len, unsigned char * out) {
+      	unsigned char stack[AKUMA_AUTH_CHUNK + AKUMA_BLOCK_SIZE_BYTES];
+      	unsigned char * scratch;
+      	Akuma_Stream * s = ctx_stream(ctx);
+      	size_t slice = base64_slice(s, &scratch, stack);
+      	size_t written = 0;
+
+      	for (size_t pos = 0; pos < in_len; pos += slice) {
+            	size_t n = (in_len - pos < slice)?(in_len - pos):slice;
+
+            	n = Akuma_Base64Decode(b, in + pos, n, scratch);
+
+            	if (n == (size_t)-1) {
+                  	written = (size_t)-1;
+                  	break;
+            	}
+
+            	n = stream_update(s, scratch, n, out + written, false);
+
+            	if (n == (size_t)-1) {
+                  	written = (size_t)-1;
+                  	break;
+            	}
+
+            	written += n;
+      	}
+
+      	if (scratch != stack)
+            	free(scratch);
+
+      	return written;
 }
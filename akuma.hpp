@@ -0,0 +1,332 @@
+/* AKUMA FOR C++20: HEADER ONLY, NO OPENSSL, CHAINED MODE WITH PKCS#7 PADDING
+ *
+ * THE BLOCK IS A 4 x (BITS / 32) BYTE MATRIX. A BLOCK IS XORED WITH THE KEYROUND,
+ * WHICH THEN BECOMES THE KEYROUND OF THE NEXT BLOCK, AND PERMUTED: ROW r MOVES TO
+ * ROW (r + 2) % 4 AND EVERY ROW IS REVERSED. THE PERMUTATION IS ITS OWN INVERSE
+ * AND IS BUILT AS A constexpr TABLE PER BLOCK SIZE, SO EACH INSTANTIATION IS A
+ * FIXED SHUFFLE THE COMPILER UNROLLS OR VECTORIZES, WITH NO SHAPE CHECKS AT RUNTIME.
+ *
+ * akuma::Encryptor<256> AND akuma::Decryptor<256> ARE BYTE IDENTICAL TO THE
+ * AKUMA_MODE_CHAIN STREAMING FUNCTIONS OF akuma.h. 512 AND 1024 BIT BLOCKS TAKE A
+ * KEY AND IV OF THE SAME SIZE AND ARE ONLY READABLE BY THIS HEADER.
+ *
+ *   akuma::Encryptor<> enc(key, iv);
+ *   size_t n = enc.update(plaintext, out);	// out: in.size() + block_bytes
+ *   n += enc.final(std::span(out).subspan(n));
+ *
+ * CONTEXTS DO NOT KEEP THE KEY, ONLY THE KEYROUND (KEY ^ IV AT FIRST) AND A
+ * PARTIAL BLOCK. THEY ARE MOVE ONLY AND WIPE THEMSELVES WHEN DESTROYED OR MOVED
+ * FROM. MISUSE AND BAD PADDING THROW akuma::error.
+ */
+
+#ifndef AKUMA_HPP
+#define AKUMA_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace akuma {
+
+class error : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+/* BLOCK GEOMETRY */
+
+template <std::size_t Bits>
+struct geometry {
+	static_assert(Bits == 256 || Bits == 512 || Bits == 1024, "AKUMA BLOCKS ARE 256, 512 OR 1024 BITS");
+
+	static constexpr std::size_t bytes = Bits / 8;
+	static constexpr std::size_t rows = 4;
+	static constexpr std::size_t columns = bytes / rows;
+
+	/* out[i] = in[permutation[i]], THE SAME TABLE UNDOES ITSELF */
+
+	static constexpr std::array<std::uint8_t, bytes> permutation = [] {
+		std::array<std::uint8_t, bytes> table {};
+
+		for (std::size_t r = 0; r < rows; ++r) {
+			for (std::size_t c = 0; c < columns; ++c)
+				table[r * columns + c] = static_cast<std::uint8_t>(((r + rows / 2) % rows) * columns + (columns - 1 - c));
+		}
+
+		return table;
+	}();
+};
+
+namespace detail {
+
+/* WIPE THROUGH A VOLATILE POINTER SO THE STORE IS NOT OPTIMIZED AWAY */
+
+inline void cleanse(void * p, std::size_t n) {
+	volatile unsigned char * v = static_cast<volatile unsigned char *>(p);
+
+	while (n-- > 0)
+		*v++ = 0;
+}
+
+/* THE PERMUTATION EXPANDED AT COMPILE TIME, ONE CONSTANT SHUFFLE (vpermb, pshufb) WHERE THE TARGET HAS ONE */
+
+template <std::size_t Bits, std::size_t... I>
+inline void permute(const unsigned char * in, unsigned char * out, std::index_sequence<I...>) {
+	const unsigned char x[geometry<Bits>::bytes] = { in[geometry<Bits>::permutation[I]]... };
+
+	std::memcpy(out, x, sizeof(x));
+}
+
+template <std::size_t Bits>
+inline void encrypt_block(unsigned char * keyround, const unsigned char * in, unsigned char * out) {
+	constexpr std::size_t n = geometry<Bits>::bytes;
+	unsigned char x[n];
+
+	for (std::size_t i = 0; i < n; ++i)
+		x[i] = keyround[i] ^ in[i];
+
+	std::memcpy(keyround, x, n);
+	permute<Bits>(x, out, std::make_index_sequence<n>());
+}
+
+/* in AND out MAY BE THE SAME BLOCK */
+
+template <std::size_t Bits>
+inline void decrypt_block(unsigned char * keyround, const unsigned char * in, unsigned char * out) {
+	constexpr std::size_t n = geometry<Bits>::bytes;
+	unsigned char x[n];
+
+	permute<Bits>(in, x, std::make_index_sequence<n>());
+
+	for (std::size_t i = 0; i < n; ++i) {
+		out[i] = x[i] ^ keyround[i];
+		keyround[i] = x[i];
+	}
+}
+
+/* KEYROUND AND PARTIAL BLOCK SHARED BY BOTH DIRECTIONS, THE KEY ITSELF IS NOT KEPT */
+
+template <std::size_t Bits>
+class context {
+public:
+	static constexpr std::size_t block_bytes = geometry<Bits>::bytes;
+
+	context(std::span<const unsigned char, block_bytes> key, std::span<const unsigned char, block_bytes> iv) {
+		for (std::size_t i = 0; i < block_bytes; ++i)
+			keyround_[i] = key[i] ^ iv[i];
+	}
+
+	context(const context &) = delete;
+	context & operator=(const context &) = delete;
+
+	context(context && other) noexcept {
+		take(other);
+	}
+
+	context & operator=(context && other) noexcept {
+		if (this != &other)
+			take(other);
+
+		return *this;
+	}
+
+	~context() {
+		cleanse(this, sizeof(*this));
+	}
+
+protected:
+	static void need(std::span<unsigned char> out, std::size_t n) {
+		if (out.size() < n)
+			throw error("akuma: output span too small");
+	}
+
+	unsigned char keyround_[block_bytes] {};
+	unsigned char buffer_[block_bytes] {};
+	std::size_t buffer_len_ = 0;
+
+private:
+	void take(context & other) noexcept {
+		std::memcpy(keyround_, other.keyround_, block_bytes);
+		std::memcpy(buffer_, other.buffer_, block_bytes);
+		buffer_len_ = other.buffer_len_;
+
+		cleanse(&other, sizeof(other));
+	}
+};
+
+} /* namespace detail */
+
+
+/* STREAMING ENCRYPTION: update() ... final(), INPUT IN PIECES OF ANY SIZE */
+
+template <std::size_t Bits = 256>
+class Encryptor : public detail::context<Bits> {
+	using base = detail::context<Bits>;
+
+public:
+	using base::base;
+	using base::block_bytes;
+
+	/* out NEEDS in.size() + block_bytes BYTES, RETURNS THE BYTES WRITTEN */
+
+	std::size_t update(std::span<const unsigned char> in, std::span<unsigned char> out) {
+		base::need(out, in.size() + block_bytes);
+
+		std::size_t written = 0;
+		std::size_t pos = 0;
+
+		if (in.empty())
+			return 0;
+
+		if (this->buffer_len_ > 0) {
+			std::size_t n = std::min(block_bytes - this->buffer_len_, in.size());
+
+			std::memcpy(this->buffer_ + this->buffer_len_, in.data(), n);
+			this->buffer_len_ += n;
+			pos = n;
+
+			if (this->buffer_len_ < block_bytes)
+				return 0;
+
+			detail::encrypt_block<Bits>(this->keyround_, this->buffer_, out.data());
+			this->buffer_len_ = 0;
+			written = block_bytes;
+		}
+
+		for (; in.size() - pos >= block_bytes; pos += block_bytes, written += block_bytes)
+			detail::encrypt_block<Bits>(this->keyround_, in.data() + pos, out.data() + written);
+
+		this->buffer_len_ = in.size() - pos;
+		std::memcpy(this->buffer_, in.data() + pos, this->buffer_len_);
+
+		return written;
+	}
+
+	/* PKCS#7 PAD WHAT IS LEFT, ALWAYS WRITES ONE BLOCK */
+
+	std::size_t final(std::span<unsigned char> out) {
+		base::need(out, block_bytes);
+
+		unsigned char n = static_cast<unsigned char>(block_bytes - this->buffer_len_);
+
+		std::memset(this->buffer_ + this->buffer_len_, n, n);
+		detail::encrypt_block<Bits>(this->keyround_, this->buffer_, out.data());
+
+		detail::cleanse(this->buffer_, block_bytes);
+		this->buffer_len_ = 0;
+
+		return block_bytes;
+	}
+};
+
+/* STREAMING DECRYPTION: THE LAST BLOCK IS HELD BACK UNTIL final() REMOVES ITS PADDING */
+
+template <std::size_t Bits = 256>
+class Decryptor : public detail::context<Bits> {
+	using base = detail::context<Bits>;
+
+public:
+	using base::base;
+	using base::block_bytes;
+
+	/* out NEEDS in.size() + block_bytes BYTES, RETURNS THE BYTES WRITTEN */
+
+	std::size_t update(std::span<const unsigned char> in, std::span<unsigned char> out) {
+		base::need(out, in.size() + block_bytes);
+
+		std::size_t written = 0;
+		std::size_t pos = 0;
+
+		if (in.empty())
+			return 0;
+
+		if (this->buffer_len_ > 0) {
+			std::size_t n = std::min(block_bytes - this->buffer_len_, in.size());
+
+			std::memcpy(this->buffer_ + this->buffer_len_, in.data(), n);
+			this->buffer_len_ += n;
+			pos = n;
+
+			if (this->buffer_len_ < block_bytes || pos == in.size())
+				return 0;
+
+			detail::decrypt_block<Bits>(this->keyround_, this->buffer_, out.data());
+			this->buffer_len_ = 0;
+			written = block_bytes;
+		}
+
+		for (; in.size() - pos > block_bytes; pos += block_bytes, written += block_bytes)
+			detail::decrypt_block<Bits>(this->keyround_, in.data() + pos, out.data() + written);
+
+		this->buffer_len_ = in.size() - pos;
+		std::memcpy(this->buffer_, in.data() + pos, this->buffer_len_);
+
+		return written;
+	}
+
+	/* CHECKS AND REMOVES THE PADDING, RETURNS THE BYTES WRITTEN */
+
+	std::size_t final(std::span<unsigned char> out) {
+		unsigned char block[block_bytes];
+
+		if (this->buffer_len_ != block_bytes)
+			throw error("akuma: ciphertext is not a whole number of blocks");
+
+		detail::decrypt_block<Bits>(this->keyround_, this->buffer_, block);
+		this->buffer_len_ = 0;
+
+		std::size_t p = block[block_bytes - 1];
+		bool ok = (p >= 1 && p <= block_bytes);
+
+		for (std::size_t i = block_bytes - (ok?p:0); i < block_bytes; ++i)
+			ok = ok && block[i] == p;
+
+		if (!ok) {
+			detail::cleanse(block, block_bytes);
+			throw error("akuma: bad padding (wrong key or corrupted ciphertext)");
+		}
+
+		base::need(out, block_bytes - p);
+		std::memcpy(out.data(), block, block_bytes - p);
+		detail::cleanse(block, block_bytes);
+
+		return block_bytes - p;
+	}
+};
+
+
+/* ONE-SHOT */
+
+template <std::size_t Bits = 256>
+std::vector<unsigned char> encrypt(std::span<const unsigned char, Bits / 8> key, std::span<const unsigned char, Bits / 8> iv, std::span<const unsigned char> plaintext) {
+	Encryptor<Bits> enc(key, iv);
+	std::vector<unsigned char> out(plaintext.size() + Bits / 8);
+
+	std::size_t n = enc.update(plaintext, out);
+	n += enc.final(std::span(out).subspan(n));
+	out.resize(n);
+
+	return out;
+}
+
+template <std::size_t Bits = 256>
+std::vector<unsigned char> decrypt(std::span<const unsigned char, Bits / 8> key, std::span<const unsigned char, Bits / 8> iv, std::span<const unsigned char> ciphertext) {
+	Decryptor<Bits> dec(key, iv);
+	std::vector<unsigned char> out(ciphertext.size() + Bits / 8);
+
+	std::size_t n = dec.update(ciphertext, out);
+	n += dec.final(std::span(out).subspan(n));
+	out.resize(n);
+
+	return out;
+}
+
+} /* namespace akuma */
+
+#endif